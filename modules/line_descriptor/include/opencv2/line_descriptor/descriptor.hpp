@@ -155,6 +155,10 @@ binary descriptor.
 Class' interface is mainly based on the ones of classical detectors and extractors, such as
 Feature2d's @ref features2d_main and @ref features2d_match. Retrieved information about lines is
 stored in line_descriptor::KeyLine objects.
+
+An instance keeps its line detectors and image buffers between calls, including the const ones, so
+it must not be used by several threads at the same time. Use one instance per thread, or the
+overloads taking a vector of images, which process the images in parallel with their own workers.
  */
 class CV_EXPORTS BinaryDescriptor : public Algorithm
 {
@@ -253,6 +257,8 @@ class CV_EXPORTS BinaryDescriptor : public Algorithm
     @param images input images
     @param keylines set of vectors that will store extracted lines for one or more images
     @param masks vector of mask matrices to detect only KeyLines of interest from each input image
+
+    Images are processed in parallel, see BinaryDescriptor::detectAndCompute.
      */
   void detect( const std::vector<Mat>& images, std::vector<std::vector<KeyLine> >& keylines, const std::vector<Mat>& masks =
                    std::vector<Mat>() ) const;
@@ -272,10 +278,31 @@ class CV_EXPORTS BinaryDescriptor : public Algorithm
     @param keylines set of vectors containing lines for which descriptors must be computed
     @param descriptors
     @param returnFloatDescr flag (when set to true, original non-binary descriptors are returned)
+
+    Images are processed in parallel, see BinaryDescriptor::detectAndCompute.
      */
   void compute( const std::vector<Mat>& images, std::vector<std::vector<KeyLine> >& keylines, std::vector<Mat>& descriptors, bool returnFloatDescr =
                     false ) const;
 
+  /** @brief Detect lines and compute their descriptors for a batch of images
+
+    @param images input images
+    @param keylines set of vectors that will store extracted lines for each image
+    @param descriptors vector that will store the descriptors of each image (an empty matrix for
+    images without lines)
+    @param masks vector of mask matrices to detect only KeyLines of interest from each input image
+    (may be empty)
+    @param returnFloatDescr flag (when set to true, original non-binary descriptors are returned)
+
+    Images are distributed among worker objects, one for each thread, that are kept between calls.
+    Every worker owns its pyramid, Sobel and edge buffers, and images of equal size are given to the
+    same worker one after the other, so that its buffers are reused instead of being allocated again.
+    Descriptors are computed from the pyramid built for detection, as operator() does. Results are
+    the same as processing the images one by one.
+     */
+  void detectAndCompute( const std::vector<Mat>& images, std::vector<std::vector<KeyLine> >& keylines, std::vector<Mat>& descriptors,
+                         const std::vector<Mat>& masks = std::vector<Mat>(), bool returnFloatDescr = false ) const;
+
   /** @brief Return descriptor size
    */
   int descriptorSize() const;
@@ -303,6 +330,15 @@ class CV_EXPORTS BinaryDescriptor : public Algorithm
   virtual void operator()( InputArray image, InputArray mask, CV_OUT std::vector<KeyLine>& keylines, OutputArray descriptors,
                            bool useProvidedKeyLines = false, bool returnFloatDescr = false ) const;
 
+  /** @brief Release internal buffers
+
+  Pyramid images, gradients and edge buffers are kept between calls and reused when the next image
+  has the same size, so that processing a video does not allocate them for every frame. This
+  function gives their memory back, together with the workers used by the batch functions; they are
+  allocated again by the next call.
+     */
+  void release();
+
  protected:
   /** implementation of line detection */
   virtual void detectImpl( const Mat& imageSrc, std::vector<KeyLine>& keylines, const Mat& mask = Mat() ) const;
@@ -452,6 +488,9 @@ class CV_EXPORTS BinaryDescriptor : public Algorithm
     /** extract line from image, and store them */
     int EDline( cv::Mat &image );
 
+    /** release buffers that are kept between calls (they are sized by the image) */
+    void release();
+
     cv::Mat dxImg_;  //store the dxImg;
 
     cv::Mat dyImg_;  //store the dyImg;
@@ -461,10 +500,10 @@ class CV_EXPORTS BinaryDescriptor : public Algorithm
     LineChains lines_;  //store the detected line chains;
 
     //store the line Equation coefficients, vec3=[w1,w2,w3] for line w1*x + w2*y + w3=0;
-    std::vector<std::vector<double> > lineEquations_;
+    std::vector<cv::Vec3d> lineEquations_;
 
     //store the line endpoints, [x1,y1,x2,y3]
-    std::vector<std::vector<float> > lineEndpoints_;
+    std::vector<cv::Vec4f> lineEndpoints_;
 
     //store the line direction
     std::vector<float> lineDirection_;
@@ -595,6 +634,15 @@ class CV_EXPORTS BinaryDescriptor : public Algorithm
 
     cv::Mat_<float> tempVecLineFit;    //the vector used in line fit function;
 
+    /* scratch buffers reused between calls */
+    cv::Mat dxABS_m_, dyABS_m_, sumDxDy_;  //absolute derivatives and their sum
+    cv::Mat anchorMask_;  //anchor flags of the scanned rows, optimized path only
+    EdgeChains edges_;  //edge chains extracted by EdgeDrawing
+    std::vector<double> lineEquation_;  //[a,b] of the line being fitted
+    std::vector<double> lineEqu_;  //normalized [w1,w2,w3] of the line being validated
+    std::vector<double> pointDirection_;  //gradient directions of the pixels of a line
+    std::vector<float> fitBuffer_;  //data of the matrices used in the incremental line fit
+
     /** Compare doubles by relative error.
      The resulting rounding error after floating point computations
      depend on the specific operations done. The same number computed by
@@ -818,13 +866,30 @@ void computeSobel( const Mat& image, const int numOctaves );
 /* conversion of an LBD descriptor to its binary representation */
 unsigned char binaryConversion( float* f1, float* f2 );
 
-/* compute LBD descriptors using EDLine extractor */
+/* compute LBD descriptors using EDLine extractor (lines are processed in parallel) */
 int computeLBD( ScaleLines &keyLines, bool useDetectionData = false );
 
+/* compute LBD descriptors of the LineVecs in range */
+void computeLBD( ScaleLines &keyLines, bool useDetectionData, const Range& range ) const;
+
+/* parallel bodies of OctaveKeyLines and computeLBD */
+class EDLineInvoker;
+class ComputeLBDInvoker;
+friend class EDLineInvoker;
+friend class ComputeLBDInvoker;
+
 /* gathers lines in groups using EDLine extractor.
  Each group contains the same line, detected in different octaves */
 int OctaveKeyLines( cv::Mat& image, ScaleLines &keyLines );
 
+/* process a batch of images in parallel (detection, description or both) using batchWorkers_ */
+void processBatch( const std::vector<Mat>& images, const std::vector<Mat>& masks, std::vector<std::vector<KeyLine> >& keylines,
+                   std::vector<Mat>* descriptors, bool detectLines, bool returnFloatDescr ) const;
+
+/* parallel body of processBatch */
+class BatchInvoker;
+friend class BatchInvoker;
+
 /* the local gaussian coefficient applied to the orthogonal line direction within each band */
 std::vector<double> gaussCoefL_;
 
@@ -849,6 +914,14 @@ std::vector<cv::Mat> dxImg_vector, dyImg_vector;
 /* Gaussian pyramid */
 std::vector<cv::Mat> octaveImages;
 
+/* buffers kept between calls of detection: gray input, blurred and resized octaves */
+cv::Mat grayImage_;
+std::vector<cv::Mat> octaveBlurred_;
+std::vector<cv::Mat> octaveResized_;
+
+/* workers of the batch functions, one for each thread, each with its own buffers */
+std::vector<Ptr<BinaryDescriptor> > batchWorkers_;
+
 };
 
 /**
@@ -1041,11 +1114,32 @@ void add( const std::vector<Mat>& descriptors );
 
 /** @brief Update dataset by inserting into it all descriptors that were stored locally by *add* function.
 
-@note Every time this function is invoked, current dataset is deleted and locally stored descriptors
-are inserted into dataset. The locally stored copy of just inserted descriptors is then removed.
+@note Locally stored descriptors are appended to the current dataset, so the cost of this function
+depends only on the number of descriptors added since the previous call. The locally stored copy of
+just inserted descriptors is then removed.
  */
 void train();
 
+/** @brief Remove from dataset all descriptors relative to an image.
+
+@param imgIdx index of the image, as it was assigned by *add* function
+
+@note Descriptors are only marked as removed and are ignored by matching functions; their memory is
+given back by *compact*. Indices of the other images do not change.
+ */
+void remove( int imgIdx );
+
+/** @brief Rebuild dataset without the descriptors removed by *remove* function.
+
+@note Descriptors of the remaining images are renumbered, so *trainIdx* fields of matches obtained
+before compaction are no longer valid.
+ */
+void compact();
+
+/** @brief Return the number of bytes used by dataset (descriptors and hash tables).
+ */
+size_t getMemoryFootprint() const;
+
 /** @brief Create a BinaryDescriptorMatcher object and return a smart pointer to it.
  */
 static Ptr<BinaryDescriptorMatcher> createBinaryDescriptorMatcher();
@@ -1121,6 +1215,9 @@ void insert( UINT64 index, UINT32 data );
 /** query data */
 UINT32* query( UINT64 index, int* size );
 
+/** bytes used by bins */
+size_t memoryFootprint() const;
+
 /** Bits per index */
 int b;
 
@@ -1220,20 +1317,23 @@ int K;
 /** Number of codes */
 UINT64 N;
 
+/** Number of codes marked as removed */
+UINT64 numRemoved;
+
+/** Removal flags of codes (empty when no code has been removed) */
+std::vector<uchar> removed;
+
 /** Table of original full-length codes */
 cv::Mat codes;
 
-/** Counter for eliminating duplicate results (it is not thread safe) */
-bitarray *counter;
-
 /** Array of m hashtables */
 SparseHashtable *H;
 
 /** Volume of a b-bit Hamming ball with radius s (for s = 0 to d) */
 UINT32 *xornum;
 
-/** Used within generation of binary codes at a certain Hamming distance */
-int power[100];
+/** Whether full codes are compared with the vectorized 256-bit popcount */
+bool useSIMDMatch;
 
 /** constructor */
 Mihasher();
@@ -1250,13 +1350,27 @@ void setK( int K );
 /** populate tables */
 void populate( cv::Mat & codes, UINT32 N, int dim1codes );
 
-/** execute a batch query */
+/** append codes to tables, new codes are numbered from N on */
+void append( const cv::Mat & newCodes );
+
+/** mark a code as removed, queries skip it */
+void remove( UINT32 index );
+
+/** bytes used by codes and tables */
+size_t memoryFootprint() const;
+
+/** execute a batch query (queries are processed in parallel) */
 void batchquery( UINT32 * results, UINT32 *numres/*, qstat *stats*/, const cv::Mat & q, UINT32 numq, int dim1queries );
 
 private:
 
-/** execute a single query */
-void query( UINT32 * results, UINT32* numres/*, qstat *stats*/, UINT8 *q, UINT64 * chunks, UINT32 * res );
+/** parallel body of batchquery, it owns the per-thread query buffers */
+class BatchqueryInvoker;
+friend class BatchqueryInvoker;
+
+/** execute a single query; counter (N bits) and power (at least d + 1 entries)
+ are scratch buffers owned by the calling thread */
+void query( UINT32 * results, UINT32* numres/*, qstat *stats*/, UINT8 *q, UINT64 * chunks, UINT32 * res, bitarray& counter, int* power );
 };
 
 /** retrieve Hamming distances */
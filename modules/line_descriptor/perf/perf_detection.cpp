@@ -136,3 +136,121 @@ PERF_TEST_P(file_str, detect_lsd, testing::Values(IMAGES))
   SANITY_CHECK( lines );
 
 }
+
+/* counts the buffers allocated by cv::Mat, and separately the ones of at least imageBytes,
+ delegating the work to the standard allocator */
+class CountingMatAllocator : public MatAllocator
+{
+ public:
+  CountingMatAllocator( size_t _imageBytes ) :
+      count( 0 ),
+      imageCount( 0 ),
+      imageBytes( _imageBytes ),
+      stdAllocator( Mat::getStdAllocator() )
+  {
+  }
+
+  UMatData* allocate( int dims, const int* sizes, int type, void* data, size_t* step, int flags, UMatUsageFlags usageFlags ) const
+  {
+    CV_XADD( &count, 1 );
+
+    size_t bytes = CV_ELEM_SIZE( type );
+    for ( int i = 0; i < dims; i++ )
+      bytes *= sizes[i];
+    if( bytes >= imageBytes )
+      CV_XADD( &imageCount, 1 );
+
+    return stdAllocator->allocate( dims, sizes, type, data, step, flags, usageFlags );
+  }
+
+  bool allocate( UMatData* data, int accessflags, UMatUsageFlags usageFlags ) const
+  {
+    return stdAllocator->allocate( data, accessflags, usageFlags );
+  }
+
+  void deallocate( UMatData* data ) const
+  {
+    stdAllocator->deallocate( data );
+  }
+
+  mutable int count;
+  mutable int imageCount;
+
+ private:
+  size_t imageBytes;
+  MatAllocator* stdAllocator;
+};
+
+/* buffers of the detector are kept between frames of the same size,
+ so after the first frame detection should not allocate image buffers */
+PERF_TEST_P(file_str, detect_allocations, testing::Values(IMAGES))
+{
+  std::string filename = getDataPath( GetParam() );
+
+  Mat frame = imread( filename, 1 );
+
+  if( frame.empty() )
+    FAIL()<< "Unable to load source image " << filename;
+
+  std::vector<KeyLine> keylines;
+  Ptr<BinaryDescriptor> bd = BinaryDescriptor::createBinaryDescriptor();
+
+  /* first frame allocates the buffers */
+  bd->detect( frame, keylines );
+
+  const int numFrames = 10;
+  /* anything as large as the gray frame is an image buffer */
+  CountingMatAllocator allocator( frame.total() );
+  MatAllocator* defaultAllocator = Mat::getDefaultAllocator();
+  Mat::setDefaultAllocator( &allocator );
+
+  TEST_CYCLE_N( numFrames )
+  {
+    keylines.clear();
+    bd->detect( frame, keylines );
+  }
+
+  Mat::setDefaultAllocator( defaultAllocator );
+
+  double allocationsPerFrame = (double) allocator.count / numFrames;
+  RecordProperty( "mat_allocations_per_frame", (int) cvRound( allocationsPerFrame ) );
+
+  bd->release();
+
+  EXPECT_EQ( 0, allocator.imageCount );
+
+  SANITY_CHECK_NOTHING();
+}
+
+typedef std::tr1::tuple<std::string, int> file_threads_t;
+typedef perf::TestBaseWithParam<file_threads_t> file_threads;
+
+/* a batch of frames of the same size is shared among per-thread workers */
+PERF_TEST_P(file_threads, detect_compute_batch, testing::Combine(testing::Values(IMAGES), testing::Values(1, 2, 4, 8)))
+{
+  std::string filename = getDataPath( get<0>( GetParam() ) );
+  int threads = get<1>( GetParam() );
+
+  Mat frame = imread( filename, 1 );
+
+  if( frame.empty() )
+    FAIL()<< "Unable to load source image " << filename;
+
+  std::vector<Mat> frames( 32, frame );
+  std::vector<std::vector<KeyLine> > keylines;
+  std::vector<Mat> descriptors;
+  Ptr<BinaryDescriptor> bd = BinaryDescriptor::createBinaryDescriptor();
+
+  int oldThreads = getNumThreads();
+  setNumThreads( threads );
+
+  declare.time( 60 );
+  TEST_CYCLE()
+  {
+    bd->detectAndCompute( frames, keylines, descriptors );
+  }
+
+  setNumThreads( oldThreads );
+
+  SANITY_CHECK_NOTHING();
+}
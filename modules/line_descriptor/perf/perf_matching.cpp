@@ -185,3 +185,41 @@ PERF_TEST(radius_match, radius_match_distances_test)
 
 }
 
+
+typedef perf::TestBaseWithParam<int> MatchingThreads;
+
+/* a SLAM-like batch: thousands of queries against a map of keyframe descriptors */
+PERF_TEST_P(MatchingThreads, batch_match, testing::Values( 1, 2, 4, 8 ))
+{
+  Mat query( 4000, DIM, CV_8UC1 ), train;
+  std::vector<DMatch> dm;
+  Ptr<BinaryDescriptorMatcher> bd = BinaryDescriptorMatcher::createBinaryDescriptorMatcher();
+
+  RNG rng( 0 );
+  rng.fill( query, RNG::UNIFORM, Scalar( 0 ), Scalar( 256 ) );
+  for ( int i = 0; i < query.rows; i++ )
+  {
+    for ( int j = 0; j < COUNT_FACTOR; j++ )
+    {
+      train.push_back( query.row( i ) );
+      int randCol = rng.uniform( 0, DIM );
+      train.at<uchar>( i * COUNT_FACTOR + j, randCol ) ^= (uchar) ( 1 << j );
+    }
+  }
+
+  std::vector<Mat> keyframes( 1, train );
+  bd->add( keyframes );
+  bd->train();
+
+  setNumThreads( GetParam() );
+
+  TEST_CYCLE()
+  {
+    dm.clear();
+    bd->match( query, dm );
+  }
+
+  setNumThreads( -1 );
+
+  SANITY_CHECK_NOTHING();
+}
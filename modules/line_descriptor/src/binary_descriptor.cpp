@@ -291,6 +291,22 @@ BinaryDescriptor::~BinaryDescriptor()
 
 }
 
+/* release buffers kept between calls */
+void BinaryDescriptor::release()
+{
+  grayImage_.release();
+  std::vector<cv::Mat>().swap( octaveBlurred_ );
+  std::vector<cv::Mat>().swap( octaveResized_ );
+  std::vector<cv::Mat>().swap( octaveImages );
+  std::vector<cv::Mat>().swap( dxImg_vector );
+  std::vector<cv::Mat>().swap( dyImg_vector );
+
+  for ( size_t i = 0; i < edLineVec_.size(); i++ )
+    edLineVec_[i]->release();
+
+  std::vector<Ptr<BinaryDescriptor> >().swap( batchWorkers_ );
+}
+
 /* read parameters from a FileNode object and store them (class function ) */
 void BinaryDescriptor::read( const cv::FileNode& fn )
 {
@@ -336,23 +352,22 @@ static inline int get2Pow( int i )
 /* compute Gaussian pyramids */
 void BinaryDescriptor::computeGaussianPyramid( const Mat& image, const int numOctaves )
 {
-  /* clear class fields */
-  images_sizes.clear();
-  octaveImages.clear();
+  /* resize class fields; images of the same size as in previous call
+   are computed in place */
+  images_sizes.resize( numOctaves );
+  octaveImages.resize( numOctaves );
 
   /* insert input image into pyramid */
-  cv::Mat currentMat = image.clone();
-  cv::GaussianBlur( currentMat, currentMat, cv::Size( 5, 5 ), 1 );
-  octaveImages.push_back( currentMat );
-  images_sizes.push_back( currentMat.size() );
+  cv::GaussianBlur( image, octaveImages[0], cv::Size( 5, 5 ), 1 );
+  images_sizes[0] = octaveImages[0].size();
 
   /* fill Gaussian pyramid */
   for ( int pyrCounter = 1; pyrCounter < numOctaves; pyrCounter++ )
   {
     /* compute and store next image in pyramid and its size */
-    pyrDown( currentMat, currentMat, Size( currentMat.cols / params.reductionRatio, currentMat.rows / params.reductionRatio ) );
-    octaveImages.push_back( currentMat );
-    images_sizes.push_back( currentMat.size() );
+    const cv::Mat& previous = octaveImages[pyrCounter - 1];
+    pyrDown( previous, octaveImages[pyrCounter], Size( previous.cols / params.reductionRatio, previous.rows / params.reductionRatio ) );
+    images_sizes[pyrCounter] = octaveImages[pyrCounter].size();
   }
 }
 
@@ -363,22 +378,13 @@ void BinaryDescriptor::computeSobel( const cv::Mat& image, const int numOctaves
   /* compute Gaussian pyramids */
   computeGaussianPyramid( image, numOctaves );
 
-  /* reinitialize class structures */
-  dxImg_vector.clear();
-  dyImg_vector.clear();
-
-//  dxImg_vector.resize( params.numOfOctave_ );
-//  dyImg_vector.resize( params.numOfOctave_ );
-
+  /* reinitialize class structures (existing derivatives are overwritten) */
   dxImg_vector.resize( octaveImages.size() );
   dyImg_vector.resize( octaveImages.size() );
 
   /* compute derivatives */
   for ( size_t sobelCnt = 0; sobelCnt < octaveImages.size(); sobelCnt++ )
   {
-    dxImg_vector[sobelCnt].create( images_sizes[sobelCnt].height, images_sizes[sobelCnt].width, CV_16SC1 );
-    dyImg_vector[sobelCnt].create( images_sizes[sobelCnt].height, images_sizes[sobelCnt].width, CV_16SC1 );
-
     cv::Sobel( octaveImages[sobelCnt], dxImg_vector[sobelCnt], CV_16SC1, 1, 0, 3 );
     cv::Sobel( octaveImages[sobelCnt], dyImg_vector[sobelCnt], CV_16SC1, 0, 1, 3 );
   }
@@ -425,34 +431,29 @@ void BinaryDescriptor::detect( const std::vector<Mat>& images, std::vector<std::
   }
 
   /* detect lines from each image */
-  for ( size_t counter = 0; counter < images.size(); counter++ )
-  {
-    if( masks[counter].data != NULL && ( masks[counter].size() != images[counter].size() || masks[counter].type() != CV_8UC1 ) )
-      throw std::runtime_error( "Masks error while detecting lines: please check their dimensions and that data types are CV_8UC1" );
-
-    else
-      detectImpl( images[counter], keylines[counter], masks[counter] );
-  }
+  processBatch( images, masks, keylines, NULL, true, false );
 }
 
 void BinaryDescriptor::detectImpl( const Mat& imageSrc, std::vector<KeyLine>& keylines, const Mat& mask ) const
 {
 
+  /* create a pointer to self */
+  BinaryDescriptor *bn = const_cast<BinaryDescriptor*>( this );
+
+  /* input image is only read, so a gray one is not copied */
   cv::Mat image;
   if( imageSrc.channels() != 1 )
   {
-    cvtColor( imageSrc, image, COLOR_BGR2GRAY );
+    cvtColor( imageSrc, bn->grayImage_, COLOR_BGR2GRAY );
+    image = bn->grayImage_;
   }
   else
-    image = imageSrc.clone();
+    image = imageSrc;
 
   /*check whether image depth is different from 0 */
   if( image.depth() != 0 )
     throw std::runtime_error( "Warning, depth image!= 0" );
 
-  /* create a pointer to self */
-  BinaryDescriptor *bn = const_cast<BinaryDescriptor*>( this );
-
   /* detect and arrange lines across octaves */
   ScaleLines sl;
   bn->OctaveKeyLines( image, sl );
@@ -517,20 +518,177 @@ void BinaryDescriptor::compute( const Mat& image, CV_OUT CV_IN_OUT std::vector<K
 void BinaryDescriptor::compute( const std::vector<Mat>& images, std::vector<std::vector<KeyLine> >& keylines, std::vector<Mat>& descriptors,
                                 bool returnFloatDescr ) const
 {
+  if( keylines.size() != images.size() )
+    throw std::runtime_error( "Error while computing descriptors: the number of keylines' vectors differs from the number of images" );
+
+  processBatch( images, std::vector<Mat>(), keylines, &descriptors, false, returnFloatDescr );
+}
+
+/* requires lines detection and descriptors computation (more than one image) */
+void BinaryDescriptor::detectAndCompute( const std::vector<Mat>& images, std::vector<std::vector<KeyLine> >& keylines, std::vector<Mat>& descriptors,
+                                         const std::vector<Mat>& masks, bool returnFloatDescr ) const
+{
+  if( images.size() == 0 )
+  {
+    std::cout << "Error: input image for detection is empty" << std::endl;
+    return;
+  }
+
+  processBatch( images, masks, keylines, &descriptors, true, returnFloatDescr );
+}
+
+/* check whether two sets of parameters are equal */
+static bool sameParams( const BinaryDescriptor::Params& p1, const BinaryDescriptor::Params& p2 )
+{
+  return p1.numOfOctave_ == p2.numOfOctave_ && p1.widthOfBand_ == p2.widthOfBand_ && p1.reductionRatio == p2.reductionRatio && p1.ksize_ == p2.ksize_;
+}
+
+/* order images by size, so that consecutive images of a worker reuse its buffers */
+struct ImageSizeLess
+{
+  ImageSizeLess( const std::vector<Mat>& images ) :
+      images_( &images )
+  {
+  }
+
+  bool operator()( int a, int b ) const
+  {
+    const Mat& ia = ( *images_ )[a];
+    const Mat& ib = ( *images_ )[b];
+    if( ia.rows != ib.rows )
+      return ia.rows < ib.rows;
+    if( ia.cols != ib.cols )
+      return ia.cols < ib.cols;
+    return a < b;
+  }
+
+  const std::vector<Mat>* images_;
+};
+
+/* every worker processes a contiguous block of the images sorted by size */
+class BinaryDescriptor::BatchInvoker : public ParallelLoopBody
+{
+ public:
+  BatchInvoker( const std::vector<Ptr<BinaryDescriptor> >& workers, const std::vector<int>& order, const std::vector<Mat>& images,
+                const std::vector<Mat>& masks, std::vector<std::vector<KeyLine> >& keylines, std::vector<Mat>* descriptors, bool detectLines,
+                bool returnFloatDescr ) :
+      workers_( &workers ),
+      order_( &order ),
+      images_( &images ),
+      masks_( &masks ),
+      keylines_( &keylines ),
+      descriptors_( descriptors ),
+      detectLines_( detectLines ),
+      returnFloatDescr_( returnFloatDescr )
+  {
+  }
+
+  void operator()( const Range& range ) const
+  {
+    int numWorkers = (int) workers_->size();
+    int numImages = (int) order_->size();
+    for ( int w = range.start; w < range.end; w++ )
+    {
+      BinaryDescriptor* worker = ( *workers_ )[w].get();
+      for ( int k = w * numImages / numWorkers; k < ( w + 1 ) * numImages / numWorkers; k++ )
+      {
+        int i = ( *order_ )[k];
+        const Mat& image = ( *images_ )[i];
+        std::vector<KeyLine>& kls = ( *keylines_ )[i];
+
+        if( detectLines_ )
+        {
+          kls.clear();
+          worker->detectImpl( image, kls, masks_->empty() ? Mat() : ( *masks_ )[i] );
+        }
+
+        if( descriptors_ != NULL )
+        {
+          /* computeImpl complains about empty lists, which are normal in a batch */
+          if( kls.empty() )
+            ( *descriptors_ )[i].release();
+          else
+            worker->computeImpl( image, kls, ( *descriptors_ )[i], returnFloatDescr_, detectLines_ );
+        }
+      }
+    }
+  }
+
+ private:
+  const std::vector<Ptr<BinaryDescriptor> >* workers_;
+  const std::vector<int>* order_;
+  const std::vector<Mat>* images_;
+  const std::vector<Mat>* masks_;
+  std::vector<std::vector<KeyLine> >* keylines_;
+  std::vector<Mat>* descriptors_;
+  bool detectLines_;
+  bool returnFloatDescr_;
+};
+
+void BinaryDescriptor::processBatch( const std::vector<Mat>& images, const std::vector<Mat>& masks, std::vector<std::vector<KeyLine> >& keylines,
+                                     std::vector<Mat>* descriptors, bool detectLines, bool returnFloatDescr ) const
+{
+  if( !masks.empty() && masks.size() != images.size() )
+    throw std::runtime_error( "Masks error while detecting lines: the number of masks differs from the number of images" );
+
+  /* check inputs here, errors thrown by workers would be harder to report */
   for ( size_t i = 0; i < images.size(); i++ )
-    computeImpl( images[i], keylines[i], descriptors[i], returnFloatDescr, false );
+  {
+    if( images[i].empty() )
+      throw std::runtime_error( "Error: an input image of the batch is empty" );
+
+    if( images[i].depth() != CV_8U )
+      throw std::runtime_error( "Error, depth of image != 0" );
+
+    if( !masks.empty() && masks[i].data != NULL && ( masks[i].size() != images[i].size() || masks[i].type() != CV_8UC1 ) )
+      throw std::runtime_error( "Masks error while detecting lines: please check their dimensions and that data types are CV_8UC1" );
+  }
+
+  keylines.resize( images.size() );
+  if( descriptors != NULL )
+    descriptors->resize( images.size() );
+
+  if( images.empty() )
+    return;
+
+  /* one worker for each thread; workers created with other parameters are replaced */
+  BinaryDescriptor* bd = const_cast<BinaryDescriptor*>( this );
+  int numWorkers = std::max( 1, std::min( getNumThreads(), (int) images.size() ) );
+  if( (int) bd->batchWorkers_.size() < numWorkers )
+    bd->batchWorkers_.resize( numWorkers );
+
+  for ( int w = 0; w < numWorkers; w++ )
+  {
+    if( bd->batchWorkers_[w].empty() || !sameParams( bd->batchWorkers_[w]->params, params ) )
+      bd->batchWorkers_[w] = Ptr<BinaryDescriptor>( new BinaryDescriptor( params ) );
+  }
+
+  std::vector<Ptr<BinaryDescriptor> > workers( bd->batchWorkers_.begin(), bd->batchWorkers_.begin() + numWorkers );
+
+  std::vector<int> order( images.size() );
+  for ( size_t i = 0; i < order.size(); i++ )
+    order[i] = (int) i;
+  std::sort( order.begin(), order.end(), ImageSizeLess( images ) );
+
+  parallel_for_( Range( 0, numWorkers ), BatchInvoker( workers, order, images, masks, keylines, descriptors, detectLines, returnFloatDescr ),
+                 numWorkers );
 }
 
 /* implementation of descriptors computation */
 void BinaryDescriptor::computeImpl( const Mat& imageSrc, std::vector<KeyLine>& keylines, Mat& descriptors, bool returnFloatDescr,
                                     bool useDetectionData ) const
 {
-  /* convert input image to gray scale */
+  BinaryDescriptor* bd = const_cast<BinaryDescriptor*>( this );
+
+  /* convert input image to gray scale (a gray input is only read) */
   cv::Mat image;
   if( imageSrc.channels() != 1 )
-    cvtColor( imageSrc, image, COLOR_BGR2GRAY );
+  {
+    cvtColor( imageSrc, bd->grayImage_, COLOR_BGR2GRAY );
+    image = bd->grayImage_;
+  }
   else
-    image = imageSrc.clone();
+    image = imageSrc;
 
   /*check whether image's depth is different from 0 */
   if( image.depth() != 0 )
@@ -543,8 +701,6 @@ void BinaryDescriptor::computeImpl( const Mat& imageSrc, std::vector<KeyLine>& k
     return;
   }
 
-  BinaryDescriptor* bd = const_cast<BinaryDescriptor*>( this );
-
   /* get maximum class_id and octave*/
   int numLines = 0;
   int octaveIndex = -1;
@@ -670,6 +826,30 @@ void BinaryDescriptor::computeImpl( const Mat& imageSrc, std::vector<KeyLine>& k
 
 }
 
+/* every octave has its own EDLineDetector, so lines of different octaves
+ can be extracted concurrently */
+class BinaryDescriptor::EDLineInvoker : public ParallelLoopBody
+{
+ public:
+  EDLineInvoker( std::vector<Ptr<EDLineDetector> >& edLineVec, std::vector<cv::Mat>& images, std::vector<int>& results ) :
+      edLineVec_( &edLineVec ),
+      images_( &images ),
+      results_( &results )
+  {
+  }
+
+  void operator()( const Range& range ) const
+  {
+    for ( int octaveCount = range.start; octaveCount < range.end; octaveCount++ )
+      ( *results_ )[octaveCount] = ( *edLineVec_ )[octaveCount]->EDline( ( *images_ )[octaveCount] );
+  }
+
+ private:
+  std::vector<Ptr<EDLineDetector> >* edLineVec_;
+  std::vector<cv::Mat>* images_;
+  std::vector<int>* results_;
+};
+
 int BinaryDescriptor::OctaveKeyLines( cv::Mat& image, ScaleLines &keyLines )
 {
 
@@ -681,28 +861,24 @@ int BinaryDescriptor::OctaveKeyLines( cv::Mat& image, ScaleLines &keyLines )
   float curSigma2 = 1.0;  //[sqrt(2)]^0=1;
   double factor = sqrt( 2 );  //the down sample factor between connective two octave images
 
+  /* blurred and resized images of octaves are kept between calls */
+  std::vector<cv::Mat>& blurred = octaveBlurred_;
+  blurred.resize( params.numOfOctave_ );
+  octaveResized_.resize( params.numOfOctave_ );
+  images_sizes.resize( params.numOfOctave_ );
+
   /* loop over number of octaves */
   for ( int octaveCount = 0; octaveCount < params.numOfOctave_; octaveCount++ )
   {
-    /* matrix storing results from blurring processes */
-    cv::Mat blur;
-
     /* apply Gaussian blur */
     float increaseSigma = sqrt( curSigma2 - preSigma2 );
-    cv::GaussianBlur( image, blur, cv::Size( params.ksize_, params.ksize_ ), increaseSigma );
-    images_sizes[octaveCount] = blur.size();
-
-    /* for current octave, extract lines */
-    if( ( edLineVec_[octaveCount]->EDline( blur ) ) != 1 )
-    {
-      return -1;
-    }
-
-    /* update number of total extracted lines */
-    numOfFinalLine += edLineVec_[octaveCount]->lines_.numOfLines;
+    const cv::Mat& octaveImage = octaveCount == 0 ? image : octaveResized_[octaveCount];
+    cv::GaussianBlur( octaveImage, blurred[octaveCount], cv::Size( params.ksize_, params.ksize_ ), increaseSigma );
+    images_sizes[octaveCount] = blurred[octaveCount].size();
 
     /* resize image for next level of pyramid */
-    cv::resize( blur, image, cv::Size(), ( 1.f / factor ), ( 1.f / factor ) );
+    if( octaveCount + 1 < params.numOfOctave_ )
+      cv::resize( blurred[octaveCount], octaveResized_[octaveCount + 1], cv::Size(), ( 1.f / factor ), ( 1.f / factor ) );
 
     /* update sigma values */
     preSigma2 = curSigma2;
@@ -710,6 +886,19 @@ int BinaryDescriptor::OctaveKeyLines( cv::Mat& image, ScaleLines &keyLines )
 
   } /* end of loop over number of octaves */
 
+  /* for every octave, extract lines (octaves are independent) */
+  std::vector<int> results( params.numOfOctave_ );
+  parallel_for_( Range( 0, params.numOfOctave_ ), EDLineInvoker( edLineVec_, blurred, results ) );
+
+  for ( int octaveCount = 0; octaveCount < params.numOfOctave_; octaveCount++ )
+  {
+    if( results[octaveCount] != 1 )
+      return -1;
+
+    /* update number of total extracted lines */
+    numOfFinalLine += edLineVec_[octaveCount]->lines_.numOfLines;
+  }
+
   /* prepare a vector to store octave information associated to extracted lines */
   std::vector < OctaveLine > octaveLines( numOfFinalLine );
 
@@ -1007,10 +1196,39 @@ int BinaryDescriptor::OctaveKeyLines( cv::Mat& image, ScaleLines &keyLines )
   return 1;
 }
 
+/* descriptors of different lines are independent: every stripe of lines
+ has its own band accumulators and writes only the descriptors of its lines */
+class BinaryDescriptor::ComputeLBDInvoker : public ParallelLoopBody
+{
+ public:
+  ComputeLBDInvoker( const BinaryDescriptor* bd, ScaleLines& keyLines, bool useDetectionData ) :
+      bd_( bd ),
+      keyLines_( &keyLines ),
+      useDetectionData_( useDetectionData )
+  {
+  }
+
+  void operator()( const Range& range ) const
+  {
+    bd_->computeLBD( *keyLines_, useDetectionData_, range );
+  }
+
+ private:
+  const BinaryDescriptor* bd_;
+  ScaleLines* keyLines_;
+  bool useDetectionData_;
+};
+
 int BinaryDescriptor::computeLBD( ScaleLines &keyLines, bool useDetectionData )
+{
+  parallel_for_( Range( 0, (int) keyLines.size() ), ComputeLBDInvoker( this, keyLines, useDetectionData ) );
+
+  return 1;
+}
+
+void BinaryDescriptor::computeLBD( ScaleLines &keyLines, bool useDetectionData, const Range& range ) const
 {
   //the default length of the band is the line length.
-  short numOfFinalLine = (short) keyLines.size();
   float *dL = new float[2];  //line direction cos(dir), sin(dir)
   float *dO = new float[2];  //the clockwise orthogonal vector of line direction.
   short heightOfLSP = (short) ( params.widthOfBand_ * NUM_OF_BANDS );  //the height of line support region;
@@ -1053,7 +1271,7 @@ int BinaryDescriptor::computeLBD( ScaleLines &keyLines, bool useDetectionData )
   short octaveCount;
   OctaveSingleLine *pSingleLine;
   /* loop over list of LineVec */
-  for ( short lineIDInScaleVec = 0; lineIDInScaleVec < numOfFinalLine; lineIDInScaleVec++ )
+  for ( int lineIDInScaleVec = range.start; lineIDInScaleVec < range.end; lineIDInScaleVec++ )
   {
     sameLineSize = (short) ( keyLines[lineIDInScaleVec].size() );
     /* loop over current LineVec's lines */
@@ -1326,19 +1544,8 @@ int BinaryDescriptor::computeLBD( ScaleLines &keyLines, bool useDetectionData )
     }/* end for(short lineIDInSameLine = 0; lineIDInSameLine<sameLineSize;
      lineIDInSameLine++) */
 
-    cv::Mat appoggio = cv::Mat( 1, 32, CV_32FC1 );
-    float* pointerToRow = appoggio.ptr<float>( 0 );
-    for ( int g = 0; g < 32; g++ )
-    {
-      /* get LBD data */
-      float* des_Vec = keyLines[lineIDInScaleVec][0].descriptor.data();
-      *pointerToRow = des_Vec[g];
-      pointerToRow++;
-
-    }
-
-  }/* end for(short lineIDInScaleVec = 0;
-   lineIDInScaleVec<numOfFinalLine; lineIDInScaleVec++) */
+  }/* end for(int lineIDInScaleVec = range.start;
+   lineIDInScaleVec<range.end; lineIDInScaleVec++) */
 
   delete[] dL;
   delete[] dO;
@@ -1350,9 +1557,6 @@ int BinaryDescriptor::computeLBD( ScaleLines &keyLines, bool useDetectionData )
   delete[] ngdOBandSum;
   delete[] pgdO2BandSum;
   delete[] ngdO2BandSum;
-
-  return 1;
-
 }
 
 BinaryDescriptor::EDLineDetector::EDLineDetector()
@@ -1403,9 +1607,11 @@ void BinaryDescriptor::EDLineDetector::InitEDLine_()
   pSecondPartEdgeS_ = NULL;
   pAnchorX_ = NULL;
   pAnchorY_ = NULL;
+  lineEquation_.assign( 2, 0 );
+  lineEqu_.assign( 3, 0 );
 }
 
-BinaryDescriptor::EDLineDetector::~EDLineDetector()
+void BinaryDescriptor::EDLineDetector::release()
 {
   if( pFirstPartEdgeX_ != NULL )
   {
@@ -1421,6 +1627,153 @@ BinaryDescriptor::EDLineDetector::~EDLineDetector()
     delete[] pFirstPartEdgeS_;
     delete[] pSecondPartEdgeS_;
   }
+  pFirstPartEdgeX_ = NULL;
+  pFirstPartEdgeY_ = NULL;
+  pFirstPartEdgeS_ = NULL;
+  pSecondPartEdgeX_ = NULL;
+  pSecondPartEdgeY_ = NULL;
+  pSecondPartEdgeS_ = NULL;
+  pAnchorX_ = NULL;
+  pAnchorY_ = NULL;
+
+  /* an empty gImg_ makes EdgeDrawing allocate again */
+  dxImg_.release();
+  dyImg_.release();
+  gImgWO_.release();
+  gImg_.release();
+  dirImg_.release();
+  edgeImage_.release();
+  dxABS_m_.release();
+  dyABS_m_.release();
+  sumDxDy_.release();
+  anchorMask_.release();
+
+  /* swap with empty containers to give back their capacity */
+  std::vector<unsigned int>().swap( edges_.xCors );
+  std::vector<unsigned int>().swap( edges_.yCors );
+  std::vector<unsigned int>().swap( edges_.sId );
+  std::vector<unsigned int>().swap( lines_.xCors );
+  std::vector<unsigned int>().swap( lines_.yCors );
+  std::vector<unsigned int>().swap( lines_.sId );
+  lines_.numOfLines = 0;
+  std::vector<cv::Vec3d>().swap( lineEquations_ );
+  std::vector<cv::Vec4f>().swap( lineEndpoints_ );
+  std::vector<float>().swap( lineDirection_ );
+  std::vector<float>().swap( lineSalience_ );
+  std::vector<double>().swap( pointDirection_ );
+  std::vector<float>().swap( fitBuffer_ );
+}
+
+BinaryDescriptor::EDLineDetector::~EDLineDetector()
+{
+  release();
+}
+
+/* fused gradient stage of EdgeDrawing for one row: |dx|+|dy| (saturated as cv::add does),
+ the direction mask (255 where |dx| < |dy|), the gradient divided by 4 with the
+ round-half-to-even of cvRound, and the same value zeroed where the sum is not above
+ gradThreshold */
+static void edgeGradientRow( const short* dx, const short* dy, short* gWO, short* g, uchar* dir, int width, short gradThreshold )
+{
+  int x = 0;
+#if CV_SSE2
+  if( checkHardwareSupport( CV_CPU_SSE2 ) )
+  {
+    const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi16( 1 ), two = _mm_set1_epi16( 2 ), three = _mm_set1_epi16( 3 );
+    const __m128i thr = _mm_set1_epi16( gradThreshold );
+    for ( ; x <= width - 8; x += 8 )
+    {
+      __m128i vdx = _mm_loadu_si128( (const __m128i*) ( dx + x ) );
+      __m128i vdy = _mm_loadu_si128( (const __m128i*) ( dy + x ) );
+      vdx = _mm_max_epi16( vdx, _mm_subs_epi16( zero, vdx ) );
+      vdy = _mm_max_epi16( vdy, _mm_subs_epi16( zero, vdy ) );
+      __m128i sum = _mm_adds_epi16( vdx, vdy );
+      __m128i q = _mm_srai_epi16( sum, 2 ), r = _mm_and_si128( sum, three );
+      __m128i up = _mm_or_si128( _mm_cmpgt_epi16( r, two ),
+                                 _mm_and_si128( _mm_cmpeq_epi16( r, two ), _mm_cmpeq_epi16( _mm_and_si128( q, one ), one ) ) );
+      q = _mm_sub_epi16( q, up );
+      _mm_storeu_si128( (__m128i*) ( gWO + x ), q );
+      _mm_storeu_si128( (__m128i*) ( g + x ), _mm_and_si128( q, _mm_cmpgt_epi16( sum, thr ) ) );
+      __m128i d = _mm_cmplt_epi16( vdx, vdy );
+      _mm_storel_epi64( (__m128i*) ( dir + x ), _mm_packs_epi16( d, d ) );
+    }
+  }
+#elif CV_NEON
+  const int16x8_t one = vdupq_n_s16( 1 ), two = vdupq_n_s16( 2 ), three = vdupq_n_s16( 3 );
+  const int16x8_t thr = vdupq_n_s16( gradThreshold );
+  for ( ; x <= width - 8; x += 8 )
+  {
+    int16x8_t vdx = vqabsq_s16( vld1q_s16( dx + x ) );
+    int16x8_t vdy = vqabsq_s16( vld1q_s16( dy + x ) );
+    int16x8_t sum = vqaddq_s16( vdx, vdy );
+    int16x8_t q = vshrq_n_s16( sum, 2 ), r = vandq_s16( sum, three );
+    uint16x8_t up = vorrq_u16( vcgtq_s16( r, two ), vandq_u16( vceqq_s16( r, two ), vceqq_s16( vandq_s16( q, one ), one ) ) );
+    q = vsubq_s16( q, vreinterpretq_s16_u16( up ) );
+    vst1q_s16( gWO + x, q );
+    vst1q_s16( g + x, vandq_s16( q, vreinterpretq_s16_u16( vcgtq_s16( sum, thr ) ) ) );
+    vst1_u8( dir + x, vmovn_u16( vcltq_s16( vdx, vdy ) ) );
+  }
+#endif
+  for ( ; x < width; x++ )
+  {
+    short adx = saturate_cast<short>( std::abs( (int) dx[x] ) ), ady = saturate_cast<short>( std::abs( (int) dy[x] ) );
+    short sum = saturate_cast<short>( adx + ady );
+    int q = sum >> 2, r = sum & 3;
+    q += r > 2 || ( r == 2 && ( q & 1 ) );
+    gWO[x] = (short) q;
+    g[x] = sum > gradThreshold ? (short) q : 0;
+    dir[x] = adx < ady ? Horizontal : Vertical;
+  }
+}
+
+/* anchor test of EdgeDrawing for the pixels [1, width-1) of one row: a pixel is an anchor
+ when its gradient exceeds both neighbours across its direction (up and down for horizontal
+ pixels, left and right otherwise) by anchorThreshold; mask is set to 1 for anchors */
+static void edgeAnchorRow( const short* g, const short* gUp, const short* gDown, const uchar* dir, uchar* mask, int width, int anchorThreshold )
+{
+  int x = 1;
+#if CV_SSE2
+  if( checkHardwareSupport( CV_CPU_SSE2 ) )
+  {
+    const __m128i th = _mm_set1_epi16( (short) anchorThreshold ), one = _mm_set1_epi16( 1 );
+    for ( ; x <= width - 9; x += 8 )
+    {
+      __m128i c = _mm_loadu_si128( (const __m128i*) ( g + x ) );
+      __m128i u = _mm_add_epi16( _mm_loadu_si128( (const __m128i*) ( gUp + x ) ), th );
+      __m128i d = _mm_add_epi16( _mm_loadu_si128( (const __m128i*) ( gDown + x ) ), th );
+      __m128i l = _mm_add_epi16( _mm_loadu_si128( (const __m128i*) ( g + x - 1 ) ), th );
+      __m128i r = _mm_add_epi16( _mm_loadu_si128( (const __m128i*) ( g + x + 1 ) ), th );
+      /* a horizontal pixel has 255 in dir, widened here to an all-ones lane */
+      __m128i hor = _mm_loadl_epi64( (const __m128i*) ( dir + x ) );
+      hor = _mm_srai_epi16( _mm_unpacklo_epi8( hor, hor ), 8 );
+      __m128i n1 = _mm_or_si128( _mm_and_si128( hor, u ), _mm_andnot_si128( hor, l ) );
+      __m128i n2 = _mm_or_si128( _mm_and_si128( hor, d ), _mm_andnot_si128( hor, r ) );
+      __m128i fail = _mm_or_si128( _mm_cmpgt_epi16( n1, c ), _mm_cmpgt_epi16( n2, c ) );
+      __m128i res = _mm_andnot_si128( fail, one );
+      _mm_storel_epi64( (__m128i*) ( mask + x ), _mm_packus_epi16( res, res ) );
+    }
+  }
+#elif CV_NEON
+  const int16x8_t th = vdupq_n_s16( (short) anchorThreshold );
+  for ( ; x <= width - 9; x += 8 )
+  {
+    int16x8_t c = vld1q_s16( g + x );
+    uint16x8_t hor = vmovl_u8( vshr_n_u8( vld1_u8( dir + x ), 7 ) );
+    hor = vceqq_u16( hor, vdupq_n_u16( 1 ) );
+    int16x8_t n1 = vbslq_s16( hor, vaddq_s16( vld1q_s16( gUp + x ), th ), vaddq_s16( vld1q_s16( g + x - 1 ), th ) );
+    int16x8_t n2 = vbslq_s16( hor, vaddq_s16( vld1q_s16( gDown + x ), th ), vaddq_s16( vld1q_s16( g + x + 1 ), th ) );
+    uint16x8_t ok = vandq_u16( vcgeq_s16( c, n1 ), vcgeq_s16( c, n2 ) );
+    vst1_u8( mask + x, vmovn_u16( vshrq_n_u16( ok, 15 ) ) );
+  }
+#endif
+  for ( ; x < width - 1; x++ )
+  {
+    int gv = g[x];
+    if( dir[x] == Horizontal )
+      mask[x] = gv >= gUp[x] + anchorThreshold && gv >= gDown[x] + anchorThreshold;
+    else
+      mask[x] = gv >= g[x - 1] + anchorThreshold && gv >= g[x + 1] + anchorThreshold;
+  }
 }
 
 int BinaryDescriptor::EDLineDetector::EdgeDrawing( cv::Mat &image, EdgeChains &edgeChains )
@@ -1465,15 +1818,27 @@ int BinaryDescriptor::EDLineDetector::EdgeDrawing( cv::Mat &image, EdgeChains &e
   cv::Sobel( image, dyImg_, CV_16SC1, 0, 1, 3 );
 
   //compute gradient and direction images
-  cv::Mat dxABS_m = cv::abs( dxImg_ );
-  cv::Mat dyABS_m = cv::abs( dyImg_ );
-  cv::Mat sumDxDy;
-  cv::add( dyABS_m, dxABS_m, sumDxDy );
-
-  cv::threshold( sumDxDy, gImg_, gradienThreshold_ + 1, 255, cv::THRESH_TOZERO );
-  gImg_ = gImg_ / 4;
-  gImgWO_ = sumDxDy / 4;
-  cv::compare( dxABS_m, dyABS_m, dirImg_, cv::CMP_LT );
+  if( cv::useOptimized() )
+  {
+    /* one pass over dx and dy builds gImgWO_, gImg_ and dirImg_, the same values as below */
+    for ( int i = 0; i < (int) imageHeight; i++ )
+      edgeGradientRow( dxImg_.ptr<short>( i ), dyImg_.ptr<short>( i ), gImgWO_.ptr<short>( i ), gImg_.ptr<short>( i ), dirImg_.ptr( i ),
+                       (int) imageWidth, (short) ( gradienThreshold_ + 1 ) );
+  }
+  else
+  {
+    dxABS_m_ = cv::abs( dxImg_ );
+    dyABS_m_ = cv::abs( dyImg_ );
+    cv::Mat& dxABS_m = dxABS_m_;
+    cv::Mat& dyABS_m = dyABS_m_;
+    cv::Mat& sumDxDy = sumDxDy_;
+    cv::add( dyABS_m, dxABS_m, sumDxDy );
+
+    cv::threshold( sumDxDy, gImg_, gradienThreshold_ + 1, 255, cv::THRESH_TOZERO );
+    gImg_ = gImg_ / 4;
+    gImgWO_ = sumDxDy / 4;
+    cv::compare( dxABS_m, dyABS_m, dirImg_, cv::CMP_LT );
+  }
 
   short *pgImg = gImg_.ptr<short>();
   unsigned char *pdirImg = dirImg_.ptr();
@@ -1483,30 +1848,55 @@ int BinaryDescriptor::EDLineDetector::EdgeDrawing( cv::Mat &image, EdgeChains &e
   memset( pAnchorY_, 0, edgePixelArraySize * sizeof(unsigned int) );
   unsigned int anchorsSize = 0;
   int indexInArray;
-  unsigned char gValue1, gValue2, gValue3;
-  for ( unsigned int w = 1; w < imageWidth - 1; w = w + scanIntervals_ )
+  if( cv::useOptimized() )
   {
+    /* test the scanned rows in bulk, then collect the anchors in the column-major order of the scalar scan */
+    anchorMask_.create( imageHeight, imageWidth, CV_8UC1 );
     for ( unsigned int h = 1; h < imageHeight - 1; h = h + scanIntervals_ )
+      edgeAnchorRow( gImg_.ptr<short>( h ), gImg_.ptr<short>( h - 1 ), gImg_.ptr<short>( h + 1 ), dirImg_.ptr( h ), anchorMask_.ptr( h ),
+                     (int) imageWidth, anchorThreshold_ );
+    const unsigned char *pAnchorMask = anchorMask_.ptr();
+    for ( unsigned int w = 1; w < imageWidth - 1; w = w + scanIntervals_ )
     {
-      indexInArray = h * imageWidth + w;
-      //gValue1 = pdirImg[indexInArray];
-      if( pdirImg[indexInArray] == Horizontal )
-      {  //if the direction of pixel is horizontal, then compare with up and down
-         //gValue2 = pgImg[indexInArray];
-        if( pgImg[indexInArray] >= pgImg[indexInArray - imageWidth] + anchorThreshold_
-            && pgImg[indexInArray] >= pgImg[indexInArray + imageWidth] + anchorThreshold_ )
-        {       // (w,h) is accepted as an anchor
-          pAnchorX_[anchorsSize] = w;
-          pAnchorY_[anchorsSize++] = h;
+      for ( unsigned int h = 1; h < imageHeight - 1; h = h + scanIntervals_ )
+      {
+        if( pAnchorMask[h * imageWidth + w] )
+        {
+          if( anchorsSize < edgePixelArraySize )
+          {
+            pAnchorX_[anchorsSize] = w;
+            pAnchorY_[anchorsSize] = h;
+          }
+          anchorsSize++;
         }
       }
-      else
-      {       // if(pdirImg[indexInArray]==Vertical){//it is vertical edge, should be compared with left and right
-        //gValue2 = pgImg[indexInArray];
-        if( pgImg[indexInArray] >= pgImg[indexInArray - 1] + anchorThreshold_ && pgImg[indexInArray] >= pgImg[indexInArray + 1] + anchorThreshold_ )
-        {       // (w,h) is accepted as an anchor
-          pAnchorX_[anchorsSize] = w;
-          pAnchorY_[anchorsSize++] = h;
+    }
+  }
+  else
+  {
+    for ( unsigned int w = 1; w < imageWidth - 1; w = w + scanIntervals_ )
+    {
+      for ( unsigned int h = 1; h < imageHeight - 1; h = h + scanIntervals_ )
+      {
+        indexInArray = h * imageWidth + w;
+        bool isAnchor;
+        if( pdirImg[indexInArray] == Horizontal )
+        {  //if the direction of pixel is horizontal, then compare with up and down
+          isAnchor = pgImg[indexInArray] >= pgImg[indexInArray - imageWidth] + anchorThreshold_
+              && pgImg[indexInArray] >= pgImg[indexInArray + imageWidth] + anchorThreshold_;
+        }
+        else
+        {  //it is vertical edge, should be compared with left and right
+          isAnchor = pgImg[indexInArray] >= pgImg[indexInArray - 1] + anchorThreshold_ && pgImg[indexInArray] >= pgImg[indexInArray + 1] + anchorThreshold_;
+        }
+        if( isAnchor )
+        {       // (w,h) is accepted as an anchor; only counted once the arrays are full
+          if( anchorsSize < edgePixelArraySize )
+          {
+            pAnchorX_[anchorsSize] = w;
+            pAnchorY_[anchorsSize] = h;
+          }
+          anchorsSize++;
         }
       }
     }
@@ -2226,8 +2616,8 @@ int BinaryDescriptor::EDLineDetector::EdgeDrawing( cv::Mat &image, EdgeChains &e
 int BinaryDescriptor::EDLineDetector::EDline( cv::Mat &image, LineChains &lines )
 {
 
-  //first, call EdgeDrawing function to extract edges
-  EdgeChains edges;
+  //first, call EdgeDrawing function to extract edges (edge chains are kept between calls)
+  EdgeChains& edges = edges_;
   if( ( EdgeDrawing( image, edges ) ) != 1 )
   {
     std::cout << "Line Detection not finished" << std::endl;
@@ -2247,7 +2637,8 @@ int BinaryDescriptor::EDLineDetector::EDline( cv::Mat &image, LineChains &lines
   unsigned int *pLineSID = lines.sId.data();
   logNT_ = 2.0 * ( log10( (double) imageWidth ) + log10( (double) imageHeight ) );
   double lineFitErr = 0;    //the line fit error;
-  std::vector<double> lineEquation( 2, 0 );
+  std::vector<double>& lineEquation = lineEquation_;
+  std::vector<double>& lineEqu = lineEqu_;
   lineEquations_.clear();
   lineEndpoints_.clear();
   lineDirection_.clear();
@@ -2332,20 +2723,19 @@ int BinaryDescriptor::EDLineDetector::EDline( cv::Mat &image, LineChains &lines
           }
         }
         //the line equation coefficients,for line w1x+w2y+w3 =0, we normalize it to make w1^2+w2^2 = 1.
-        std::vector<double> lineEqu( 3, 0 );
         lineEqu[0] = lineEquation[0] * coef1;
         lineEqu[1] = -1 * coef1;
         lineEqu[2] = lineEquation[1] * coef1;
         if( LineValidation_( pLineXCors, pLineYCors, pLineSID[numOfLines], offsetInLineArray, lineEqu, direction ) )
         {           //check the line
           //store the line equation coefficients
-          lineEquations_.push_back( lineEqu );
+          lineEquations_.push_back( cv::Vec3d( lineEqu[0], lineEqu[1], lineEqu[2] ) );
           /*At last, compute the line endpoints and store them.
            *we project the first and last pixels in the pixelChain onto the best fit line
            *to get the line endpoints.
            *xp= (w2^2*x0-w1*w2*y0-w3*w1)/(w1^2+w2^2)
            *yp= (w1^2*y0-w1*w2*x0-w3*w2)/(w1^2+w2^2)  */
-          std::vector<float> lineEndP( 4, 0 );          //line endpoints
+          cv::Vec4f lineEndP;          //line endpoints
           double a1 = lineEqu[1] * lineEqu[1];
           double a2 = lineEqu[0] * lineEqu[0];
           double a3 = lineEqu[0] * lineEqu[1];
@@ -2418,7 +2808,6 @@ int BinaryDescriptor::EDLineDetector::EDline( cv::Mat &image, LineChains &lines
           }
         }
         //the line equation coefficients,for line w1x+w2y+w3 =0, we normalize it to make w1^2+w2^2 = 1.
-        std::vector<double> lineEqu( 3, 0 );
         lineEqu[0] = 1 * coef1;
         lineEqu[1] = -lineEquation[0] * coef1;
         lineEqu[2] = -lineEquation[1] * coef1;
@@ -2426,13 +2815,13 @@ int BinaryDescriptor::EDLineDetector::EDline( cv::Mat &image, LineChains &lines
         if( LineValidation_( pLineXCors, pLineYCors, pLineSID[numOfLines], offsetInLineArray, lineEqu, direction ) )
         {           //check the line
           //store the line equation coefficients
-          lineEquations_.push_back( lineEqu );
+          lineEquations_.push_back( cv::Vec3d( lineEqu[0], lineEqu[1], lineEqu[2] ) );
           /*At last, compute the line endpoints and store them.
            *we project the first and last pixels in the pixelChain onto the best fit line
            *to get the line endpoints.
            *xp= (w2^2*x0-w1*w2*y0-w3*w1)/(w1^2+w2^2)
            *yp= (w1^2*y0-w1*w2*x0-w3*w2)/(w1^2+w2^2)  */
-          std::vector<float> lineEndP( 4, 0 );          //line endpoints
+          cv::Vec4f lineEndP;          //line endpoints
           double a1 = lineEqu[1] * lineEqu[1];
           double a2 = lineEqu[0] * lineEqu[0];
           double a3 = lineEqu[0] * lineEqu[1];
@@ -2560,8 +2949,11 @@ double BinaryDescriptor::EDLineDetector::LeastSquaresLineFit_( unsigned int *xCo
   {
     std::cout << "SHOULD NOT BE != 2" << std::endl;
   }
-  cv::Mat_<float> matT( 2, newLength );
-  cv::Mat_<float> vec( newLength, 1 );
+  /* matT and vec are headers over a buffer that is reused between calls */
+  if( fitBuffer_.size() < (size_t) newLength * 3 )
+    fitBuffer_.resize( newLength * 3 );
+  cv::Mat_<float> matT( 2, newLength, &fitBuffer_[0] );
+  cv::Mat_<float> vec( newLength, 1, &fitBuffer_[2 * newLength] );
   float * pMatT;
   float * pATA;
   double coef;
@@ -2638,7 +3030,8 @@ bool BinaryDescriptor::EDLineDetector::LineValidation_( unsigned int *xCors, uns
     short *pdxImg = dxImg_.ptr<short>();
     short *pdyImg = dyImg_.ptr<short>();
     double dx, dy;
-    std::vector<double> pointDirection;
+    std::vector<double>& pointDirection = pointDirection_;
+    pointDirection.clear();
     int index;
     for ( int i = 0; i < n; i++ )
     {
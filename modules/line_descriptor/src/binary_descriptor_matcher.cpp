@@ -85,18 +85,93 @@ void BinaryDescriptorMatcher::train()
   if( !dataset )
     dataset = new Mihasher( 256, 32 );
 
+  /* only the descriptors added since last call are inserted */
   if( descriptorsMat.rows > 0 )
-    dataset->populate( descriptorsMat, descriptorsMat.rows, descriptorsMat.cols );
+    dataset->append( descriptorsMat );
 
-  descrInDS = descriptorsMat.rows;
+  descrInDS = (int) dataset->N;
   descriptorsMat.release();
 }
 
+/* mark descriptors of an image as removed */
+void BinaryDescriptorMatcher::remove( int imgIdx )
+{
+  CV_Assert( imgIdx >= 0 && imgIdx < numImages );
+
+  /* descriptors of the image could still be stored locally */
+  train();
+
+  /* find where descriptors of the image begin and end in dataset */
+  std::map<int, int>::iterator it = indexesMap.begin();
+  while ( it != indexesMap.end() && it->second != imgIdx )
+    it++;
+
+  /* images without descriptors are not in map */
+  if( it == indexesMap.end() )
+    return;
+
+  std::map<int, int>::iterator next = it;
+  next++;
+  int end = next == indexesMap.end() ? descrInDS : next->first;
+
+  for ( int i = it->first; i < end; i++ )
+    dataset->remove( (UINT32) i );
+}
+
+/* rebuild dataset without removed descriptors */
+void BinaryDescriptorMatcher::compact()
+{
+  train();
+
+  if( dataset->numRemoved == 0 )
+    return;
+
+  Mat liveCodes;
+  std::map<int, int> liveIndexesMap;
+
+  for ( std::map<int, int>::iterator it = indexesMap.begin(); it != indexesMap.end(); it++ )
+  {
+    std::map<int, int>::iterator next = it;
+    next++;
+    int end = next == indexesMap.end() ? descrInDS : next->first;
+
+    /* an image keeps its entry in map only if some of its descriptors survive */
+    int start = liveCodes.rows;
+    for ( int i = it->first; i < end; i++ )
+    {
+      if( !dataset->removed[i] )
+        liveCodes.push_back( dataset->codes.row( i ) );
+    }
+
+    if( liveCodes.rows > start )
+      liveIndexesMap.insert( std::pair<int, int>( start, it->second ) );
+  }
+
+  delete dataset;
+  dataset = new Mihasher( 256, 32 );
+  dataset->append( liveCodes );
+
+  indexesMap.swap( liveIndexesMap );
+  descrInDS = liveCodes.rows;
+  nextAddedIndex = liveCodes.rows;
+}
+
+/* memory used by dataset */
+size_t BinaryDescriptorMatcher::getMemoryFootprint() const
+{
+  size_t bytes = descriptorsMat.total() * descriptorsMat.elemSize();
+  if( dataset )
+    bytes += dataset->memoryFootprint();
+
+  return bytes;
+}
+
 /* clear dataset and internal data */
 void BinaryDescriptorMatcher::clear()
 {
   descriptorsMat.release();
   indexesMap.clear();
+  delete dataset;
   dataset = 0;
   nextAddedIndex = 0;
   numImages = 0;
@@ -147,8 +222,8 @@ void BinaryDescriptorMatcher::match( const Mat& queryDescriptors, std::vector<DM
   /* set number of requested matches to return for each query */
   dataset->setK( 1 );
 
-  /* prepare structures for query */
-  UINT32 *results = new UINT32[queryDescriptors.rows];
+  /* prepare structures for query (0 marks a missing result) */
+  UINT32 *results = new UINT32[queryDescriptors.rows]();
   UINT32 * numres = new UINT32[ ( 256 + 1 ) * ( queryDescriptors.rows )];
 
   /* execute query */
@@ -156,6 +231,10 @@ void BinaryDescriptorMatcher::match( const Mat& queryDescriptors, std::vector<DM
   /* compose matches */
   for ( int counter = 0; counter < queryDescriptors.rows; counter++ )
   {
+    /* no descriptor in dataset (e.g. all of them removed) */
+    if( results[counter] == 0 )
+      continue;
+
     /* create a map iterator */
     std::map<int, int>::iterator itup;
 
@@ -361,8 +440,8 @@ void BinaryDescriptorMatcher::knnMatch( const Mat& queryDescriptors, std::vector
   /* set number of requested matches to return for each query */
   dataset->setK( k );
 
-  /* prepare structures for query */
-  UINT32 *results = new UINT32[k * queryDescriptors.rows];
+  /* prepare structures for query (0 marks a missing result) */
+  UINT32 *results = new UINT32[k * queryDescriptors.rows]();
   UINT32 * numres = new UINT32[ ( 256 + 1 ) * ( queryDescriptors.rows )];
 
   /* execute query */
@@ -376,7 +455,7 @@ void BinaryDescriptorMatcher::knnMatch( const Mat& queryDescriptors, std::vector
     std::vector < DMatch > tempVector;
 
     /* loop over k results returned for every query */
-    for ( int j = index; j < index + k; j++ )
+    for ( int j = index; j < index + k && results[j] != 0; j++ )
     {
       /* retrieve which image returned index refers to */
       int currentIndex = results[j] - 1;
@@ -530,8 +609,8 @@ void BinaryDescriptorMatcher::radiusMatch( const Mat& queryDescriptors, std::vec
   /* set K */
   dataset->setK( descrInDS );
 
-  /* prepare structures for query */
-  UINT32 *results = new UINT32[descrInDS * queryDescriptors.rows];
+  /* prepare structures for query (0 marks a missing result) */
+  UINT32 *results = new UINT32[descrInDS * queryDescriptors.rows]();
   UINT32 * numres = new UINT32[ ( 256 + 1 ) * ( queryDescriptors.rows )];
 
   /* execute query */
@@ -541,12 +620,12 @@ void BinaryDescriptorMatcher::radiusMatch( const Mat& queryDescriptors, std::vec
   int index = 0;
   for ( int counter = 0; counter < queryDescriptors.rows; counter++ )
   {
+    std::vector<int> k_distances;
+    checkKDistances( numres, descrInDS, k_distances, counter, 256 );
+
     std::vector < DMatch > tempVector;
-    for ( int j = index; j < index + descrInDS; j++ )
+    for ( int j = index; j < index + descrInDS && results[j] != 0; j++ )
     {
-      std::vector<int> k_distances;
-      checkKDistances( numres, descrInDS, k_distances, counter, 256 );
-
       if( k_distances[j - index] <= maxDistance )
       {
         int currentIndex = results[j] - 1;
@@ -592,47 +671,57 @@ void BinaryDescriptorMatcher::radiusMatch( const Mat& queryDescriptors, std::vec
 
 }
 
-/* execute a batch query */
-void BinaryDescriptorMatcher::Mihasher::batchquery( UINT32 * results, UINT32 *numres, const cv::Mat & queries, UINT32 numq, int dim1queries )
+/* queries are independent: every stripe works with its own duplicate counter
+ and result buffers, and writes to its own rows of results and numres */
+class BinaryDescriptorMatcher::Mihasher::BatchqueryInvoker : public ParallelLoopBody
 {
-  /* create and initialize a bitarray */
-  counter = new bitarray;
-  counter->init( N );
-
-  UINT32 *res = new UINT32[K * ( D + 1 )];
-  UINT64 *chunks = new UINT64[m];
-  UINT32 * presults = results;
-  UINT32 *pnumres = numres;
-
-  /* make a copy of input queries */
-  cv::Mat queries_clone = queries.clone();
-
-  /* set a pointer to first query (row) */
-  UINT8 *pq = queries_clone.ptr();
-
-  /* loop over number of descriptors */
-  for ( size_t i = 0; i < numq; i++ )
+ public:
+  BatchqueryInvoker( Mihasher* mh, UINT32 * results, UINT32 *numres, const cv::Mat & queries ) :
+      mh_( mh ),
+      results_( results ),
+      numres_( numres ),
+      queries_( queries )
   {
-    /* for every descriptor, query database */
-    query( presults, pnumres, pq, chunks, res );
+  }
 
-    /* move pointer to write next K indeces */
-    presults += K;
-    pnumres += B + 1;
+  void operator()( const Range& range ) const
+  {
+    bitarray counter;
+    counter.init( mh_->N );
 
-    /* move forward pointer to current row in descriptors matrix */
-    pq += dim1queries;
+    std::vector<UINT32> res( (size_t) mh_->K * ( mh_->D + 1 ) );
+    std::vector<UINT64> chunks( mh_->m );
+    std::vector<int> power( mh_->d + 2 );
 
+    for ( int i = range.start; i < range.end; i++ )
+    {
+      /* for every descriptor, query database */
+      mh_->query( results_ + (size_t) i * mh_->K, numres_ + (size_t) i * ( mh_->B + 1 ), (UINT8*) queries_.ptr( i ), &chunks[0],
+                  res.empty() ? NULL : &res[0], counter, &power[0] );
+    }
   }
 
-  delete[] res;
-  delete[] chunks;
+ private:
+  Mihasher* mh_;
+  UINT32 * results_;
+  UINT32 * numres_;
+  const cv::Mat & queries_;
+};
+
+/* execute a batch query */
+void BinaryDescriptorMatcher::Mihasher::batchquery( UINT32 * results, UINT32 *numres, const cv::Mat & queries, UINT32 numq, int dim1queries )
+{
+  CV_Assert( (int) numq <= queries.rows && dim1queries <= (int) queries.step[0] );
 
-  delete counter;
+  /* every stripe clears an N bit counter per query, so give it a batch of queries */
+  const int queriesPerStripe = 64;
+  parallel_for_( Range( 0, (int) numq ), BatchqueryInvoker( this, results, numres, queries ),
+                 std::max( 1.0, (double) numq / queriesPerStripe ) );
 }
 
 /* execute a single query */
-void BinaryDescriptorMatcher::Mihasher::query( UINT32* results, UINT32* numres, UINT8 * Query, UINT64 *chunks, UINT32 *res )
+void BinaryDescriptorMatcher::Mihasher::query( UINT32* results, UINT32* numres, UINT8 * Query, UINT64 *chunks, UINT32 *res, bitarray& counter,
+                                                int* power )
 {
   /* if K == 0 that means we want everything to be processed.
    So maxres = N in that case. Otherwise K limits the results processed */
@@ -654,7 +743,7 @@ void BinaryDescriptorMatcher::Mihasher::query( UINT32* results, UINT32* numres,
   UINT32 index;
   int hammd;
 
-  counter->erase();
+  counter.erase();
   memset( numres, 0, ( B + 1 ) * sizeof ( *numres ) );
 
   split( chunks, Query, m, mplus, b );
@@ -712,10 +801,14 @@ void BinaryDescriptorMatcher::Mihasher::query( UINT32* results, UINT32* numres,
             for ( int c = 0; c < size; c++ )
             {
               index = arr[c];
-              if( !counter->get( index ) )
+              if( !counter.get( index ) )
               { /* if it is not a duplicate */
-                counter->set( index );
-                hammd = cv::line_descriptor::match( codes.ptr() + (UINT64) index * ( B_over_8 ), Query, B_over_8 );
+                counter.set( index );
+                if( numRemoved > 0 && removed[index] )
+                  continue;
+
+                UINT8* code = codes.ptr() + (UINT64) index * ( B_over_8 );
+                hammd = useSIMDMatch ? match256( code, Query ) : cv::line_descriptor::match( code, Query, B_over_8 );
 
                 nc++;
                 if( hammd <= D && numres[hammd] < maxres )
@@ -769,6 +862,12 @@ BinaryDescriptorMatcher::Mihasher::Mihasher( int B_val, int _m )
    (m-mplus) is the number of chunks with (b-1) bits */
   mplus = B - m * ( b - 1 );
 
+  useSIMDMatch = B == 256 && hasSIMDMatch256();
+
+  N = 0;
+  K = 0;
+  numRemoved = 0;
+
   xornum = new UINT32[d + 2];
   xornum[0] = 0;
   for ( int i = 0; i <= d; i++ )
@@ -801,6 +900,8 @@ void BinaryDescriptorMatcher::Mihasher::populate( cv::Mat & _codes, UINT32 N_val
 {
   N = N_val;
   codes = _codes;
+  removed.clear();
+  numRemoved = 0;
   UINT64 * chunks = new UINT64[m];
 
   UINT8 * pcodes = codes.ptr();
@@ -818,6 +919,58 @@ void BinaryDescriptorMatcher::Mihasher::populate( cv::Mat & _codes, UINT32 N_val
   delete[] chunks;
 }
 
+/* append codes to tables */
+void BinaryDescriptorMatcher::Mihasher::append( const cv::Mat & newCodes )
+{
+  if( newCodes.rows == 0 )
+    return;
+
+  CV_Assert( newCodes.type() == CV_8UC1 && newCodes.cols == B_over_8 );
+
+  /* push_back grows the storage geometrically, so appending is amortized O(batch) */
+  codes.push_back( newCodes );
+  if( !removed.empty() )
+    removed.resize( (size_t) N + newCodes.rows, 0 );
+
+  std::vector<UINT64> chunks( m );
+  for ( UINT64 i = N; i < N + newCodes.rows; i++ )
+  {
+    split( &chunks[0], codes.ptr( (int) i ), m, mplus, b );
+
+    for ( int k = 0; k < m; k++ )
+      H[k].insert( chunks[k], (UINT32) i );
+  }
+
+  N += newCodes.rows;
+}
+
+/* mark a code as removed */
+void BinaryDescriptorMatcher::Mihasher::remove( UINT32 index )
+{
+  CV_Assert( index < N );
+
+  if( removed.empty() )
+    removed.resize( (size_t) N, 0 );
+
+  if( !removed[index] )
+  {
+    removed[index] = 1;
+    numRemoved++;
+  }
+}
+
+/* memory used by codes and tables */
+size_t BinaryDescriptorMatcher::Mihasher::memoryFootprint() const
+{
+  size_t bytes = codes.empty() ? 0 : (size_t) ( codes.datalimit - codes.datastart );
+  bytes += removed.capacity() + ( d + 2 ) * sizeof(UINT32);
+
+  for ( int k = 0; k < m; k++ )
+    bytes += H[k].memoryFootprint();
+
+  return bytes;
+}
+
 /* constructor */
 BinaryDescriptorMatcher::SparseHashtable::SparseHashtable()
 {
@@ -859,6 +1012,16 @@ UINT32* BinaryDescriptorMatcher::SparseHashtable::query( UINT64 index, int *Size
   return table[index >> 5].query( (int) ( index % 32 ), Size );
 }
 
+/* memory used by bins */
+size_t BinaryDescriptorMatcher::SparseHashtable::memoryFootprint() const
+{
+  size_t bytes = (size_t) size * sizeof(BucketGroup);
+  for ( UINT64 i = 0; i < size; i++ )
+    bytes += table[i].group.capacity() * sizeof(uint32_t);
+
+  return bytes;
+}
+
 /* constructor */
 BinaryDescriptorMatcher::BucketGroup::BucketGroup()
 {
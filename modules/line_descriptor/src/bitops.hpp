@@ -95,6 +95,50 @@ inline int match( UINT8*P, UINT8*Q, int codelb )
     return output;
 }
 
+/* matching function specialized for 256-bit codes, such as LBD descriptors;
+ the caller must check hasSIMDMatch256() before using it */
+inline bool hasSIMDMatch256()
+{
+#if CV_AVX2
+  return checkHardwareSupport( CV_CPU_AVX2 );
+#elif CV_POPCNT && ( defined(_M_X64) || defined(__x86_64__) )
+  return checkHardwareSupport( CV_CPU_POPCNT );
+#elif CV_NEON
+  return true;
+#else
+  return false;
+#endif
+}
+
+inline int match256( const UINT8* P, const UINT8* Q )
+{
+#if CV_AVX2
+  /* nibble lookup of the bit counts, summed by sad against zero */
+  const __m256i lut = _mm256_setr_epi8( 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 );
+  const __m256i lowMask = _mm256_set1_epi8( 0x0f );
+  __m256i x = _mm256_xor_si256( _mm256_loadu_si256( (const __m256i*) P ), _mm256_loadu_si256( (const __m256i*) Q ) );
+  __m256i cnt = _mm256_add_epi8( _mm256_shuffle_epi8( lut, _mm256_and_si256( x, lowMask ) ),
+                                 _mm256_shuffle_epi8( lut, _mm256_and_si256( _mm256_srli_epi16( x, 4 ), lowMask ) ) );
+  __m256i sad = _mm256_sad_epu8( cnt, _mm256_setzero_si256() );
+  __m128i sum = _mm_add_epi64( _mm256_castsi256_si128( sad ), _mm256_extracti128_si256( sad, 1 ) );
+  sum = _mm_add_epi64( sum, _mm_unpackhi_epi64( sum, sum ) );
+  return _mm_cvtsi128_si32( sum );
+#elif CV_POPCNT && ( defined(_M_X64) || defined(__x86_64__) )
+  const UINT64* p = (const UINT64*) P;
+  const UINT64* q = (const UINT64*) Q;
+  return (int) ( _mm_popcnt_u64( p[0] ^ q[0] ) + _mm_popcnt_u64( p[1] ^ q[1] ) +
+                 _mm_popcnt_u64( p[2] ^ q[2] ) + _mm_popcnt_u64( p[3] ^ q[3] ) );
+#elif CV_NEON
+  uint8x16_t cnt = vaddq_u8( vcntq_u8( veorq_u8( vld1q_u8( P ), vld1q_u8( Q ) ) ),
+                             vcntq_u8( veorq_u8( vld1q_u8( P + 16 ), vld1q_u8( Q + 16 ) ) ) );
+  uint64x2_t sum = vpaddlq_u32( vpaddlq_u16( vpaddlq_u8( cnt ) ) );
+  return (int) ( vgetq_lane_u64( sum, 0 ) + vgetq_lane_u64( sum, 1 ) );
+#else
+  return match( (UINT8*) P, (UINT8*) Q, 32 );
+#endif
+}
+
 /* splitting function (b <= 64) */
 inline void split( UINT64 *chunks, UINT8 *code, int m, int mplus, int b )
 {
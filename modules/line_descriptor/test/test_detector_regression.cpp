@@ -70,6 +70,8 @@ class CV_BinaryDescriptorDetectorTest : public cvtest::BaseTest
 
   void emptyDataTest();
   void regressionTest();
+  void optimizedPathTest();
+  void batchTest();
   virtual void run( int );
 
   Ptr<BinaryDescriptor> bd;
@@ -314,6 +316,115 @@ void CV_BinaryDescriptorDetectorTest::regressionTest()
   }
 }
 
+void CV_BinaryDescriptorDetectorTest::optimizedPathTest()
+{
+  std::string imgFilename = std::string( ts->get_data_path() ) + LINE_DESCRIPTOR_DIR + "/" + IMAGE_FILENAME;
+  Mat image = imread( imgFilename, IMREAD_GRAYSCALE );
+  if( image.empty() )
+  {
+    ts->printf( cvtest::TS::LOG, "Image %s can not be read.\n", imgFilename.c_str() );
+    ts->set_failed_test_info( cvtest::TS::FAIL_INVALID_TEST_DATA );
+    return;
+  }
+
+  /* the full image and an odd-sized crop, so that the row tails are exercised too */
+  std::vector<Mat> images;
+  images.push_back( image );
+  images.push_back( image( Rect( 3, 5, image.cols - 8, image.rows - 10 ) ).clone() );
+
+  bool wasOptimized = useOptimized();
+  for ( size_t i = 0; i < images.size(); i++ )
+  {
+    std::vector<KeyLine> scalarKeylines, optimizedKeylines;
+    setUseOptimized( false );
+    bd->detect( images[i], scalarKeylines );
+    setUseOptimized( true );
+    bd->detect( images[i], optimizedKeylines );
+
+    bool identical = scalarKeylines.size() == optimizedKeylines.size();
+    for ( size_t j = 0; identical && j < scalarKeylines.size(); j++ )
+    {
+      const KeyLine& k1 = scalarKeylines[j];
+      const KeyLine& k2 = optimizedKeylines[j];
+      identical = k1.startPointX == k2.startPointX && k1.startPointY == k2.startPointY && k1.endPointX == k2.endPointX
+          && k1.endPointY == k2.endPointY && k1.angle == k2.angle && k1.response == k2.response && k1.octave == k2.octave
+          && k1.class_id == k2.class_id && k1.numOfPixels == k2.numOfPixels;
+    }
+
+    if( !identical )
+    {
+      setUseOptimized( wasOptimized );
+      ts->printf( cvtest::TS::LOG, "Optimized and scalar keylines differ (image %d: scalarCount = %d, optimizedCount = %d).\n", (int) i,
+                  (int) scalarKeylines.size(), (int) optimizedKeylines.size() );
+      ts->set_failed_test_info( cvtest::TS::FAIL_INVALID_OUTPUT );
+      return;
+    }
+  }
+  setUseOptimized( wasOptimized );
+}
+
+void CV_BinaryDescriptorDetectorTest::batchTest()
+{
+  std::string imgFilename = std::string( ts->get_data_path() ) + LINE_DESCRIPTOR_DIR + "/" + IMAGE_FILENAME;
+  Mat image = imread( imgFilename );
+  if( image.empty() )
+  {
+    ts->printf( cvtest::TS::LOG, "Image %s can not be read.\n", imgFilename.c_str() );
+    ts->set_failed_test_info( cvtest::TS::FAIL_INVALID_TEST_DATA );
+    return;
+  }
+
+  /* images of different sizes, interleaved, so that workers switch between them */
+  Mat crop = image( Rect( 3, 5, image.cols - 8, image.rows - 10 ) ).clone();
+  std::vector<Mat> images;
+  for ( int i = 0; i < 4; i++ )
+  {
+    images.push_back( image );
+    images.push_back( crop );
+  }
+
+  std::vector<std::vector<KeyLine> > batchKeylines;
+  std::vector<Mat> batchDescriptors;
+  bd->detectAndCompute( images, batchKeylines, batchDescriptors );
+
+  std::vector<std::vector<KeyLine> > detectedKeylines;
+  bd->detect( images, detectedKeylines );
+
+  if( batchKeylines.size() != images.size() || batchDescriptors.size() != images.size() || detectedKeylines.size() != images.size() )
+  {
+    ts->printf( cvtest::TS::LOG, "Batch output has a wrong number of elements.\n" );
+    ts->set_failed_test_info( cvtest::TS::FAIL_INVALID_OUTPUT );
+    return;
+  }
+
+  for ( size_t i = 0; i < images.size(); i++ )
+  {
+    std::vector<KeyLine> keylines;
+    Mat descriptors;
+    ( *bd )( images[i], Mat(), keylines, descriptors, false, false );
+
+    bool identical = keylines.size() == batchKeylines[i].size() && keylines.size() == detectedKeylines[i].size()
+        && descriptors.size() == batchDescriptors[i].size() && descriptors.type() == batchDescriptors[i].type()
+        && ( descriptors.empty() || norm( descriptors, batchDescriptors[i], NORM_INF ) == 0 );
+    for ( size_t j = 0; identical && j < keylines.size(); j++ )
+    {
+      const KeyLine& k = keylines[j];
+      const KeyLine& kb = batchKeylines[i][j];
+      const KeyLine& kd = detectedKeylines[i][j];
+      identical = k.startPointX == kb.startPointX && k.startPointY == kb.startPointY && k.endPointX == kb.endPointX && k.endPointY == kb.endPointY
+          && k.class_id == kb.class_id && k.octave == kb.octave && k.startPointX == kd.startPointX && k.startPointY == kd.startPointY
+          && k.endPointX == kd.endPointX && k.endPointY == kd.endPointY && k.class_id == kd.class_id && k.octave == kd.octave;
+    }
+
+    if( !identical )
+    {
+      ts->printf( cvtest::TS::LOG, "Batch results differ from the ones of image %d processed alone.\n", (int) i );
+      ts->set_failed_test_info( cvtest::TS::FAIL_INVALID_OUTPUT );
+      return;
+    }
+  }
+}
+
 void CV_BinaryDescriptorDetectorTest::run( int )
 {
   if( !bd )
@@ -325,6 +436,8 @@ void CV_BinaryDescriptorDetectorTest::run( int )
 
   emptyDataTest();
   regressionTest();
+  optimizedPathTest();
+  batchTest();
 
   ts->set_failed_test_info( cvtest::TS::OK );
 }
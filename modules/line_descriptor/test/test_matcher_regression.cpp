@@ -66,6 +66,7 @@ class CV_BinaryDescriptorMatcherTest : public cvtest::BaseTest
   void matchTest( const Mat& query, const Mat& train );
   void knnMatchTest( const Mat& query, const Mat& train );
   void radiusMatchTest( const Mat& query, const Mat& train );
+  void incrementalTest( const Mat& query, const Mat& train );
 
   std::string name;
   Ptr<BinaryDescriptorMatcher> dmatcher;
@@ -558,6 +559,74 @@ void CV_BinaryDescriptorMatcherTest::radiusMatchTest( const Mat& query, const Ma
   }
 }
 
+void CV_BinaryDescriptorMatcherTest::incrementalTest( const Mat& query, const Mat& train )
+{
+  dmatcher->clear();
+
+  // train on first half, then append second half without rebuilding dataset
+  {
+    std::vector<DMatch> matches;
+    dmatcher->add( std::vector<Mat>( 1, train.rowRange( 0, train.rows / 2 ) ) );
+    dmatcher->train();
+    dmatcher->add( std::vector<Mat>( 1, train.rowRange( train.rows / 2, train.rows ) ) );
+    dmatcher->match( query, matches );
+
+    int badCount = 0;
+    for ( size_t i = 0; i < matches.size(); i++ )
+    {
+      DMatch& match = matches[i];
+      int imgIdx = (int) i < queryDescCount / 2 ? 0 : 1;
+      if( ( match.queryIdx != (int) i ) || ( match.trainIdx != (int) i * countFactor ) || ( match.imgIdx != imgIdx ) )
+        badCount++;
+    }
+
+    if( (int) matches.size() != queryDescCount || (float) badCount > (float) queryDescCount * badPart )
+    {
+      ts->printf( cvtest::TS::LOG, "Bad matches after incremental train() (%d bad of %d).\n", badCount, (int) matches.size() );
+      ts->set_failed_test_info( cvtest::TS::FAIL_BAD_ACCURACY );
+    }
+  }
+
+  // removed descriptors must not be returned, before and after compaction
+  {
+    size_t footprint = dmatcher->getMemoryFootprint();
+    dmatcher->remove( 0 );
+
+    for ( int pass = 0; pass < 2; pass++ )
+    {
+      std::vector<DMatch> matches;
+      dmatcher->match( query, matches );
+
+      int badCount = 0;
+      for ( size_t i = 0; i < matches.size(); i++ )
+      {
+        DMatch& match = matches[i];
+        if( match.imgIdx != 1 )
+          badCount++;
+
+        // renumbering after compaction
+        int trainIdx = match.queryIdx * countFactor - ( pass == 0 ? 0 : train.rows / 2 );
+        if( match.queryIdx >= queryDescCount / 2 && match.trainIdx != trainIdx )
+          badCount++;
+      }
+
+      if( badCount > 0 )
+      {
+        ts->printf( cvtest::TS::LOG, "Removed descriptors are returned by match() (pass %d, %d bad).\n", pass, badCount );
+        ts->set_failed_test_info( cvtest::TS::FAIL_INVALID_OUTPUT );
+      }
+
+      dmatcher->compact();
+    }
+
+    if( dmatcher->getMemoryFootprint() >= footprint )
+    {
+      ts->printf( cvtest::TS::LOG, "compact() did not release memory of removed descriptors.\n" );
+      ts->set_failed_test_info( cvtest::TS::FAIL_INVALID_OUTPUT );
+    }
+  }
+}
+
 void CV_BinaryDescriptorMatcherTest::run( int )
 {
   Mat query, train;
@@ -566,6 +635,7 @@ void CV_BinaryDescriptorMatcherTest::run( int )
   matchTest( query, train );
   knnMatchTest( query, train );
   radiusMatchTest( query, train );
+  incrementalTest( query, train );
 }
 
 /****************************************************************************************\
@@ -988,6 +988,113 @@ namespace rgbd
     mutable Ptr<RgbdNormals> normalsComputer;
   };
 
+  /** Keyframe-to-frame tracking on top of an Odometry algorithm.
+   * Every frame passed to the tracker gets its cache prepared once for both roles (CACHE_ALL), so it can be
+   * tracked against the keyframe and later promoted to a keyframe without recomputing its pyramids.
+   */
+  class CV_EXPORTS OdometryTracker
+  {
+  public:
+    /** Counters of the cache usage.
+     * @param framesCount Count of the frames passed to track() (including the initial keyframe)
+     * @param keyframesCount Count of the frames that became keyframes
+     * @param preparedCount Count of the frames whose cache was computed (cache misses), a promoted frame is not
+     * counted again
+     * @param cacheHits Count of the times a frame cache was reused instead of being recomputed
+     * @param prepareTime Total time spent on preparing the frame caches, including the promoted frames (in seconds)
+     * @param savedTime Estimated time saved by the cache hits (in seconds): the time it took to prepare the cache
+     * of the reused frame, i.e. what Odometry::compute() on plain Mats would spend on that frame once more
+     */
+    struct CV_EXPORTS Stats
+    {
+      Stats();
+
+      int framesCount;
+      int keyframesCount;
+      int preparedCount;
+      int cacheHits;
+      double prepareTime;
+      double savedTime;
+    };
+
+    /** Constructor
+     * @param odometry The odometry algorithm to track the frames with, its parameters (e.g. camera matrix)
+     * have to be set before the first frame is passed
+     */
+    OdometryTracker(const Ptr<Odometry>& odometry);
+
+    /** Set a new keyframe. Its cache is prepared for the destination role, the data already present in the frame
+     * is reused.
+     */
+    void
+    setKeyframe(const Ptr<OdometryFrame>& keyframe);
+
+    /** Compute the transformation from the frame to the current keyframe (see Odometry::compute with the frame
+     * as srcFrame and the keyframe as dstFrame). If there is no keyframe yet, the frame becomes the keyframe
+     * and Rt is set to the identity.
+     * @param frame The new frame, it is kept by the tracker until the next call (see promoteFrame). Its cache is
+     * prepared for the source role only.
+     * @param Rt Resulting transformation from the frame to the keyframe
+     * @param initRt Initial transformation from the frame to the keyframe (optional)
+     */
+    bool
+    track(const Ptr<OdometryFrame>& frame, Mat& Rt, const Mat& initRt = Mat());
+
+    /** The same as above for a frame given by its image, depth and mask.
+     */
+    bool
+    track(const Mat& image, const Mat& depth, const Mat& mask, Mat& Rt, const Mat& initRt = Mat());
+
+    /** Make the last tracked frame the keyframe. Its pyramids are reused, only the data of the destination role
+     * (e.g. the normals) is added and its pyramid mask is rebuilt.
+     */
+    void
+    promoteFrame();
+
+    /** Release the keyframe and the last tracked frame. The stats are kept.
+     */
+    void
+    reset();
+
+    Ptr<OdometryFrame>
+    getKeyframe() const
+    {
+      return keyframe;
+    }
+    Ptr<OdometryFrame>
+    getFrame() const
+    {
+      return frame;
+    }
+    Ptr<Odometry>
+    getOdometry() const
+    {
+      return odometry;
+    }
+    const Stats&
+    getStats() const
+    {
+      return stats;
+    }
+    void
+    resetStats()
+    {
+      stats = Stats();
+    }
+
+  private:
+    double
+    prepareFrame(Ptr<OdometryFrame>& frame, int cacheType);
+
+    Ptr<Odometry> odometry;
+
+    Ptr<OdometryFrame> keyframe, frame;
+    /** The time it took to prepare the cache of the keyframe and of the last tracked frame (in seconds) */
+    double keyframePrepareTime, framePrepareTime;
+
+    Stats stats;
+  };
+
   /** Warp the image: compute 3d points from the depth, transform them using given transformation,
    * then project color point cloud to an image plane.
    * This function can be used to visualize results of the Odometry algorithm.
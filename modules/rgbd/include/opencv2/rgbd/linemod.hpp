@@ -433,6 +433,17 @@ protected:
                   float threshold, std::vector<Match>& matches,
                   const String& class_id,
                   const std::vector<TemplatePyramid>& template_pyramids) const;
+
+  // Similarity maps reused from one template to the next by a matching thread
+  struct SimilarityBuffers;
+  // Matches a range of (class, template) pairs in parallel
+  class MatchInvoker;
+
+  void matchTemplate(const LinearMemoryPyramid& lm_pyramid,
+                     const std::vector<Size>& sizes,
+                     float threshold, std::vector<Match>& candidates,
+                     const String& class_id, int template_id,
+                     const TemplatePyramid& tp, SimilarityBuffers& buffers) const;
 };
 
 /**
@@ -0,0 +1,143 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote products
+//     derived from this software without specific prior written permission.
+//
+// This software is provided by the copyright holders and contributors "as is" and
+// any express or implied warranties, including, but not limited to, the implied
+// warranties of merchantability and fitness for a particular purpose are disclaimed.
+// In no event shall the Intel Corporation or contributors be liable for any direct,
+// indirect, incidental, special, exemplary, or consequential damages
+// (including, but not limited to, procurement of substitute goods or services;
+// loss of use, data, or profits; or business interruption) however caused
+// and on any theory of liability, whether in contract, strict liability,
+// or tort (including negligence or otherwise) arising in any way out of
+// the use of this software, even if advised of the possibility of such damage.
+//
+//M*/
+
+
+#include "perf_precomp.hpp"
+
+using namespace cv;
+using namespace perf;
+using std::tr1::get;
+
+typedef std::tr1::tuple<int, int> TemplatesCount_ClassesCount_t;
+typedef perf::TestBaseWithParam<TemplatesCount_ClassesCount_t> TemplatesCount_ClassesCount;
+
+// A rectangle with an ellipse inside it, rotated and scaled around the center
+static void drawObject(Mat& image, Mat& mask, Point2f center, float angle, float scale)
+{
+    RotatedRect box(center, Size2f(60.f * scale, 40.f * scale), angle);
+    Point2f corners[4];
+    box.points(corners);
+    Point polygon[4];
+    for (int i = 0; i < 4; ++i)
+        polygon[i] = corners[i];
+
+    fillConvexPoly(image, polygon, 4, Scalar(40, 160, 220));
+    ellipse(image, RotatedRect(center, Size2f(30.f * scale, 20.f * scale), angle + 45.f), Scalar(200, 60, 20), -1);
+    fillConvexPoly(mask, polygon, 4, Scalar::all(255));
+}
+
+// Templates of the object in every class get a different scale and cover the rotations
+static void addTemplates(const Ptr<linemod::Detector>& detector, int templatesCount, int classesCount)
+{
+    int templatesPerClass = templatesCount / classesCount;
+    for (int c = 0; c < classesCount; ++c)
+    {
+        String class_id = format("class_%d", c);
+        float scale = 0.8f + 0.4f * c / classesCount;
+        for (int t = 0; t < templatesPerClass; ++t)
+        {
+            Mat image(128, 128, CV_8UC3, Scalar::all(0)), mask(128, 128, CV_8UC1, Scalar::all(0));
+            drawObject(image, mask, Point2f(64.f, 64.f), 360.f * t / templatesPerClass, scale);
+            std::vector<Mat> sources(1, image);
+            detector->addTemplate(sources, class_id, mask);
+        }
+    }
+}
+
+static Mat makeScene()
+{
+    Mat scene(480, 640, CV_8UC3, Scalar::all(0)), mask = Mat::zeros(scene.size(), CV_8UC1);
+    RNG rng(0);
+    for (int i = 0; i < 12; ++i)
+        drawObject(scene, mask, Point2f(rng.uniform(60.f, 580.f), rng.uniform(60.f, 420.f)),
+                   rng.uniform(0.f, 360.f), rng.uniform(0.8f, 1.2f));
+    return scene;
+}
+
+PERF_TEST_P(TemplatesCount_ClassesCount, match,
+            testing::Combine(testing::Values(256, 2048),
+                             testing::Values(1, 8)))
+{
+    Ptr<linemod::Detector> detector = linemod::getDefaultLINE();
+    addTemplates(detector, get<0>(GetParam()), get<1>(GetParam()));
+    ASSERT_GT(detector->numTemplates(), 0);
+
+    std::vector<Mat> sources(1, makeScene());
+
+    std::vector<linemod::Match> matches;
+    declare.time(120);
+    TEST_CYCLE()
+    {
+        detector->match(sources, 80.f, matches);
+    }
+
+    SANITY_CHECK_NOTHING();
+}
+
+typedef perf::TestBaseWithParam<bool> Optimized;
+
+// The same templates and scene with the SIMD paths of the response maps and similarities
+// enabled or disabled by setUseOptimized(). This only compares the widest SIMD path of the
+// machine (AVX2, otherwise SSE) against the scalar code, not AVX2 against SSE. NEON is selected
+// at build time and stays enabled, so the comparison on ARM is between builds with and without NEON.
+PERF_TEST_P(Optimized, match_vectorization, testing::Bool())
+{
+    bool optimized = GetParam();
+
+    Ptr<linemod::Detector> detector = linemod::getDefaultLINE();
+    addTemplates(detector, 512, 4);
+    ASSERT_GT(detector->numTemplates(), 0);
+
+    std::vector<Mat> sources(1, makeScene());
+
+    std::vector<linemod::Match> matches;
+    bool useOptimized = cv::useOptimized();
+    cv::setUseOptimized(optimized);
+    declare.time(120);
+    TEST_CYCLE()
+    {
+        detector->match(sources, 80.f, matches);
+    }
+    cv::setUseOptimized(useOptimized);
+
+    SANITY_CHECK_NOTHING();
+}
@@ -0,0 +1,99 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2012, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include "perf_precomp.hpp"
+
+using namespace cv;
+using namespace cv::rgbd;
+using namespace perf;
+using std::tr1::make_tuple;
+using std::tr1::get;
+
+typedef std::tr1::tuple<std::string, Size> OdometryType_Size_t;
+typedef perf::TestBaseWithParam<OdometryType_Size_t> OdometryType_Size;
+
+// The test frame (640x480) resized to the given resolution, with its camera matrix
+static bool readFrame(const Size& size, Mat& image, Mat& depth, Mat& K)
+{
+    image = imread(getDataPath("rgbd/odometry/rgb.png"), 0);
+    depth = imread(getDataPath("rgbd/odometry/depth.png"), -1);
+    if(image.empty() || depth.empty())
+        return false;
+
+    Mat depth_flt;
+    depth.convertTo(depth_flt, CV_32FC1, 1.f/5000.f);
+    depth_flt.setTo(std::numeric_limits<float>::quiet_NaN(), depth_flt < FLT_EPSILON);
+
+    double scale = (double)size.width / image.cols;
+    resize(image, image, size);
+    resize(depth_flt, depth, size, 0, 0, INTER_NEAREST);
+
+    K = Mat::eye(3, 3, CV_32FC1);
+    K.at<float>(0,0) = (float)(525. * scale);
+    K.at<float>(1,1) = (float)(525. * scale);
+    K.at<float>(0,2) = (float)(319.5 * scale);
+    K.at<float>(1,2) = (float)(239.5 * scale);
+    return true;
+}
+
+PERF_TEST_P(OdometryType_Size, compute,
+            testing::Combine(testing::Values("RgbdOdometry", "ICPOdometry", "RgbdICPOdometry"),
+                             testing::Values(Size(320, 240), Size(640, 480), Size(1280, 960))))
+{
+    Size size = get<1>(GetParam());
+
+    Mat image, depth, K;
+    ASSERT_TRUE(readFrame(size, image, depth, K)) << "Unable to load the odometry test frame";
+
+    // the next frame: the camera moved by a couple of pixels
+    Mat shift = (Mat_<double>(2,3) << 1, 0, 2 * size.width / 640, 0, 1, size.height / 480);
+    Mat dstImage, dstDepth;
+    warpAffine(image, dstImage, shift, size);
+    warpAffine(depth, dstDepth, shift, size, INTER_NEAREST, BORDER_CONSTANT,
+               Scalar::all(std::numeric_limits<float>::quiet_NaN()));
+
+    Ptr<Odometry> odometry = Odometry::create(get<0>(GetParam()));
+    odometry->setCameraMatrix(K);
+
+    Mat Rt;
+    declare.time(60);
+    TEST_CYCLE()
+    {
+        odometry->compute(image, depth, Mat(), dstImage, dstDepth, Mat(), Rt);
+    }
+
+    SANITY_CHECK_NOTHING();
+}
@@ -920,6 +920,9 @@ static void orUnaligned8u(const uchar * src, const int src_stride,
                    uchar * dst, const int dst_stride,
                    const int width, const int height)
 {
+#if CV_AVX2
+  volatile bool haveAVX2 = checkHardwareSupport(CV_CPU_AVX2);
+#endif
 #if CV_SSE2
   volatile bool haveSSE2 = checkHardwareSupport(CPU_SSE2);
 #if CV_SSE3
@@ -932,6 +935,18 @@ static void orUnaligned8u(const uchar * src, const int src_stride,
   {
     int c = 0;
 
+#if CV_AVX2
+    // 32 pixels at a time, the SSE2 loops below finish the last 16 if any
+    if (haveAVX2)
+    {
+      for ( ; c < width - 31; c += 32)
+      {
+        __m256i val = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + c));
+        __m256i* dst_ptr = reinterpret_cast<__m256i*>(dst + c);
+        _mm256_storeu_si256(dst_ptr, _mm256_or_si256(_mm256_loadu_si256(dst_ptr), val));
+      }
+    }
+#endif
 #if CV_SSE2
     // Use aligned loads if possible
     if (haveSSE2 && src_aligned)
@@ -965,6 +980,10 @@ static void orUnaligned8u(const uchar * src, const int src_stride,
         *dst_ptr = _mm_or_si128(*dst_ptr, val);
       }
     }
+#endif
+#if CV_NEON
+    for ( ; c < width - 15; c += 16)
+      vst1q_u8(dst + c, vorrq_u8(vld1q_u8(dst + c), vld1q_u8(src + c)));
 #endif
     for ( ; c < width; ++c)
       dst[c] |= src[c];
@@ -1039,8 +1058,46 @@ static void computeResponseMaps(const Mat& src, std::vector<Mat>& response_maps)
     }
   }
 
+#if CV_AVX2
+  volatile bool haveAVX2 = checkHardwareSupport(CV_CPU_AVX2);
+#endif
 #if CV_SSSE3
   volatile bool haveSSSE3 = checkHardwareSupport(CV_CPU_SSSE3);
+#endif
+
+#if CV_AVX2
+  if (haveAVX2)
+  {
+    const __m128i* lut = reinterpret_cast<const __m128i*>(SIMILARITY_LUT);
+    int total = src.rows * src.cols;
+    for (int ori = 0; ori < 8; ++ori)
+    {
+      uchar* map_data = response_maps[ori].ptr<uchar>();
+      const uchar* lsb4_data = lsb4.ptr<uchar>();
+      const uchar* msb4_data = msb4.ptr<uchar>();
+
+      // The shuffle looks up within each 128-bit lane, so both lanes hold the same LUT
+      __m256i lut_low = _mm256_inserti128_si256(_mm256_castsi128_si256(lut[2*ori + 0]), lut[2*ori + 0], 1);
+      __m256i lut_hi = _mm256_inserti128_si256(_mm256_castsi128_si256(lut[2*ori + 1]), lut[2*ori + 1], 1);
+
+      int i = 0;
+      for ( ; i < total - 31; i += 32)
+      {
+        __m256i res1 = _mm256_shuffle_epi8(lut_low, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lsb4_data + i)));
+        __m256i res2 = _mm256_shuffle_epi8(lut_hi, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(msb4_data + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(map_data + i), _mm256_max_epu8(res1, res2));
+      }
+
+      // The last 16 pixels if the count is not a multiple of 32
+      const uchar* lut_low_data = SIMILARITY_LUT + 32*ori;
+      const uchar* lut_hi_data = lut_low_data + 16;
+      for ( ; i < total; ++i)
+        map_data[i] = std::max(lut_low_data[ lsb4_data[i] ], lut_hi_data[ msb4_data[i] ]);
+    }
+  }
+  else
+#endif
+#if CV_SSSE3
   if (haveSSSE3)
   {
     const __m128i* lut = reinterpret_cast<const __m128i*>(SIMILARITY_LUT);
@@ -1065,6 +1122,33 @@ static void computeResponseMaps(const Mat& src, std::vector<Mat>& response_maps)
   }
   else
 #endif
+#if CV_NEON
+  {
+    for (int ori = 0; ori < 8; ++ori)
+    {
+      uchar* map_data = response_maps[ori].ptr<uchar>();
+      const uchar* lsb4_data = lsb4.ptr<uchar>();
+      const uchar* msb4_data = msb4.ptr<uchar>();
+      const uchar* lut_data = SIMILARITY_LUT + 32*ori;
+
+      // VTBL looks up 8 indices at a time in a 16-entry table given as two halves
+      uint8x8x2_t lut_low, lut_hi;
+      lut_low.val[0] = vld1_u8(lut_data);
+      lut_low.val[1] = vld1_u8(lut_data + 8);
+      lut_hi.val[0] = vld1_u8(lut_data + 16);
+      lut_hi.val[1] = vld1_u8(lut_data + 24);
+
+      for (int i = 0; i < src.rows * src.cols; i += 16)
+      {
+        uint8x16_t lsb = vld1q_u8(lsb4_data + i);
+        uint8x16_t msb = vld1q_u8(msb4_data + i);
+        uint8x8_t res_low = vmax_u8(vtbl2_u8(lut_low, vget_low_u8(lsb)), vtbl2_u8(lut_hi, vget_low_u8(msb)));
+        uint8x8_t res_high = vmax_u8(vtbl2_u8(lut_low, vget_high_u8(lsb)), vtbl2_u8(lut_hi, vget_high_u8(msb)));
+        vst1q_u8(map_data + i, vcombine_u8(res_low, res_high));
+      }
+    }
+  }
+#else
   {
     // For each of the 8 quantized orientations...
     for (int ori = 0; ori < 8; ++ori)
@@ -1081,6 +1165,7 @@ static void computeResponseMaps(const Mat& src, std::vector<Mat>& response_maps)
       }
     }
   }
+#endif
 }
 
 /**
@@ -1196,6 +1281,9 @@ static void similarity(const std::vector<Mat>& linear_memories, const Template&
   dst = Mat::zeros(H, W, CV_8U);
   uchar* dst_ptr = dst.ptr<uchar>();
 
+#if CV_AVX2
+  volatile bool haveAVX2 = checkHardwareSupport(CV_CPU_AVX2);
+#endif
 #if CV_SSE2
   volatile bool haveSSE2 = checkHardwareSupport(CV_CPU_SSE2);
 #if CV_SSE3
@@ -1218,6 +1306,18 @@ static void similarity(const std::vector<Mat>& linear_memories, const Template&
 
     // Now we do an aligned/unaligned add of dst_ptr and lm_ptr with template_positions elements
     int j = 0;
+#if CV_AVX2
+    // Process responses 32 at a time, the SSE2 loops below finish the last 16 if any
+    if (haveAVX2)
+    {
+      for ( ; j < template_positions - 31; j += 32)
+      {
+        __m256i responses = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lm_ptr + j));
+        __m256i* dst_ptr_avx = reinterpret_cast<__m256i*>(dst_ptr + j);
+        _mm256_storeu_si256(dst_ptr_avx, _mm256_add_epi8(_mm256_loadu_si256(dst_ptr_avx), responses));
+      }
+    }
+#endif
     // Process responses 16 at a time if vectorization possible
 #if CV_SSE2
 #if CV_SSE3
@@ -1243,6 +1343,10 @@ static void similarity(const std::vector<Mat>& linear_memories, const Template&
         *dst_ptr_sse = _mm_add_epi8(*dst_ptr_sse, responses);
       }
     }
+#endif
+#if CV_NEON
+    for ( ; j < template_positions - 15; j += 16)
+      vst1q_u8(dst_ptr + j, vaddq_u8(vld1q_u8(dst_ptr + j), vld1q_u8(lm_ptr + j)));
 #endif
     for ( ; j < template_positions; ++j)
       dst_ptr[j] = uchar(dst_ptr[j] + lm_ptr[j]);
@@ -1322,6 +1426,18 @@ static void similarityLocal(const std::vector<Mat>& linear_memories, const Templ
     }
     else
 #endif
+#if CV_NEON
+    {
+      // One row of the 16x16 patch per register
+      uchar* dst_ptr = dst.ptr<uchar>();
+      for (int row = 0; row < 16; ++row)
+      {
+        vst1q_u8(dst_ptr, vaddq_u8(vld1q_u8(dst_ptr), vld1q_u8(lm_ptr)));
+        dst_ptr += 16;
+        lm_ptr += W;
+      }
+    }
+#else
     {
       uchar* dst_ptr = dst.ptr<uchar>();
       for (int row = 0; row < 16; ++row)
@@ -1332,12 +1448,53 @@ static void similarityLocal(const std::vector<Mat>& linear_memories, const Templ
         lm_ptr += W;
       }
     }
+#endif
   }
 }
 
 static void addUnaligned8u16u(const uchar * src1, const uchar * src2, ushort * res, int length)
 {
   const uchar * end = src1 + length;
+  int i = 0;
+
+#if CV_AVX2
+  if (checkHardwareSupport(CV_CPU_AVX2))
+  {
+    for ( ; i < length - 15; i += 16)
+    {
+      __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src1 + i)));
+      __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src2 + i)));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(res + i), _mm256_add_epi16(a, b));
+    }
+  }
+#endif
+#if CV_SSE2
+  if (checkHardwareSupport(CV_CPU_SSE2))
+  {
+    __m128i zero = _mm_setzero_si128();
+    for ( ; i < length - 15; i += 16)
+    {
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src1 + i));
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src2 + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(res + i),
+                       _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(res + i + 8),
+                       _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+    }
+  }
+#endif
+#if CV_NEON
+  for ( ; i < length - 15; i += 16)
+  {
+    uint8x16_t a = vld1q_u8(src1 + i);
+    uint8x16_t b = vld1q_u8(src2 + i);
+    vst1q_u16(res + i, vaddl_u8(vget_low_u8(a), vget_low_u8(b)));
+    vst1q_u16(res + i + 8, vaddl_u8(vget_high_u8(a), vget_high_u8(b)));
+  }
+#endif
+  src1 += i;
+  src2 += i;
+  res += i;
 
   while (src1 != end)
   {
@@ -1377,6 +1534,85 @@ static void addSimilarities(const std::vector<Mat>& similarities, Mat& dst)
 *                               High-level Detector API                                  *
 \****************************************************************************************/
 
+// Count of templates matched by one parallel_for_ stripe, which reuses its similarity
+// buffers from one template to the next
+static const int templatesPerStripe = 16;
+
+// A template pyramid to match, the tasks are listed in the order of the serial search
+struct MatchTask
+{
+  MatchTask(const String* _class_id, const std::vector<Template>* _tp, int _template_id)
+    : class_id(_class_id), tp(_tp), template_id(_template_id)
+  {}
+
+  const String* class_id;
+  const std::vector<Template>* tp;
+  int template_id;
+};
+
+static void addMatchTasks(const String& class_id, const std::vector< std::vector<Template> >& template_pyramids,
+                          std::vector<MatchTask>& tasks)
+{
+  for (size_t template_id = 0; template_id < template_pyramids.size(); ++template_id)
+    tasks.push_back(MatchTask(&class_id, &template_pyramids[template_id], static_cast<int>(template_id)));
+}
+
+struct Detector::SimilarityBuffers
+{
+  std::vector<Mat> similarities;
+  Mat total_similarity;
+  std::vector<Mat> local_similarities;
+  Mat total_local_similarity;
+};
+
+class Detector::MatchInvoker : public ParallelLoopBody
+{
+public:
+  MatchInvoker(const Detector& _detector, const LinearMemoryPyramid& _lm_pyramid,
+               const std::vector<Size>& _sizes, float _threshold,
+               const std::vector<MatchTask>& _tasks, std::vector< std::vector<Match> >& _candidates)
+    : detector(_detector), lm_pyramid(_lm_pyramid), sizes(_sizes), threshold(_threshold),
+      tasks(_tasks), candidates(_candidates)
+  {}
+
+  virtual void operator()(const Range& range) const
+  {
+    SimilarityBuffers buffers;
+    for (int i = range.start; i < range.end; ++i)
+    {
+      const MatchTask& task = tasks[i];
+      detector.matchTemplate(lm_pyramid, sizes, threshold, candidates[i],
+                             *task.class_id, task.template_id, *task.tp, buffers);
+    }
+  }
+
+  static void run(const Detector& detector, const LinearMemoryPyramid& lm_pyramid,
+                  const std::vector<Size>& sizes, float threshold,
+                  const std::vector<MatchTask>& tasks, std::vector<Match>& matches)
+  {
+    if (tasks.empty())
+      return;
+
+    // Each template writes its own candidates, so the threads need no locking and the
+    // merged matches come in the same order as with the serial search
+    std::vector< std::vector<Match> > candidates(tasks.size());
+    int count = static_cast<int>(tasks.size());
+    parallel_for_(Range(0, count), MatchInvoker(detector, lm_pyramid, sizes, threshold, tasks, candidates),
+                  (count + templatesPerStripe - 1) / templatesPerStripe);
+
+    for (size_t i = 0; i < candidates.size(); ++i)
+      matches.insert(matches.end(), candidates[i].begin(), candidates[i].end());
+  }
+
+private:
+  const Detector& detector;
+  const LinearMemoryPyramid& lm_pyramid;
+  const std::vector<Size>& sizes;
+  float threshold;
+  const std::vector<MatchTask>& tasks;
+  std::vector< std::vector<Match> >& candidates;
+};
+
 Detector::Detector()
 {
 }
@@ -1446,12 +1682,15 @@ void Detector::match(const std::vector<Mat>& sources, float threshold, std::vect
     sizes.push_back(quantized.size());
   }
 
+  // Collect the templates of all the searched classes, so that they are spread over the
+  // threads together rather than one class at a time
+  std::vector<MatchTask> tasks;
   if (class_ids.empty())
   {
     // Match all templates
     TemplatesMap::const_iterator it = class_templates.begin(), itend = class_templates.end();
     for ( ; it != itend; ++it)
-      matchClass(lm_pyramid, sizes, threshold, matches, it->first, it->second);
+      addMatchTasks(it->first, it->second, tasks);
   }
   else
   {
@@ -1460,9 +1699,10 @@ void Detector::match(const std::vector<Mat>& sources, float threshold, std::vect
     {
       TemplatesMap::const_iterator it = class_templates.find(class_ids[i]);
       if (it != class_templates.end())
-        matchClass(lm_pyramid, sizes, threshold, matches, it->first, it->second);
+        addMatchTasks(it->first, it->second, tasks);
     }
   }
+  MatchInvoker::run(*this, lm_pyramid, sizes, threshold, tasks, matches);
 
   // Sort matches by similarity, and prune any duplicates introduced by pyramid refinement
   std::sort(matches.begin(), matches.end());
@@ -1484,125 +1724,130 @@ void Detector::matchClass(const LinearMemoryPyramid& lm_pyramid,
                           const String& class_id,
                           const std::vector<TemplatePyramid>& template_pyramids) const
 {
-  // For each template...
-  for (size_t template_id = 0; template_id < template_pyramids.size(); ++template_id)
+  std::vector<MatchTask> tasks;
+  addMatchTasks(class_id, template_pyramids, tasks);
+  MatchInvoker::run(*this, lm_pyramid, sizes, threshold, tasks, matches);
+}
+
+void Detector::matchTemplate(const LinearMemoryPyramid& lm_pyramid,
+                             const std::vector<Size>& sizes,
+                             float threshold, std::vector<Match>& candidates,
+                             const String& class_id, int template_id,
+                             const TemplatePyramid& tp, SimilarityBuffers& buffers) const
+{
+  // First match over the whole image at the lowest pyramid level
+  /// @todo Factor this out into separate function
+  const std::vector<LinearMemories>& lowest_lm = lm_pyramid.back();
+
+  // Compute similarity maps for each modality at lowest pyramid level
+  std::vector<Mat>& similarities = buffers.similarities;
+  similarities.resize(modalities.size());
+  int lowest_start = static_cast<int>(tp.size() - modalities.size());
+  int lowest_T = T_at_level.back();
+  int num_features = 0;
+  for (int i = 0; i < (int)modalities.size(); ++i)
   {
-    const TemplatePyramid& tp = template_pyramids[template_id];
-
-    // First match over the whole image at the lowest pyramid level
-    /// @todo Factor this out into separate function
-    const std::vector<LinearMemories>& lowest_lm = lm_pyramid.back();
-
-    // Compute similarity maps for each modality at lowest pyramid level
-    std::vector<Mat> similarities(modalities.size());
-    int lowest_start = static_cast<int>(tp.size() - modalities.size());
-    int lowest_T = T_at_level.back();
-    int num_features = 0;
-    for (int i = 0; i < (int)modalities.size(); ++i)
-    {
-      const Template& templ = tp[lowest_start + i];
-      num_features += static_cast<int>(templ.features.size());
-      similarity(lowest_lm[i], templ, similarities[i], sizes.back(), lowest_T);
-    }
+    const Template& templ = tp[lowest_start + i];
+    num_features += static_cast<int>(templ.features.size());
+    similarity(lowest_lm[i], templ, similarities[i], sizes.back(), lowest_T);
+  }
 
-    // Combine into overall similarity
-    /// @todo Support weighting the modalities
-    Mat total_similarity;
-    addSimilarities(similarities, total_similarity);
+  // Combine into overall similarity
+  /// @todo Support weighting the modalities
+  Mat& total_similarity = buffers.total_similarity;
+  addSimilarities(similarities, total_similarity);
 
-    // Convert user-friendly percentage to raw similarity threshold. The percentage
-    // threshold scales from half the max response (what you would expect from applying
-    // the template to a completely random image) to the max response.
-    // NOTE: This assumes max per-feature response is 4, so we scale between [2*nf, 4*nf].
-    int raw_threshold = static_cast<int>(2*num_features + (threshold / 100.f) * (2*num_features) + 0.5f);
+  // Convert user-friendly percentage to raw similarity threshold. The percentage
+  // threshold scales from half the max response (what you would expect from applying
+  // the template to a completely random image) to the max response.
+  // NOTE: This assumes max per-feature response is 4, so we scale between [2*nf, 4*nf].
+  int raw_threshold = static_cast<int>(2*num_features + (threshold / 100.f) * (2*num_features) + 0.5f);
 
-    // Find initial matches
-    std::vector<Match> candidates;
-    for (int r = 0; r < total_similarity.rows; ++r)
+  // Find initial matches
+  candidates.clear();
+  for (int r = 0; r < total_similarity.rows; ++r)
+  {
+    ushort* row = total_similarity.ptr<ushort>(r);
+    for (int c = 0; c < total_similarity.cols; ++c)
     {
-      ushort* row = total_similarity.ptr<ushort>(r);
-      for (int c = 0; c < total_similarity.cols; ++c)
+      int raw_score = row[c];
+      if (raw_score > raw_threshold)
       {
-        int raw_score = row[c];
-        if (raw_score > raw_threshold)
-        {
-          int offset = lowest_T / 2 + (lowest_T % 2 - 1);
-          int x = c * lowest_T + offset;
-          int y = r * lowest_T + offset;
-          float score =(raw_score * 100.f) / (4 * num_features) + 0.5f;
-          candidates.push_back(Match(x, y, score, class_id, static_cast<int>(template_id)));
-        }
+        int offset = lowest_T / 2 + (lowest_T % 2 - 1);
+        int x = c * lowest_T + offset;
+        int y = r * lowest_T + offset;
+        float score =(raw_score * 100.f) / (4 * num_features) + 0.5f;
+        candidates.push_back(Match(x, y, score, class_id, template_id));
       }
     }
+  }
 
-    // Locally refine each match by marching up the pyramid
-    for (int l = pyramid_levels - 2; l >= 0; --l)
+  // Locally refine each match by marching up the pyramid
+  for (int l = pyramid_levels - 2; l >= 0; --l)
+  {
+    const std::vector<LinearMemories>& lms = lm_pyramid[l];
+    int T = T_at_level[l];
+    int start = static_cast<int>(l * modalities.size());
+    Size size = sizes[l];
+    int border = 8 * T;
+    int offset = T / 2 + (T % 2 - 1);
+    int max_x = size.width - tp[start].width - border;
+    int max_y = size.height - tp[start].height - border;
+
+    std::vector<Mat>& similarities2 = buffers.local_similarities;
+    similarities2.resize(modalities.size());
+    Mat& total_similarity2 = buffers.total_local_similarity;
+    for (int m = 0; m < (int)candidates.size(); ++m)
     {
-      const std::vector<LinearMemories>& lms = lm_pyramid[l];
-      int T = T_at_level[l];
-      int start = static_cast<int>(l * modalities.size());
-      Size size = sizes[l];
-      int border = 8 * T;
-      int offset = T / 2 + (T % 2 - 1);
-      int max_x = size.width - tp[start].width - border;
-      int max_y = size.height - tp[start].height - border;
-
-      std::vector<Mat> similarities2(modalities.size());
-      Mat total_similarity2;
-      for (int m = 0; m < (int)candidates.size(); ++m)
-      {
-        Match& match2 = candidates[m];
-        int x = match2.x * 2 + 1; /// @todo Support other pyramid distance
-        int y = match2.y * 2 + 1;
+      Match& match2 = candidates[m];
+      int x = match2.x * 2 + 1; /// @todo Support other pyramid distance
+      int y = match2.y * 2 + 1;
 
-        // Require 8 (reduced) row/cols to the up/left
-        x = std::max(x, border);
-        y = std::max(y, border);
+      // Require 8 (reduced) row/cols to the up/left
+      x = std::max(x, border);
+      y = std::max(y, border);
 
-        // Require 8 (reduced) row/cols to the down/left, plus the template size
-        x = std::min(x, max_x);
-        y = std::min(y, max_y);
+      // Require 8 (reduced) row/cols to the down/left, plus the template size
+      x = std::min(x, max_x);
+      y = std::min(y, max_y);
 
-        // Compute local similarity maps for each modality
-        int numFeatures = 0;
-        for (int i = 0; i < (int)modalities.size(); ++i)
-        {
-          const Template& templ = tp[start + i];
-          numFeatures += static_cast<int>(templ.features.size());
-          similarityLocal(lms[i], templ, similarities2[i], size, T, Point(x, y));
-        }
-        addSimilarities(similarities2, total_similarity2);
+      // Compute local similarity maps for each modality
+      int numFeatures = 0;
+      for (int i = 0; i < (int)modalities.size(); ++i)
+      {
+        const Template& templ = tp[start + i];
+        numFeatures += static_cast<int>(templ.features.size());
+        similarityLocal(lms[i], templ, similarities2[i], size, T, Point(x, y));
+      }
+      addSimilarities(similarities2, total_similarity2);
 
-        // Find best local adjustment
-        int best_score = 0;
-        int best_r = -1, best_c = -1;
-        for (int r = 0; r < total_similarity2.rows; ++r)
+      // Find best local adjustment
+      int best_score = 0;
+      int best_r = -1, best_c = -1;
+      for (int r = 0; r < total_similarity2.rows; ++r)
+      {
+        ushort* row = total_similarity2.ptr<ushort>(r);
+        for (int c = 0; c < total_similarity2.cols; ++c)
         {
-          ushort* row = total_similarity2.ptr<ushort>(r);
-          for (int c = 0; c < total_similarity2.cols; ++c)
+          int score = row[c];
+          if (score > best_score)
           {
-            int score = row[c];
-            if (score > best_score)
-            {
-              best_score = score;
-              best_r = r;
-              best_c = c;
-            }
+            best_score = score;
+            best_r = r;
+            best_c = c;
           }
         }
-        // Update current match
-        match2.x = (x / T - 8 + best_c) * T + offset;
-        match2.y = (y / T - 8 + best_r) * T + offset;
-        match2.similarity = (best_score * 100.f) / (4 * numFeatures);
       }
-
-      // Filter out any matches that drop below the similarity threshold
-      std::vector<Match>::iterator new_end = std::remove_if(candidates.begin(), candidates.end(),
-                                                            MatchPredicate(threshold));
-      candidates.erase(new_end, candidates.end());
+      // Update current match
+      match2.x = (x / T - 8 + best_c) * T + offset;
+      match2.y = (y / T - 8 + best_r) * T + offset;
+      match2.similarity = (best_score * 100.f) / (4 * numFeatures);
     }
 
-    matches.insert(matches.end(), candidates.begin(), candidates.end());
+    // Filter out any matches that drop below the similarity threshold
+    std::vector<Match>::iterator new_end = std::remove_if(candidates.begin(), candidates.end(),
+                                                          MatchPredicate(threshold));
+    candidates.erase(new_end, candidates.end());
   }
 }
 
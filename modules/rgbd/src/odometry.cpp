@@ -451,6 +451,209 @@ void computeProjectiveMatrix(const Mat& ksi, Mat& Rt)
 #endif
 }
 
+// The correspondences are searched by stripes of source rows in parallel, then every
+// stripe of destination rows resolves its collisions taking the candidates in source raster
+// order, which is the order of the serial search (so the result is the same).
+const int correspsStripeRows = 16;
+
+struct CorrespCandidate
+{
+    int v0, u0;
+    short u1, v1;
+    float d1; // depth of the source point seen from the destination camera
+};
+
+// Projects a row of source pixels: transformed depth and destination pixel of each of them
+static
+void projectCorrespsRow(const float* depth1_row, int cols,
+                        const float* KRK_inv0_u1, float KRK_inv1_v1_plus_KRK_inv2,
+                        const float* KRK_inv3_u1, float KRK_inv4_v1_plus_KRK_inv5,
+                        const float* KRK_inv6_u1, float KRK_inv7_v1_plus_KRK_inv8,
+                        const double* Kt_ptr, bool haveSSE2,
+                        float* transformed_d1, int* u0, int* v0)
+{
+    int u1 = 0;
+#if CV_SSE2
+    if(haveSSE2)
+    {
+        // the same float/double mix as the scalar code below, so the rounding is the same
+        const __m128 one = _mm_set1_ps(1.f);
+        const __m128 b0 = _mm_set1_ps(KRK_inv1_v1_plus_KRK_inv2),
+                     b1 = _mm_set1_ps(KRK_inv4_v1_plus_KRK_inv5),
+                     b2 = _mm_set1_ps(KRK_inv7_v1_plus_KRK_inv8);
+        const __m128d t0 = _mm_set1_pd(Kt_ptr[0]), t1 = _mm_set1_pd(Kt_ptr[1]), t2 = _mm_set1_pd(Kt_ptr[2]);
+        for(; u1 <= cols - 4; u1 += 4)
+        {
+            __m128 d1 = _mm_loadu_ps(depth1_row + u1);
+
+            __m128 z = _mm_mul_ps(d1, _mm_add_ps(_mm_loadu_ps(KRK_inv6_u1 + u1), b2));
+            __m128d z_lo = _mm_add_pd(_mm_cvtps_pd(z), t2);
+            __m128d z_hi = _mm_add_pd(_mm_cvtps_pd(_mm_movehl_ps(z, z)), t2);
+            z = _mm_movelh_ps(_mm_cvtpd_ps(z_lo), _mm_cvtpd_ps(z_hi));
+            _mm_storeu_ps(transformed_d1 + u1, z);
+
+            __m128 z_inv = _mm_div_ps(one, z);
+            __m128d z_inv_lo = _mm_cvtps_pd(z_inv), z_inv_hi = _mm_cvtps_pd(_mm_movehl_ps(z_inv, z_inv));
+
+            __m128 x = _mm_mul_ps(d1, _mm_add_ps(_mm_loadu_ps(KRK_inv0_u1 + u1), b0));
+            __m128i x_lo = _mm_cvtpd_epi32(_mm_mul_pd(z_inv_lo, _mm_add_pd(_mm_cvtps_pd(x), t0)));
+            __m128i x_hi = _mm_cvtpd_epi32(_mm_mul_pd(z_inv_hi, _mm_add_pd(_mm_cvtps_pd(_mm_movehl_ps(x, x)), t0)));
+            _mm_storeu_si128((__m128i*)(u0 + u1), _mm_unpacklo_epi64(x_lo, x_hi));
+
+            __m128 y = _mm_mul_ps(d1, _mm_add_ps(_mm_loadu_ps(KRK_inv3_u1 + u1), b1));
+            __m128i y_lo = _mm_cvtpd_epi32(_mm_mul_pd(z_inv_lo, _mm_add_pd(_mm_cvtps_pd(y), t1)));
+            __m128i y_hi = _mm_cvtpd_epi32(_mm_mul_pd(z_inv_hi, _mm_add_pd(_mm_cvtps_pd(_mm_movehl_ps(y, y)), t1)));
+            _mm_storeu_si128((__m128i*)(v0 + u1), _mm_unpacklo_epi64(y_lo, y_hi));
+        }
+    }
+#else
+    (void)haveSSE2;
+#endif
+    for(; u1 < cols; u1++)
+    {
+        float d1 = depth1_row[u1];
+        transformed_d1[u1] = static_cast<float>(d1 * (KRK_inv6_u1[u1] + KRK_inv7_v1_plus_KRK_inv8) + Kt_ptr[2]);
+        float transformed_d1_inv = 1.f / transformed_d1[u1];
+        u0[u1] = cvRound(transformed_d1_inv * (d1 * (KRK_inv0_u1[u1] + KRK_inv1_v1_plus_KRK_inv2) + Kt_ptr[0]));
+        v0[u1] = cvRound(transformed_d1_inv * (d1 * (KRK_inv3_u1[u1] + KRK_inv4_v1_plus_KRK_inv5) + Kt_ptr[1]));
+    }
+}
+
+class CorrespsProjectInvoker : public ParallelLoopBody
+{
+public:
+    CorrespsProjectInvoker(const Mat& _depth0, const Mat& _validMask0, const Mat& _depth1, const Mat& _selectMask1,
+                           float _maxDepthDiff, const float* _KRK_inv_buf, const double* _Kt_ptr,
+                           std::vector<std::vector<CorrespCandidate> >& _candidates, int _dstStripesCount) :
+        depth0(_depth0), validMask0(_validMask0), depth1(_depth1), selectMask1(_selectMask1),
+        maxDepthDiff(_maxDepthDiff), KRK_inv_buf(_KRK_inv_buf), Kt_ptr(_Kt_ptr),
+        candidates(_candidates), dstStripesCount(_dstStripesCount)
+    {
+        haveSSE2 = checkHardwareSupport(CV_CPU_SSE2);
+    }
+
+    virtual void operator()(const Range& range) const
+    {
+        const int cols = depth1.cols, rows = depth1.rows;
+        const float *KRK_inv0_u1 = KRK_inv_buf;
+        const float *KRK_inv1_v1_plus_KRK_inv2 = KRK_inv0_u1 + cols;
+        const float *KRK_inv3_u1 = KRK_inv1_v1_plus_KRK_inv2 + rows;
+        const float *KRK_inv4_v1_plus_KRK_inv5 = KRK_inv3_u1 + cols;
+        const float *KRK_inv6_u1 = KRK_inv4_v1_plus_KRK_inv5 + rows;
+        const float *KRK_inv7_v1_plus_KRK_inv8 = KRK_inv6_u1 + cols;
+
+        AutoBuffer<float> transformed_d1_buf(cols);
+        AutoBuffer<int> uv0_buf(2 * cols);
+        float* transformed_d1 = transformed_d1_buf;
+        int* u0 = uv0_buf;
+        int* v0 = u0 + cols;
+
+        Rect r(0, 0, cols, rows);
+        for(int stripe = range.start; stripe < range.end; stripe++)
+        {
+            std::vector<CorrespCandidate>* buckets = &candidates[stripe * dstStripesCount];
+            int end = std::min(rows, (stripe + 1) * correspsStripeRows);
+            for(int v1 = stripe * correspsStripeRows; v1 < end; v1++)
+            {
+                const float *depth1_row = depth1.ptr<float>(v1);
+                const uchar *mask1_row = selectMask1.ptr<uchar>(v1);
+
+                projectCorrespsRow(depth1_row, cols,
+                                   KRK_inv0_u1, KRK_inv1_v1_plus_KRK_inv2[v1],
+                                   KRK_inv3_u1, KRK_inv4_v1_plus_KRK_inv5[v1],
+                                   KRK_inv6_u1, KRK_inv7_v1_plus_KRK_inv8[v1],
+                                   Kt_ptr, haveSSE2, transformed_d1, u0, v0);
+
+                for(int u1 = 0; u1 < cols; u1++)
+                {
+                    if(!mask1_row[u1] || !(transformed_d1[u1] > 0))
+                        continue;
+                    CV_DbgAssert(!cvIsNaN(depth1_row[u1]));
+
+                    if(r.contains(Point(u0[u1],v0[u1])))
+                    {
+                        float d0 = depth0.at<float>(v0[u1],u0[u1]);
+                        if(validMask0.at<uchar>(v0[u1],u0[u1]) && std::abs(transformed_d1[u1] - d0) <= maxDepthDiff)
+                        {
+                            CV_DbgAssert(!cvIsNaN(d0));
+                            CorrespCandidate c;
+                            c.v0 = v0[u1];
+                            c.u0 = u0[u1];
+                            c.u1 = (short)u1;
+                            c.v1 = (short)v1;
+                            c.d1 = transformed_d1[u1];
+                            buckets[c.v0 / correspsStripeRows].push_back(c);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    CorrespsProjectInvoker& operator=(const CorrespsProjectInvoker&);
+
+    const Mat& depth0;
+    const Mat& validMask0;
+    const Mat& depth1;
+    const Mat& selectMask1;
+    float maxDepthDiff;
+    const float* KRK_inv_buf;
+    const double* Kt_ptr;
+    std::vector<std::vector<CorrespCandidate> >& candidates;
+    int dstStripesCount;
+    bool haveSSE2;
+};
+
+class CorrespsResolveInvoker : public ParallelLoopBody
+{
+public:
+    CorrespsResolveInvoker(const std::vector<std::vector<CorrespCandidate> >& _candidates, int _srcStripesCount,
+                           int _dstStripesCount, Mat& _corresps, Mat& _correspsDepth, int* _counts) :
+        candidates(_candidates), srcStripesCount(_srcStripesCount), dstStripesCount(_dstStripesCount),
+        corresps(_corresps), correspsDepth(_correspsDepth), counts(_counts)
+    {}
+
+    virtual void operator()(const Range& range) const
+    {
+        for(int stripe = range.start; stripe < range.end; stripe++)
+        {
+            int correspCount = 0;
+            for(int srcStripe = 0; srcStripe < srcStripesCount; srcStripe++)
+            {
+                const std::vector<CorrespCandidate>& bucket = candidates[srcStripe * dstStripesCount + stripe];
+                for(size_t i = 0; i < bucket.size(); i++)
+                {
+                    const CorrespCandidate& cand = bucket[i];
+                    Vec2s& c = corresps.at<Vec2s>(cand.v0,cand.u0);
+                    float& exist_d1 = correspsDepth.at<float>(cand.v0,cand.u0);
+                    if(c[0] != -1)
+                    {
+                        if(cand.d1 > exist_d1)
+                            continue;
+                    }
+                    else
+                        correspCount++;
+
+                    c = Vec2s(cand.u1, cand.v1);
+                    exist_d1 = cand.d1;
+                }
+            }
+            counts[stripe] = correspCount;
+        }
+    }
+
+private:
+    CorrespsResolveInvoker& operator=(const CorrespsResolveInvoker&);
+
+    const std::vector<std::vector<CorrespCandidate> >& candidates;
+    int srcStripesCount;
+    int dstStripesCount;
+    Mat& corresps;
+    Mat& correspsDepth;
+    int* counts;
+};
+
 static
 void computeCorresps(const Mat& K, const Mat& K_inv, const Mat& Rt,
                      const Mat& depth0, const Mat& validMask0,
@@ -463,7 +666,6 @@ void computeCorresps(const Mat& K, const Mat& K_inv, const Mat& Rt,
 
     Mat corresps(depth1.size(), CV_16SC2, Scalar::all(-1));
     
-    Rect r(0, 0, depth1.cols, depth1.rows);
     Mat Kt = Rt(Rect(3,0,1,3)).clone();
     Kt = K * Kt;
     const double * Kt_ptr = Kt.ptr<const double>();
@@ -495,54 +697,20 @@ void computeCorresps(const Mat& K, const Mat& K_inv, const Mat& Rt,
         }
     }
 
-    int correspCount = 0;
-    for(int v1 = 0; v1 < depth1.rows; v1++)
-    {
-        const float *depth1_row = depth1.ptr<float>(v1);
-        const uchar *mask1_row = selectMask1.ptr<uchar>(v1);
-        for(int u1 = 0; u1 < depth1.cols; u1++)
-        {
-            float d1 = depth1_row[u1];
-            if(mask1_row[u1])
-            {
-                CV_DbgAssert(!cvIsNaN(d1));
-                float transformed_d1 = static_cast<float>(d1 * (KRK_inv6_u1[u1] + KRK_inv7_v1_plus_KRK_inv8[v1]) + 
-                                                          Kt_ptr[2]);
-                if(transformed_d1 > 0)
-                {
-                    float transformed_d1_inv = 1.f / transformed_d1;
-                    int u0 = cvRound(transformed_d1_inv * (d1 * (KRK_inv0_u1[u1] + KRK_inv1_v1_plus_KRK_inv2[v1]) + 
-                                                           Kt_ptr[0]));
-                    int v0 = cvRound(transformed_d1_inv * (d1 * (KRK_inv3_u1[u1] + KRK_inv4_v1_plus_KRK_inv5[v1]) + 
-                                                           Kt_ptr[1]));
-                    
-                    if(r.contains(Point(u0,v0)))
-                    {
-                        float d0 = depth0.at<float>(v0,u0);
-                        if(validMask0.at<uchar>(v0, u0) && std::abs(transformed_d1 - d0) <= maxDepthDiff)
-                        {
-                            CV_DbgAssert(!cvIsNaN(d0));
-                            Vec2s& c = corresps.at<Vec2s>(v0,u0);
-                            if(c[0] != -1)
-                            {
-                                int exist_u1 = c[0], exist_v1 = c[1];
-
-                                float exist_d1 = (float)(depth1.at<float>(exist_v1,exist_u1) * 
-                                    (KRK_inv6_u1[exist_u1] + KRK_inv7_v1_plus_KRK_inv8[exist_v1]) + Kt_ptr[2]);
+    const int stripesCount = (depth1.rows + correspsStripeRows - 1) / correspsStripeRows;
+    std::vector<std::vector<CorrespCandidate> > candidates(stripesCount * stripesCount);
+    parallel_for_(Range(0, stripesCount),
+                  CorrespsProjectInvoker(depth0, validMask0, depth1, selectMask1, maxDepthDiff,
+                                         KRK_inv0_u1, Kt_ptr, candidates, stripesCount));
 
-                                if(transformed_d1 > exist_d1)
-                                    continue;
-                            }
-                            else
-                                correspCount++;
+    Mat correspsDepth(depth1.size(), CV_32FC1);
+    std::vector<int> counts(stripesCount);
+    parallel_for_(Range(0, stripesCount),
+                  CorrespsResolveInvoker(candidates, stripesCount, stripesCount, corresps, correspsDepth, &counts[0]));
 
-                            c = Vec2s((short)u1, (short)v1);
-                        }
-                    }
-                }
-            }
-        }
-    }
+    int correspCount = 0;
+    for(int stripe = 0; stripe < stripesCount; stripe++)
+        correspCount += counts[stripe];
 
     _corresps.create(correspCount, 1, CV_32SC4);
     Vec4i * corresps_ptr = _corresps.ptr<Vec4i>();
@@ -631,78 +799,324 @@ void calcICPEquationCoeffsTranslation(double* C, const Point3f& /*p0*/, const Ve
 typedef
 void (*CalcICPEquationCoeffsPtr)(double*, const Point3f&, const Vec3f&);
 
+// The normal equations are summed by fixed-size stripes of correspondences in parallel.
+// Each stripe keeps its own packed upper triangle of AtA and its AtB, and the stripes
+// are added in order afterwards, so the result does not depend on the number of threads.
+const int lsmStripeSize = 4096;
+
+static inline
+int getLsmStripesCount(int correspsCount)
+{
+    return std::max(1, (correspsCount + lsmStripeSize - 1) / lsmStripeSize);
+}
+
+static inline
+int getLsmPartialSize(int transformDim)
+{
+    return transformDim * (transformDim + 1) / 2 + transformDim;
+}
+
+// Adds A^T*A (upper triangle, packed by rows) and A^T*b of one equation to the sums
+static inline
+void accumulateLsm(double* AtA_packed, double* AtB, const double* A, double b, int transformDim, bool haveSSE2)
+{
+    double* row = AtA_packed;
+    for(int y = 0; y < transformDim; y++)
+    {
+        const double ay = A[y];
+        int x = y;
+#if CV_SSE2
+        if(haveSSE2)
+        {
+            __m128d ay2 = _mm_set1_pd(ay);
+            for(; x <= transformDim - 2; x += 2)
+            {
+                __m128d sum = _mm_loadu_pd(row + x - y);
+                _mm_storeu_pd(row + x - y, _mm_add_pd(sum, _mm_mul_pd(ay2, _mm_loadu_pd(A + x))));
+            }
+        }
+#else
+        (void)haveSSE2;
+#endif
+        for(; x < transformDim; x++)
+            row[x - y] += ay * A[x];
+
+        AtB[y] += ay * b;
+        row += transformDim - y;
+    }
+}
+
+static
+void reduceLsmStripes(const std::vector<double>& partials, int stripesCount, int transformDim, Mat& AtA, Mat& AtB)
+{
+    const int partialSize = getLsmPartialSize(transformDim);
+    std::vector<double> sums(partialSize, 0.);
+    for(int stripe = 0; stripe < stripesCount; stripe++)
+    {
+        const double* partial = &partials[stripe * partialSize];
+        for(int i = 0; i < partialSize; i++)
+            sums[i] += partial[i];
+    }
+
+    AtA = Mat(transformDim, transformDim, CV_64FC1);
+    AtB = Mat(transformDim, 1, CV_64FC1);
+    const double* row = &sums[0];
+    for(int y = 0; y < transformDim; y++)
+    {
+        for(int x = y; x < transformDim; x++)
+            AtA.at<double>(y,x) = AtA.at<double>(x,y) = row[x - y];
+        row += transformDim - y;
+    }
+    for(int y = 0; y < transformDim; y++)
+        AtB.at<double>(y) = row[y];
+}
+
+class RgbdDiffsInvoker : public ParallelLoopBody
+{
+public:
+    RgbdDiffsInvoker(const Mat& _image0, const Mat& _image1, const Mat& _corresps,
+                     float* _diffs, double* _sigmas) :
+        image0(_image0), image1(_image1), corresps(_corresps), diffs(_diffs), sigmas(_sigmas)
+    {}
+
+    virtual void operator()(const Range& range) const
+    {
+        const Vec4i* corresps_ptr = corresps.ptr<Vec4i>();
+        for(int stripe = range.start; stripe < range.end; stripe++)
+        {
+            int end = std::min(corresps.rows, (stripe + 1) * lsmStripeSize);
+            double sigma = 0;
+            for(int correspIndex = stripe * lsmStripeSize; correspIndex < end; correspIndex++)
+            {
+                const Vec4i& c = corresps_ptr[correspIndex];
+                int u0 = c[0], v0 = c[1];
+                int u1 = c[2], v1 = c[3];
+
+                diffs[correspIndex] = static_cast<float>(static_cast<int>(image0.at<uchar>(v0,u0)) -
+                                                         static_cast<int>(image1.at<uchar>(v1,u1)));
+                sigma += diffs[correspIndex] * diffs[correspIndex];
+            }
+            sigmas[stripe] = sigma;
+        }
+    }
+
+private:
+    RgbdDiffsInvoker& operator=(const RgbdDiffsInvoker&);
+
+    const Mat& image0;
+    const Mat& image1;
+    const Mat& corresps;
+    float* diffs;
+    double* sigmas;
+};
+
+class RgbdLsmInvoker : public ParallelLoopBody
+{
+public:
+    RgbdLsmInvoker(const Mat& _cloud0, const Mat& _Rt, const Mat& _dI_dx1, const Mat& _dI_dy1,
+                   const Mat& _corresps, const float* _diffs, double _sigma, double _fx, double _fy,
+                   double _sobelScale, CalcRgbdEquationCoeffsPtr _func, int _transformDim, double* _partials) :
+        cloud0(_cloud0), Rt(_Rt), dI_dx1(_dI_dx1), dI_dy1(_dI_dy1), corresps(_corresps), diffs(_diffs),
+        sigma(_sigma), fx(_fx), fy(_fy), sobelScale(_sobelScale), func(_func), transformDim(_transformDim),
+        partials(_partials)
+    {
+        haveSSE2 = checkHardwareSupport(CV_CPU_SSE2);
+    }
+
+    virtual void operator()(const Range& range) const
+    {
+        const double * Rt_ptr = Rt.ptr<const double>();
+        const Vec4i* corresps_ptr = corresps.ptr<Vec4i>();
+        const int partialSize = getLsmPartialSize(transformDim);
+
+        double A_ptr[6];
+        for(int stripe = range.start; stripe < range.end; stripe++)
+        {
+            double* AtA_packed = partials + stripe * partialSize;
+            double* AtB_ptr = AtA_packed + partialSize - transformDim;
+            std::fill(AtA_packed, AtA_packed + partialSize, 0.);
+
+            int end = std::min(corresps.rows, (stripe + 1) * lsmStripeSize);
+            for(int correspIndex = stripe * lsmStripeSize; correspIndex < end; correspIndex++)
+            {
+                const Vec4i& c = corresps_ptr[correspIndex];
+                int u0 = c[0], v0 = c[1];
+                int u1 = c[2], v1 = c[3];
+
+                double w = sigma + std::abs(diffs[correspIndex]);
+                w = w > DBL_EPSILON ? 1./w : 1.;
+
+                double w_sobelScale = w * sobelScale;
+
+                const Point3f& p0 = cloud0.at<Point3f>(v0,u0);
+                Point3f tp0;
+                tp0.x = (float)(p0.x * Rt_ptr[0] + p0.y * Rt_ptr[1] + p0.z * Rt_ptr[2] + Rt_ptr[3]);
+                tp0.y = (float)(p0.x * Rt_ptr[4] + p0.y * Rt_ptr[5] + p0.z * Rt_ptr[6] + Rt_ptr[7]);
+                tp0.z = (float)(p0.x * Rt_ptr[8] + p0.y * Rt_ptr[9] + p0.z * Rt_ptr[10] + Rt_ptr[11]);
+
+                func(A_ptr,
+                     w_sobelScale * dI_dx1.at<short int>(v1,u1),
+                     w_sobelScale * dI_dy1.at<short int>(v1,u1),
+                     tp0, fx, fy);
+
+                accumulateLsm(AtA_packed, AtB_ptr, A_ptr, w * diffs[correspIndex], transformDim, haveSSE2);
+            }
+        }
+    }
+
+private:
+    RgbdLsmInvoker& operator=(const RgbdLsmInvoker&);
+
+    const Mat& cloud0;
+    const Mat& Rt;
+    const Mat& dI_dx1;
+    const Mat& dI_dy1;
+    const Mat& corresps;
+    const float* diffs;
+    double sigma, fx, fy, sobelScale;
+    CalcRgbdEquationCoeffsPtr func;
+    int transformDim;
+    double* partials;
+    bool haveSSE2;
+};
+
 static 
 void calcRgbdLsmMatrices(const Mat& image0, const Mat& cloud0, const Mat& Rt,
                const Mat& image1, const Mat& dI_dx1, const Mat& dI_dy1,
                const Mat& corresps, double fx, double fy, double sobelScaleIn,
                Mat& AtA, Mat& AtB, CalcRgbdEquationCoeffsPtr func, int transformDim)
 {
-    AtA = Mat(transformDim, transformDim, CV_64FC1, Scalar(0));
-    AtB = Mat(transformDim, 1, CV_64FC1, Scalar(0));
-    double* AtB_ptr = AtB.ptr<double>();
+    CV_Assert(transformDim <= 6);
 
     const int correspsCount = corresps.rows;
 
     CV_Assert(Rt.type() == CV_64FC1);
-    const double * Rt_ptr = Rt.ptr<const double>();
 
     AutoBuffer<float> diffs(correspsCount);
     float* diffs_ptr = diffs;
 
-    const Vec4i* corresps_ptr = corresps.ptr<Vec4i>();
+    const int stripesCount = getLsmStripesCount(correspsCount);
+    std::vector<double> sigmas(stripesCount);
+    parallel_for_(Range(0, stripesCount), RgbdDiffsInvoker(image0, image1, corresps, diffs_ptr, &sigmas[0]));
 
     double sigma = 0;
-    for(int correspIndex = 0; correspIndex < corresps.rows; correspIndex++)
+    for(int stripe = 0; stripe < stripesCount; stripe++)
+        sigma += sigmas[stripe];
+    sigma = std::sqrt(sigma/correspsCount);
+
+    std::vector<double> partials(stripesCount * getLsmPartialSize(transformDim));
+    parallel_for_(Range(0, stripesCount),
+                  RgbdLsmInvoker(cloud0, Rt, dI_dx1, dI_dy1, corresps, diffs_ptr, sigma, fx, fy, sobelScaleIn,
+                                 func, transformDim, &partials[0]));
+
+    reduceLsmStripes(partials, stripesCount, transformDim, AtA, AtB);
+}
+
+class ICPDiffsInvoker : public ParallelLoopBody
+{
+public:
+    ICPDiffsInvoker(const Mat& _cloud0, const Mat& _Rt, const Mat& _cloud1, const Mat& _normals1,
+                    const Mat& _corresps, float* _diffs, Point3f* _tps0, double* _sigmas) :
+        cloud0(_cloud0), Rt(_Rt), cloud1(_cloud1), normals1(_normals1), corresps(_corresps),
+        diffs(_diffs), tps0(_tps0), sigmas(_sigmas)
+    {}
+
+    virtual void operator()(const Range& range) const
     {
-         const Vec4i& c = corresps_ptr[correspIndex];
-         int u0 = c[0], v0 = c[1];
-         int u1 = c[2], v1 = c[3];
-              
-         diffs_ptr[correspIndex] = static_cast<float>(static_cast<int>(image0.at<uchar>(v0,u0)) - 
-                                                      static_cast<int>(image1.at<uchar>(v1,u1)));
-         sigma += diffs_ptr[correspIndex] * diffs_ptr[correspIndex];
+        const double * Rt_ptr = Rt.ptr<const double>();
+        const Vec4i* corresps_ptr = corresps.ptr<Vec4i>();
+        for(int stripe = range.start; stripe < range.end; stripe++)
+        {
+            int end = std::min(corresps.rows, (stripe + 1) * lsmStripeSize);
+            double sigma = 0;
+            for(int correspIndex = stripe * lsmStripeSize; correspIndex < end; correspIndex++)
+            {
+                const Vec4i& c = corresps_ptr[correspIndex];
+                int u0 = c[0], v0 = c[1];
+                int u1 = c[2], v1 = c[3];
+
+                const Point3f& p0 = cloud0.at<Point3f>(v0,u0);
+                Point3f tp0;
+                tp0.x = (float)(p0.x * Rt_ptr[0] + p0.y * Rt_ptr[1] + p0.z * Rt_ptr[2] + Rt_ptr[3]);
+                tp0.y = (float)(p0.x * Rt_ptr[4] + p0.y * Rt_ptr[5] + p0.z * Rt_ptr[6] + Rt_ptr[7]);
+                tp0.z = (float)(p0.x * Rt_ptr[8] + p0.y * Rt_ptr[9] + p0.z * Rt_ptr[10] + Rt_ptr[11]);
+
+                Vec3f n1 = normals1.at<Vec3f>(v1, u1);
+                Point3f v = cloud1.at<Point3f>(v1,u1) - tp0;
+
+                tps0[correspIndex] = tp0;
+                diffs[correspIndex] = n1[0] * v.x + n1[1] * v.y + n1[2] * v.z;
+                sigma += diffs[correspIndex] * diffs[correspIndex];
+            }
+            sigmas[stripe] = sigma;
+        }
     }
-    sigma = std::sqrt(sigma/correspsCount);
 
-    std::vector<double> A_buf(transformDim);
-    double* A_ptr = &A_buf[0];
+private:
+    ICPDiffsInvoker& operator=(const ICPDiffsInvoker&);
+
+    const Mat& cloud0;
+    const Mat& Rt;
+    const Mat& cloud1;
+    const Mat& normals1;
+    const Mat& corresps;
+    float* diffs;
+    Point3f* tps0;
+    double* sigmas;
+};
 
-    for(int correspIndex = 0; correspIndex < corresps.rows; correspIndex++)
+class ICPLsmInvoker : public ParallelLoopBody
+{
+public:
+    ICPLsmInvoker(const Mat& _normals1, const Mat& _corresps, const float* _diffs, const Point3f* _tps0,
+                  double _sigma, CalcICPEquationCoeffsPtr _func, int _transformDim, double* _partials) :
+        normals1(_normals1), corresps(_corresps), diffs(_diffs), tps0(_tps0), sigma(_sigma),
+        func(_func), transformDim(_transformDim), partials(_partials)
     {
-         const Vec4i& c = corresps_ptr[correspIndex];
-         int u0 = c[0], v0 = c[1];
-         int u1 = c[2], v1 = c[3];
+        haveSSE2 = checkHardwareSupport(CV_CPU_SSE2);
+    }
 
-         double w = sigma + std::abs(diffs_ptr[correspIndex]);
-         w = w > DBL_EPSILON ? 1./w : 1.;
+    virtual void operator()(const Range& range) const
+    {
+        const Vec4i* corresps_ptr = corresps.ptr<Vec4i>();
+        const int partialSize = getLsmPartialSize(transformDim);
 
-         double w_sobelScale = w * sobelScaleIn;
+        double A_ptr[6];
+        for(int stripe = range.start; stripe < range.end; stripe++)
+        {
+            double* AtA_packed = partials + stripe * partialSize;
+            double* AtB_ptr = AtA_packed + partialSize - transformDim;
+            std::fill(AtA_packed, AtA_packed + partialSize, 0.);
 
-         const Point3f& p0 = cloud0.at<Point3f>(v0,u0);
-         Point3f tp0;
-         tp0.x = (float)(p0.x * Rt_ptr[0] + p0.y * Rt_ptr[1] + p0.z * Rt_ptr[2] + Rt_ptr[3]);
-         tp0.y = (float)(p0.x * Rt_ptr[4] + p0.y * Rt_ptr[5] + p0.z * Rt_ptr[6] + Rt_ptr[7]);
-         tp0.z = (float)(p0.x * Rt_ptr[8] + p0.y * Rt_ptr[9] + p0.z * Rt_ptr[10] + Rt_ptr[11]);
+            int end = std::min(corresps.rows, (stripe + 1) * lsmStripeSize);
+            for(int correspIndex = stripe * lsmStripeSize; correspIndex < end; correspIndex++)
+            {
+                const Vec4i& c = corresps_ptr[correspIndex];
+                int u1 = c[2], v1 = c[3];
 
-         func(A_ptr,
-              w_sobelScale * dI_dx1.at<short int>(v1,u1),
-              w_sobelScale * dI_dy1.at<short int>(v1,u1),
-              tp0, fx, fy);
+                double w = sigma + std::abs(diffs[correspIndex]);
+                w = w > DBL_EPSILON ? 1./w : 1.;
 
-        for(int y = 0; y < transformDim; y++)
-        {
-            double* AtA_ptr = AtA.ptr<double>(y);
-            for(int x = y; x < transformDim; x++)
-                AtA_ptr[x] += A_ptr[y] * A_ptr[x];
+                func(A_ptr, tps0[correspIndex], normals1.at<Vec3f>(v1, u1) * w);
 
-            AtB_ptr[y] += A_ptr[y] * w * diffs_ptr[correspIndex];
+                accumulateLsm(AtA_packed, AtB_ptr, A_ptr, w * diffs[correspIndex], transformDim, haveSSE2);
+            }
         }
-    }		
-    
-    for(int y = 0; y < transformDim; y++)
-        for(int x = y+1; x < transformDim; x++)
-            AtA.at<double>(x,y) = AtA.at<double>(y,x);
-}
+    }
+
+private:
+    ICPLsmInvoker& operator=(const ICPLsmInvoker&);
+
+    const Mat& normals1;
+    const Mat& corresps;
+    const float* diffs;
+    const Point3f* tps0;
+    double sigma;
+    CalcICPEquationCoeffsPtr func;
+    int transformDim;
+    double* partials;
+    bool haveSSE2;
+};
 
 static
 void calcICPLsmMatrices(const Mat& cloud0, const Mat& Rt,
@@ -710,14 +1124,11 @@ void calcICPLsmMatrices(const Mat& cloud0, const Mat& Rt,
                         const Mat& corresps,
                         Mat& AtA, Mat& AtB, CalcICPEquationCoeffsPtr func, int transformDim)
 {
-    AtA = Mat(transformDim, transformDim, CV_64FC1, Scalar(0));
-    AtB = Mat(transformDim, 1, CV_64FC1, Scalar(0));
-    double* AtB_ptr = AtB.ptr<double>();
+    CV_Assert(transformDim <= 6);
 
     const int correspsCount = corresps.rows;
 
     CV_Assert(Rt.type() == CV_64FC1);
-    const double * Rt_ptr = Rt.ptr<const double>();
 
     AutoBuffer<float> diffs(correspsCount);
     float * diffs_ptr = diffs;
@@ -725,56 +1136,21 @@ void calcICPLsmMatrices(const Mat& cloud0, const Mat& Rt,
     AutoBuffer<Point3f> transformedPoints0(correspsCount);
     Point3f * tps0_ptr = transformedPoints0;
 
-    const Vec4i* corresps_ptr = corresps.ptr<Vec4i>();
+    const int stripesCount = getLsmStripesCount(correspsCount);
+    std::vector<double> sigmas(stripesCount);
+    parallel_for_(Range(0, stripesCount),
+                  ICPDiffsInvoker(cloud0, Rt, cloud1, normals1, corresps, diffs_ptr, tps0_ptr, &sigmas[0]));
 
     double sigma = 0;
-    for(int correspIndex = 0; correspIndex < corresps.rows; correspIndex++)
-    {
-        const Vec4i& c = corresps_ptr[correspIndex];
-        int u0 = c[0], v0 = c[1];
-        int u1 = c[2], v1 = c[3];
-
-        const Point3f& p0 = cloud0.at<Point3f>(v0,u0);
-        Point3f tp0;
-        tp0.x = (float)(p0.x * Rt_ptr[0] + p0.y * Rt_ptr[1] + p0.z * Rt_ptr[2] + Rt_ptr[3]);
-        tp0.y = (float)(p0.x * Rt_ptr[4] + p0.y * Rt_ptr[5] + p0.z * Rt_ptr[6] + Rt_ptr[7]);
-        tp0.z = (float)(p0.x * Rt_ptr[8] + p0.y * Rt_ptr[9] + p0.z * Rt_ptr[10] + Rt_ptr[11]);
-
-        Vec3f n1 = normals1.at<Vec3f>(v1, u1);
-        Point3f v = cloud1.at<Point3f>(v1,u1) - tp0;
-
-        tps0_ptr[correspIndex] = tp0;
-        diffs_ptr[correspIndex] = n1[0] * v.x + n1[1] * v.y + n1[2] * v.z;
-        sigma += diffs_ptr[correspIndex] * diffs_ptr[correspIndex];
-    }
-
+    for(int stripe = 0; stripe < stripesCount; stripe++)
+        sigma += sigmas[stripe];
     sigma = std::sqrt(sigma/correspsCount);
 
-    std::vector<double> A_buf(transformDim);
-    double* A_ptr = &A_buf[0];
-    for(int correspIndex = 0; correspIndex < corresps.rows; correspIndex++)
-    {
-        const Vec4i& c = corresps_ptr[correspIndex];
-        int u1 = c[2], v1 = c[3];
-
-        double w = sigma + std::abs(diffs_ptr[correspIndex]);
-        w = w > DBL_EPSILON ? 1./w : 1.;
-
-        func(A_ptr, tps0_ptr[correspIndex], normals1.at<Vec3f>(v1, u1) * w);
+    std::vector<double> partials(stripesCount * getLsmPartialSize(transformDim));
+    parallel_for_(Range(0, stripesCount),
+                  ICPLsmInvoker(normals1, corresps, diffs_ptr, tps0_ptr, sigma, func, transformDim, &partials[0]));
 
-        for(int y = 0; y < transformDim; y++)
-        {
-            double* AtA_ptr = AtA.ptr<double>(y);
-            for(int x = y; x < transformDim; x++)
-                AtA_ptr[x] += A_ptr[y] * A_ptr[x];
-
-            AtB_ptr[y] += A_ptr[y] * w * diffs_ptr[correspIndex];
-        }
-    }
-
-    for(int y = 0; y < transformDim; y++)
-        for(int x = y+1; x < transformDim; x++)
-            AtA.at<double>(x,y) = AtA.at<double>(y,x);
+    reduceLsmStripes(partials, stripesCount, transformDim, AtA, AtB);
 }
 
 static
@@ -1401,6 +1777,102 @@ bool RgbdICPOdometry::computeImpl(const Ptr<OdometryFrame>& srcFrame, const Ptr<
     return RGBDICPOdometryImpl(Rt, initRt, srcFrame, dstFrame, cameraMatrix, (float)maxDepthDiff, iterCounts,  maxTranslation, maxRotation, MERGED_ODOMETRY, transformType);
 }
 
+//
+OdometryTracker::Stats::Stats() :
+    framesCount(0), keyframesCount(0), preparedCount(0), cacheHits(0), prepareTime(0.), savedTime(0.)
+{}
+
+OdometryTracker::OdometryTracker(const Ptr<Odometry>& _odometry) :
+    odometry(_odometry), keyframePrepareTime(0.), framePrepareTime(0.)
+{
+    if(odometry.empty())
+        CV_Error(Error::StsBadArg, "Null odometry pointer.");
+}
+
+double OdometryTracker::prepareFrame(Ptr<OdometryFrame>& _frame, int cacheType)
+{
+    int64 t = getTickCount();
+    odometry->prepareFrameCache(_frame, cacheType);
+    double time = (getTickCount() - t) / getTickFrequency();
+
+    stats.prepareTime += time;
+    return time;
+}
+
+void OdometryTracker::setKeyframe(const Ptr<OdometryFrame>& _keyframe)
+{
+    if(_keyframe.empty())
+        CV_Error(Error::StsBadArg, "Null keyframe pointer.");
+
+    if(_keyframe == frame)
+    {
+        promoteFrame();
+        return;
+    }
+
+    keyframe = _keyframe;
+    keyframePrepareTime = prepareFrame(keyframe, OdometryFrame::CACHE_DST);
+    stats.preparedCount++;
+    stats.keyframesCount++;
+}
+
+bool OdometryTracker::track(const Ptr<OdometryFrame>& _frame, Mat& Rt, const Mat& initRt)
+{
+    if(_frame.empty())
+        CV_Error(Error::StsBadArg, "Null frame pointer.");
+
+    stats.framesCount++;
+
+    if(keyframe.empty())
+    {
+        frame.release();
+        setKeyframe(_frame);
+        Rt = Mat::eye(4, 4, CV_64FC1);
+        return true;
+    }
+
+    // Only the source role: most frames never become the keyframe, so e.g. the normals
+    // of ICPOdometry are computed for the promoted ones only (see promoteFrame)
+    frame = _frame;
+    framePrepareTime = prepareFrame(frame, OdometryFrame::CACHE_SRC);
+    stats.preparedCount++;
+
+    // Odometry::compute() only checks the prepared caches, the keyframe is reused as is
+    stats.cacheHits++;
+    stats.savedTime += keyframePrepareTime;
+
+    return odometry->compute(frame, keyframe, Rt, initRt);
+}
+
+bool OdometryTracker::track(const Mat& image, const Mat& depth, const Mat& mask, Mat& Rt, const Mat& initRt)
+{
+    return track(makePtr<OdometryFrame>(image, depth, mask), Rt, initRt);
+}
+
+void OdometryTracker::promoteFrame()
+{
+    if(frame.empty())
+        CV_Error(Error::StsBadArg, "There is no tracked frame to promote.");
+
+    // The pyramids of the source role are reused, the destination data is added. The source mask
+    // was built without the normals, so it is rebuilt with them.
+    keyframe = frame;
+    keyframe->pyramidMask.clear();
+    keyframePrepareTime = framePrepareTime + prepareFrame(keyframe, OdometryFrame::CACHE_DST);
+    frame.release();
+
+    stats.keyframesCount++;
+    stats.cacheHits++;
+    stats.savedTime += framePrepareTime;
+}
+
+void OdometryTracker::reset()
+{
+    keyframe.release();
+    frame.release();
+    keyframePrepareTime = framePrepareTime = 0.;
+}
+
 //
 
 void
@@ -0,0 +1,203 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote products
+//     derived from this software without specific prior written permission.
+//
+// This software is provided by the copyright holders and contributors "as is" and
+// any express or implied warranties, including, but not limited to, the implied
+// warranties of merchantability and fitness for a particular purpose are disclaimed.
+// In no event shall the Intel Corporation or contributors be liable for any direct,
+// indirect, incidental, special, exemplary, or consequential damages
+// (including, but not limited to, procurement of substitute goods or services;
+// loss of use, data, or profits; or business interruption) however caused
+// and on any theory of liability, whether in contract, strict liability,
+// or tort (including negligence or otherwise) arising in any way out of
+// the use of this software, even if advised of the possibility of such damage.
+//
+//M*/
+
+
+
+#include "test_precomp.hpp"
+
+#include <opencv2/imgproc.hpp>
+
+namespace cv
+{
+namespace linemod
+{
+
+// A rectangle with an ellipse inside it, rotated and scaled around the center
+static void drawObject(Mat& image, Mat& mask, Point2f center, float angle, float scale)
+{
+    RotatedRect box(center, Size2f(60.f * scale, 40.f * scale), angle);
+    Point2f corners[4];
+    box.points(corners);
+    Point polygon[4];
+    for (int i = 0; i < 4; ++i)
+        polygon[i] = corners[i];
+
+    fillConvexPoly(image, polygon, 4, Scalar(40, 160, 220));
+    ellipse(image, RotatedRect(center, Size2f(30.f * scale, 20.f * scale), angle + 45.f), Scalar(200, 60, 20), -1);
+    fillConvexPoly(mask, polygon, 4, Scalar::all(255));
+}
+
+static Ptr<Detector> createDetector(int templatesCount, int classesCount)
+{
+    Ptr<Detector> detector = getDefaultLINE();
+    int templatesPerClass = templatesCount / classesCount;
+    for (int c = 0; c < classesCount; ++c)
+    {
+        String class_id = format("class_%d", c);
+        float scale = 0.8f + 0.4f * c / classesCount;
+        for (int t = 0; t < templatesPerClass; ++t)
+        {
+            Mat image(128, 128, CV_8UC3, Scalar::all(0)), mask(128, 128, CV_8UC1, Scalar::all(0));
+            drawObject(image, mask, Point2f(64.f, 64.f), 360.f * t / templatesPerClass, scale);
+            std::vector<Mat> sources(1, image);
+            detector->addTemplate(sources, class_id, mask);
+        }
+    }
+    return detector;
+}
+
+static Mat makeScene()
+{
+    Mat scene(480, 640, CV_8UC3, Scalar::all(0)), mask = Mat::zeros(scene.size(), CV_8UC1);
+    RNG rng(0);
+    for (int i = 0; i < 12; ++i)
+        drawObject(scene, mask, Point2f(rng.uniform(60.f, 580.f), rng.uniform(60.f, 420.f)),
+                   rng.uniform(0.f, 360.f), rng.uniform(0.8f, 1.2f));
+    return scene;
+}
+
+static bool equalMatches(const std::vector<Match>& expected, const std::vector<Match>& actual)
+{
+    if (expected.size() != actual.size())
+        return false;
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        if (!(expected[i] == actual[i]) || expected[i].template_id != actual[i].template_id)
+            return false;
+    }
+    return true;
+}
+
+class CV_LinemodThreadsTest : public cvtest::BaseTest
+{
+protected:
+    virtual void run(int);
+};
+
+// The templates are matched in parallel stripes, the result must be the one of the serial search
+void CV_LinemodThreadsTest::run(int)
+{
+    Ptr<Detector> detector = createDetector(128, 4);
+    std::vector<Mat> sources(1, makeScene());
+
+    int numThreads = getNumThreads();
+
+    std::vector<Match> expected;
+    setNumThreads(1);
+    detector->match(sources, 70.f, expected);
+
+    std::vector<Match> matches;
+    setNumThreads(4);
+    detector->match(sources, 70.f, matches);
+
+    setNumThreads(numThreads);
+
+    if (expected.empty())
+    {
+        ts->printf(cvtest::TS::LOG, "No matches found in the synthetic scene");
+        ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+        return;
+    }
+
+    if (!equalMatches(expected, matches))
+    {
+        ts->printf(cvtest::TS::LOG, "Parallel matches differ from the serial ones: %d vs %d matches",
+                   static_cast<int>(matches.size()), static_cast<int>(expected.size()));
+        ts->set_failed_test_info(cvtest::TS::FAIL_MISMATCH);
+    }
+}
+
+class CV_LinemodOptimizedTest : public cvtest::BaseTest
+{
+protected:
+    virtual void run(int);
+};
+
+// setUseOptimized(false) disables the AVX2 and SSE kernels of the response maps and similarities.
+// This compares the SIMD path selected on this machine against the scalar one; NEON is selected
+// at build time and is not switched off.
+void CV_LinemodOptimizedTest::run(int)
+{
+    Ptr<Detector> detector = createDetector(128, 4);
+    std::vector<Mat> sources(1, makeScene());
+
+    bool useOptimized = cv::useOptimized();
+
+    std::vector<Match> expected;
+    setUseOptimized(false);
+    detector->match(sources, 70.f, expected);
+
+    std::vector<Match> matches;
+    setUseOptimized(true);
+    detector->match(sources, 70.f, matches);
+
+    setUseOptimized(useOptimized);
+
+    if (expected.empty())
+    {
+        ts->printf(cvtest::TS::LOG, "No matches found in the synthetic scene");
+        ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+        return;
+    }
+
+    if (!equalMatches(expected, matches))
+    {
+        ts->printf(cvtest::TS::LOG, "Optimized matches differ from the scalar ones: %d vs %d matches",
+                   static_cast<int>(matches.size()), static_cast<int>(expected.size()));
+        ts->set_failed_test_info(cvtest::TS::FAIL_MISMATCH);
+    }
+}
+
+}
+}
+
+TEST(RGBD_Linemod, threads)
+{
+    cv::linemod::CV_LinemodThreadsTest test;
+    test.safe_run();
+}
+
+TEST(RGBD_Linemod, optimized)
+{
+    cv::linemod::CV_LinemodOptimizedTest test;
+    test.safe_run();
+}
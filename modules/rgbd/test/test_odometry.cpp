@@ -330,6 +330,101 @@ void CV_OdometryTest::run(int)
     }
 }
 
+class CV_OdometryTrackerTest : public CV_OdometryTest
+{
+public:
+    CV_OdometryTrackerTest(const Ptr<Odometry>& _odometry) :
+        CV_OdometryTest(_odometry, 0, 0) {}
+
+protected:
+    virtual void run(int);
+};
+
+void CV_OdometryTrackerTest::run(int)
+{
+    Mat K = Mat::eye(3,3,CV_32FC1);
+    {
+        K.at<float>(0,0) = 525.0f;
+        K.at<float>(1,1) = 525.0f;
+        K.at<float>(0,2) = 319.5f;
+        K.at<float>(1,2) = 239.5f;
+    }
+
+    Mat image, depth;
+    if(!readData(image, depth))
+        return;
+
+    odometry->setCameraMatrix(K);
+
+    OdometryTracker tracker(odometry);
+
+    // 1. The first frame becomes the keyframe.
+    Mat trackRt;
+    tracker.track(image, depth, Mat(), trackRt);
+    if(tracker.getKeyframe().empty() || norm(trackRt, Mat::eye(4,4,CV_64FC1)) > DBL_EPSILON)
+    {
+        ts->printf(cvtest::TS::LOG, "The first tracked frame has to become the keyframe");
+        ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+        return;
+    }
+
+    // 2. Each tracked frame has to give the same transformation as Odometry::compute() on the plain data.
+    int iterCount = 10;
+    for(int iter = 0; iter < iterCount; iter++)
+    {
+        Mat rvec, tvec;
+        generateRandomTransformation(rvec, tvec);
+        Mat warpedImage, warpedDepth;
+        warpFrame(image, depth, rvec, tvec, K, warpedImage, warpedDepth);
+        dilateFrame(warpedImage, warpedDepth);
+
+        bool isTracked = tracker.track(warpedImage, warpedDepth, Mat(), trackRt);
+
+        Mat calcRt;
+        bool isComputed = odometry->compute(warpedImage, warpedDepth, Mat(), image, depth, Mat(), calcRt);
+
+        if(isTracked != isComputed || (isComputed && norm(trackRt, calcRt) > DBL_EPSILON))
+        {
+            ts->printf(cvtest::TS::LOG, "Tracked transformation differs from the computed one on iteration %d", iter);
+            ts->set_failed_test_info(cvtest::TS::FAIL_BAD_ACCURACY);
+            return;
+        }
+
+        // The tracked frame is only a source, so it has no data of the destination role.
+        if(!tracker.getFrame()->pyramidNormals.empty())
+        {
+            ts->printf(cvtest::TS::LOG, "The tracked frame has to be prepared for the source role only");
+            ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+            return;
+        }
+    }
+
+    // 3. The promoted frame keeps its pyramids and gets the data of the destination role.
+    Ptr<OdometryFrame> frame = tracker.getFrame();
+    const uchar* pyramidData = frame->pyramidImage.empty() ? frame->pyramidDepth.back().data : frame->pyramidImage.back().data;
+    tracker.promoteFrame();
+    Ptr<OdometryFrame> keyframe = tracker.getKeyframe();
+    tracker.track(image, depth, Mat(), trackRt);
+    const uchar* keyframePyramidData = keyframe->pyramidImage.empty() ? keyframe->pyramidDepth.back().data : keyframe->pyramidImage.back().data;
+    if(keyframe != frame || keyframePyramidData != pyramidData ||
+       (keyframe->pyramidNormalsMask.empty() && keyframe->pyramidTexturedMask.empty()))
+    {
+        ts->printf(cvtest::TS::LOG, "The promoted frame has to be used as the keyframe without recomputation");
+        ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+        return;
+    }
+
+    const OdometryTracker::Stats& stats = tracker.getStats();
+    if(stats.framesCount != iterCount + 2 || stats.keyframesCount != 2 ||
+       stats.preparedCount != iterCount + 2 || stats.cacheHits != iterCount + 2 ||
+       stats.savedTime <= 0. || stats.prepareTime <= 0.)
+    {
+        ts->printf(cvtest::TS::LOG, "Incorrect tracker stats: frames %d, keyframes %d, prepared %d, cache hits %d",
+                   stats.framesCount, stats.keyframesCount, stats.preparedCount, stats.cacheHits);
+        ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+    }
+}
+
 /****************************************************************************************\
 *                                Tests registrations                                     *
 \****************************************************************************************/
@@ -353,3 +448,15 @@ TEST(RGBD_Odometry_RgbdICP, algorithmic)
     cv::rgbd::CV_OdometryTest test(cv::rgbd::Odometry::create("RGBD.RgbdICPOdometry"), 0.99, 0.99);
     test.safe_run();
 }
+
+TEST(RGBD_OdometryTracker_Rgbd, reuse)
+{
+    cv::rgbd::CV_OdometryTrackerTest test(cv::rgbd::Odometry::create("RgbdOdometry"));
+    test.safe_run();
+}
+
+TEST(RGBD_OdometryTracker_RgbdICP, reuse)
+{
+    cv::rgbd::CV_OdometryTrackerTest test(cv::rgbd::Odometry::create("RgbdICPOdometry"));
+    test.safe_run();
+}
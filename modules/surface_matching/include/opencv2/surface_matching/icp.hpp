@@ -49,6 +49,7 @@
 #include <opencv2/core.hpp>
 
 #include "pose_3d.hpp"
+#include "ppf_helpers.hpp"
 #include <vector>
 
 namespace cv
@@ -151,6 +152,31 @@ public:
      */
   int registerModelToScene(const Mat& srcPC, const Mat& dstPC, std::vector<Pose3DPtr>& poses);
 
+  /**
+     *  \brief Perform registration against a prebuilt scene index
+     *
+     *  @param [in] srcPC The input point cloud for the model. Expected to have the normals (Nx6). Currently,
+     *  CV_32F is the only supported data type.
+     *  @param [in] scene Index of the scene point cloud. It can be reused for any number of registrations.
+     *  @param [out] residual The output registration error.
+     *  @param [out] pose Transformation between srcPC and the scene.
+     *  \return On successful termination, the function returns 0.
+     */
+  int registerModelToScene(const Mat& srcPC, const PointCloudIndex& scene, double& residual, double pose[16]);
+
+  /**
+     *  \brief Perform registration with multiple initial poses against a prebuilt scene index
+     *
+     *  @param [in] srcPC The input point cloud for the model. Expected to have the normals (Nx6). Currently,
+     *  CV_32F is the only supported data type.
+     *  @param [in] scene Index of the scene point cloud.
+     *  @param [in,out] poses Input poses to start with but also list output of poses.
+     *  \return On successful termination, the function returns 0.
+     *
+     *  \details The hypotheses are independent and are refined in parallel.
+     */
+  int registerModelToScene(const Mat& srcPC, const PointCloudIndex& scene, std::vector<Pose3DPtr>& poses);
+
 private:
   float m_tolerance;
   int m_maxIterations;
@@ -56,7 +56,8 @@ namespace ppf_match_3d
 
 /**
  *  @brief Load a PLY file
- *  @param [in] fileName The PLY model to read
+ *  @param [in] fileName The PLY model to read. ASCII, binary little endian and binary big endian
+ *  files are supported.
  *  @param [in] withNormals Flag wheather the input PLY contains normal information,
  *  and whether it should be loaded or not
  *  @return Returns the matrix on successfull load
@@ -67,8 +68,61 @@ CV_EXPORTS Mat loadPLYSimple(const char* fileName, int withNormals);
  *  @brief Write a point cloud to PLY file
  *  @param [in] PC Input point cloud
  *  @param [in] fileName The PLY model file to write
+ *  @param [in] binary Write the vertices in the binary format of the host byte order instead of ASCII.
+ *  Binary files are considerably smaller and faster to read and write.
 */
-CV_EXPORTS void writePLY(Mat PC, const char* fileName);
+CV_EXPORTS void writePLY(Mat PC, const char* fileName, bool binary=false);
+
+/**
+ *  @brief Streaming reader for the vertices of a PLY file.
+ *
+ *  The vertex element must be the first element of the file. Its properties may be of any scalar
+ *  PLY type and appear in any order; x, y, z and nx, ny, nz are picked by name and the rest is
+ *  skipped. The vertices are read in chunks into caller provided matrices, so arbitrarily large
+ *  files can be processed with a fixed amount of memory and without per vertex allocations.
+ *  @code
+ *  PLYReader reader;
+ *  if (reader.open("scan.ply"))
+ *  {
+ *    Mat chunk(65536, 6, CV_32F);
+ *    int n;
+ *    while ((n = reader.read(chunk)) > 0)
+ *      process(chunk.rowRange(0, n));
+ *  }
+ *  @endcode
+ */
+class CV_EXPORTS PLYReader
+{
+public:
+  PLYReader();
+  ~PLYReader();
+
+  /**
+   *  @brief Opens a file and parses its header
+   *  @return false if the file cannot be opened or is not a supported PLY file
+   */
+  bool open(const char* fileName);
+  void close();
+
+  int getNumVertices() const;
+  bool hasNormals() const;
+  bool isBinary() const;
+
+  /**
+   *  @brief Reads the next vertices into the rows of a preallocated matrix
+   *  @param [in,out] pc CV_32F matrix with 3 (points) or 6 (points and normals) columns. Normal
+   *  columns are set to zero if the file has no normals.
+   *  @return The number of rows filled. It is less than pc.rows only at the end of the file.
+   */
+  int read(Mat& pc);
+
+private:
+  class Impl;
+  Ptr<Impl> impl;
+
+  PLYReader(const PLYReader&);
+  PLYReader& operator=(const PLYReader&);
+};
 
 Mat samplePCUniform(Mat PC, int sampleStep);
 Mat samplePCUniformInd(Mat PC, int sampleStep, std::vector<int>& indices);
@@ -81,7 +135,8 @@ Mat samplePCUniformInd(Mat PC, int sampleStep, std::vector<int>& indices);
  *  @param [in] zrange Z components (min and max) of the bounding box of the model
  *  @param [in] sample_step_relative The point cloud is sampled such that all points
  *  have a certain minimum distance. This minimum distance is determined relatively using
- *  the parameter sample_step_relative. 
+ *  the parameter sample_step_relative. Only the occupied voxels are stored, so the memory
+ *  grows with the number of points and not with the volume of the bounding box.
  *  @param [in] weightByCenter The contribution of the quantized data points can be weighted
  *  by the distance to the origin. This parameter enables/disables the use of weighting.
  *  @return Sampled point cloud
@@ -93,6 +148,45 @@ void computeBboxStd(Mat pc, float xRange[2], float yRange[2], float zRange[2]);
 void* indexPCFlann(Mat pc);
 void destroyFlann(void* flannIndex);
 void queryPCFlann(void* flannIndex, Mat& pc, Mat& indices, Mat& distances);
+void queryPCFlann(void* flannIndex, Mat& pc, Mat& indices, Mat& distances, const int numNeighbors);
+
+/**
+ *  @brief Nearest neighbour index over the points of a point cloud. Building the index is a large
+ *  part of ICP and normal estimation, so when the same cloud is queried many times (e.g. a scene
+ *  refined against many pose hypotheses), build the index once and pass it to ICP::registerModelToScene
+ *  or computeNormalsPC3d. The index is read-only after construction and can be shared by concurrent
+ *  queries.
+ */
+class CV_EXPORTS PointCloudIndex
+{
+public:
+  /**
+   *  @param [in] pc The point cloud (Nx3 or wider). Currently, CV_32F is the only supported data
+   *  type. The matrix is referenced, not copied, and should not be modified while the index is in use.
+   */
+  explicit PointCloudIndex(const Mat& pc);
+  ~PointCloudIndex();
+
+  const Mat& getPointCloud() const { return m_pc; }
+
+  /**
+   *  @brief Finds the nearest points of every query point
+   *  @param [in] queries Query points (Nx3 or wider, CV_32F), given in the coordinate frame of the cloud
+   *  @param [out] indices N x numNeighbors CV_32S matrix of point cloud rows, allocated if needed
+   *  @param [out] distances N x numNeighbors CV_32F matrix of squared distances, allocated if needed
+   *  @param [in] numNeighbors Number of neighbours to find for every query
+   *
+   *  The queries are split into chunks and searched in parallel.
+   */
+  void knnSearch(const Mat& queries, Mat& indices, Mat& distances, int numNeighbors=1) const;
+
+private:
+  Mat m_pc;
+  void* m_flannIndex;
+
+  PointCloudIndex(const PointCloudIndex&);
+  PointCloudIndex& operator=(const PointCloudIndex&);
+};
 
 /**
  *  Mostly for visualization purposes. Normalizes the point cloud in a Hartley-Zissermann
@@ -147,6 +241,18 @@ CV_EXPORTS Mat addNoisePC(Mat pc, double scale);
  */
 CV_EXPORTS int computeNormalsPC3d(const Mat& PC, Mat& PCNormals, const int NumNeighbors, const bool FlipViewpoint, const double viewpoint[3]);
 
+/**
+ *  @brief Compute the normals of an arbitrary point cloud using a prebuilt neighbour index
+ *  @param [in] PC Input point cloud to compute the normals for.
+ *  @param [in] PCNormals Output point cloud
+ *  @param [in] NumNeighbors Number of neighbors to take into account in a local region
+ *  @param [in] FlipViewpoint Should normals be flipped to a viewing direction?
+ *  @param [in] viewpoint
+ *  @param [in] index Neighbour index built over the rows of PC. It can be reused across calls.
+ *  @return Returns 0 on success
+ */
+CV_EXPORTS int computeNormalsPC3d(const Mat& PC, Mat& PCNormals, const int NumNeighbors, const bool FlipViewpoint, const double viewpoint[3], const PointCloudIndex& index);
+
 //! @}
 
 } // namespace ppf_match_3d
@@ -73,6 +73,8 @@ namespace ppf_match_3d
 //! @addtogroup surface_matching
 //! @{
 
+class MappedModelFile;
+
 /**
   * @brief Struct, holding a node in the hashtable
   */
@@ -137,9 +139,39 @@ public:
     *  @param [out] results List of output poses
     *  @param [in] relativeSceneSampleStep The ratio of scene points to be used for the matching after sampling with relativeSceneDistance. For example, if this value is set to 1.0/5.0, every 5th point from the scene is used for pose estimation. This parameter allows an easy trade-off between speed and accuracy of the matching. Increasing the value leads to less points being used and in turn to a faster but less accurate pose computation. Decreasing the value has the inverse effect.
     *  @param [in] relativeSceneDistance Set the distance threshold relative to the diameter of the model. This parameter is equivalent to relativeSamplingStep in the training stage. This parameter acts like a prior sampling with the relativeSceneSampleStep parameter.
+    *
+    *  \details The voting over the scene reference points is distributed with cv::parallel_for_. Each worker
+    *  owns its accumulator and every reference point writes its pose to a fixed slot, so the output does not
+    *  depend on the number of threads. Use cv::setNumThreads(1) to force the serial path.
     */
   void match(const Mat& scene, std::vector<Pose3DPtr> &results, const double relativeSceneSampleStep=1.0/5.0, const double relativeSceneDistance=0.03);
 
+  /**
+    *  \brief Saves a trained model to a binary file.
+    *
+    *  @param [in] fileName The file to write
+    *
+    *  \details The file holds a versioned header followed by the sampled model points with their normals,
+    *  the point pair features and the flat hashtable, each aligned so that load() can use them in place.
+    *  The layout uses the native byte order of the machine that wrote it.
+    */
+  void save(const std::string& fileName) const;
+
+  /**
+    *  \brief Loads a model written by save().
+    *
+    *  @param [in] fileName The file to read
+    *  @param [in] checkContents Also check every hash node and its feature against the model. This
+    *  reads the whole node and feature sections, use it for files that may have been tampered with.
+    *
+    *  \details The file is memory mapped read-only and the model matrices point directly into the
+    *  mapping, so loading does not allocate or parse per entry. Several processes loading the same file
+    *  share its pages. The mapping is kept until the model is cleared, retrained or the detector is
+    *  destroyed. The header, the section shapes and the hashtable slots are always checked, and a file
+    *  that is inconsistent raises StsParseError.
+    */
+  void load(const std::string& fileName, bool checkContents=false);
+
   void read(const FileNode& fn);
   void write(FileStorage& fs) const;
 
@@ -149,8 +181,14 @@ protected:
   double sampling_step_relative, angle_step_relative, distance_step_relative;
   Mat sampled_pc, ppf;
   int num_ref_points, ppf_step;
-  hashtable_int* hash_table;
-  THash* hash_nodes;
+
+  // Flat model hashtable: hash_nodes holds the THash entries (CV_32SC3) sorted by key,
+  // so that all entries of a key are contiguous. hash_table is an open addressing
+  // table (CV_32SC3) whose slots store the key and the [begin, end) range of its entries.
+  Mat hash_nodes, hash_table;
+
+  // keeps a model file mapped while the matrices above point into it
+  Ptr<MappedModelFile> model_file;
 
   double position_threshold, rotation_threshold;
   bool use_weighted_avg;
@@ -159,14 +197,25 @@ protected:
 
   void clearTrainingModels();
 
+  /**
+    *  \brief Groups the pose hypotheses with the numPoses highest votes and averages every group.
+    *
+    *  \details A pose joins the first cluster (in the order of creation) whose center is within
+    *  position_threshold and rotation_threshold. The cluster centers are kept in a grid over the
+    *  translation and the rotation angle, so that only the neighbouring cells have to be searched.
+    */
+  void clusterPoses(std::vector<Pose3DPtr> poseList, int numPoses, std::vector<Pose3DPtr> &finalPoses);
+
 private:
+  friend class PPFVotingInvoker;
+
   void computePPFFeatures(const double p1[4], const double n1[4],
                           const double p2[4], const double n2[4],
                           double f[4]);
 
-  bool matchPose(const Pose3D& sourcePose, const Pose3D& targetPose);
+  Pose3DPtr voteReferencePoint(const Mat& sampled, int refInd, unsigned int* accumulator);
 
-  void clusterPoses(std::vector<Pose3DPtr> poseList, int numPoses, std::vector<Pose3DPtr> &finalPoses);
+  bool matchPose(const Pose3D& sourcePose, const Pose3D& targetPose);
 
   bool trained;
 };
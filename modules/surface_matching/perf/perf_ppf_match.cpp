@@ -0,0 +1,280 @@
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                          License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2014, OpenCV Foundation, all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote products
+//     derived from this software without specific prior written permission.
+//
+// This software is provided by the copyright holders and contributors "as is" and
+// any express or implied warranties, including, but not limited to, the implied
+// warranties of merchantability and fitness for a particular purpose are disclaimed.
+// In no event shall the Intel Corporation or contributors be liable for any direct,
+// indirect, incidental, special, exemplary, or consequential damages
+// (including, but not limited to, procurement of substitute goods or services;
+// loss of use, data, or profits; or business interruption) however caused
+// and on any theory of liability, whether in contract, strict liability,
+// or tort (including negligence or otherwise) arising in any way out of
+// the use of this software, even if advised of the possibility of such damage.
+
+#include "perf_precomp.hpp"
+
+using namespace cv;
+using namespace cv::ppf_match_3d;
+using namespace perf;
+
+static void expectSamePoses(const std::vector<Pose3DPtr>& expected, const std::vector<Pose3DPtr>& results)
+{
+  ASSERT_EQ(expected.size(), results.size());
+  for (size_t i=0; i<results.size(); i++)
+  {
+    EXPECT_EQ(expected[i]->numVotes, results[i]->numVotes);
+    for (int k=0; k<16; k++)
+      EXPECT_EQ(expected[i]->pose[k], results[i]->pose[k]);
+  }
+}
+
+typedef TestBaseWithParam<int> PPFMatchThreads;
+
+// The voting result must not depend on the thread count, so the serial run
+// (1 thread) and the parallel runs are directly comparable.
+PERF_TEST_P(PPFMatchThreads, match, testing::Values(1, 2, 4, 8))
+{
+  const int numThreads = GetParam();
+
+  Mat model = generateEllipsoidPC(5000);
+  Mat scene = generateEllipsoidPC(50000, 1.2f, 0.8f, 0.5f);
+
+  // 30 degrees around z, shifted away from the clutter
+  double pose[16] = { 0.866, -0.5,   0, 2.5,
+                      0.5,    0.866, 0, 0.5,
+                      0,      0,     1, 0.2,
+                      0,      0,     0, 1 };
+  vconcat(transformPCPose(model, pose), scene, scene);
+
+  PPF3DDetector detector(0.05, 0.05);
+  detector.trainModel(model);
+
+  const int oldThreads = getNumThreads();
+
+  std::vector<Pose3DPtr> expected, results;
+  setNumThreads(1);
+  detector.match(scene, expected, 1.0/10.0, 0.05);
+
+  declare.time(120);
+  setNumThreads(numThreads);
+
+  TEST_CYCLE_N(3)
+  {
+    detector.match(scene, results, 1.0/10.0, 0.05);
+  }
+
+  setNumThreads(oldThreads);
+
+  expectSamePoses(expected, results);
+  SANITY_CHECK_NOTHING();
+}
+
+static Mat generateMatchScene(const Mat& model)
+{
+  Mat scene = generateEllipsoidPC(20000, 1.2f, 0.8f, 0.5f);
+
+  double pose[16] = { 0.866, -0.5,   0, 2.5,
+                      0.5,    0.866, 0, 0.5,
+                      0,      0,     1, 0.2,
+                      0,      0,     0, 1 };
+  vconcat(transformPCPose(model, pose), scene, scene);
+  return scene;
+}
+
+typedef TestBaseWithParam<bool> PPFModelCheck;
+
+// A loaded model must match exactly like the trained one it was saved from.
+// The parameter enables the check of every hash node on load.
+PERF_TEST_P(PPFModelCheck, load, testing::Bool())
+{
+  const bool checkContents = GetParam();
+
+  Mat model = generateEllipsoidPC(5000);
+  Mat scene = generateMatchScene(model);
+
+  PPF3DDetector trained(0.05, 0.05);
+  trained.trainModel(model);
+
+  String fileName = tempfile(".ppf");
+  trained.save(fileName);
+
+  PPF3DDetector loaded;
+
+  TEST_CYCLE()
+  {
+    loaded.load(fileName, checkContents);
+  }
+
+  remove(fileName.c_str());
+
+  std::vector<Pose3DPtr> expected, results;
+  trained.match(scene, expected, 1.0/10.0, 0.05);
+  loaded.match(scene, results, 1.0/10.0, 0.05);
+
+  expectSamePoses(expected, results);
+  SANITY_CHECK_NOTHING();
+}
+
+// Copies the model file with the bytes at offset replaced by value
+template<typename T> static String tamperModel(const std::vector<char>& data, size_t offset, T value)
+{
+  std::vector<char> tampered(data);
+  memcpy(&tampered[offset], &value, sizeof(value));
+
+  String fileName = tempfile(".ppf");
+  FILE* f = fopen(fileName.c_str(), "wb");
+  fwrite(&tampered[0], 1, tampered.size(), f);
+  fclose(f);
+  return fileName;
+}
+
+TEST(PPFModelIO, loadCorrupted)
+{
+  PPF3DDetector trained(0.05, 0.05);
+  trained.trainModel(generateEllipsoidPC(1000));
+
+  String fileName = tempfile(".ppf");
+  trained.save(fileName);
+
+  std::vector<char> data;
+  FILE* f = fopen(fileName.c_str(), "rb");
+  ASSERT_TRUE(f != NULL);
+  fseek(f, 0, SEEK_END);
+  data.resize((size_t)ftell(f));
+  fseek(f, 0, SEEK_SET);
+  ASSERT_EQ(data.size(), fread(&data[0], 1, data.size(), f));
+  fclose(f);
+  remove(fileName.c_str());
+
+  // Version 1 header: magic, version, byte order and file size take 24 bytes, followed by
+  // angleStep. The section table starts at 96 with 24 bytes per section, offset first.
+  const size_t angleStepOffset = 24;
+  uint64 ppfOffset, nodesOffset;
+  memcpy(&ppfOffset, &data[96 + 1*24], sizeof(ppfOffset));
+  memcpy(&nodesOffset, &data[96 + 2*24], sizeof(nodesOffset));
+
+  // the alpha column of the feature referenced by the first hash node
+  THash node;
+  memcpy(&node, &data[(size_t)nodesOffset], sizeof(node));
+  const size_t alphaOffset = (size_t)ppfOffset + node.ppfInd + 4*sizeof(float);
+
+  PPF3DDetector loaded;
+
+  String angleFile = tamperModel(data, angleStepOffset, -1.0);
+  EXPECT_ANY_THROW(loaded.load(angleFile));
+  remove(angleFile.c_str());
+
+  String alphaFile = tamperModel(data, alphaOffset, 100.0f);
+  EXPECT_ANY_THROW(loaded.load(alphaFile, true));
+  remove(alphaFile.c_str());
+}
+
+typedef TestBaseWithParam<int> SamplePCSize;
+
+PERF_TEST_P(SamplePCSize, samplePCByQuantization, testing::Values(100000, 1000000, 10000000))
+{
+  Mat pc = generateEllipsoidPC(GetParam());
+
+  float ranges[3][2];
+  for (int c=0; c<3; c++)
+  {
+    double minVal, maxVal;
+    minMaxIdx(pc.col(c), &minVal, &maxVal);
+    ranges[c][0] = (float)minVal;
+    ranges[c][1] = (float)maxVal;
+  }
+
+  Mat sampled;
+
+  declare.time(60);
+
+  TEST_CYCLE()
+  {
+    sampled = samplePCByQuantization(pc, ranges[0], ranges[1], ranges[2], 0.002f, 0);
+  }
+
+  SANITY_CHECK_NOTHING();
+}
+
+// Exposes the pose clustering, so it can be measured without the voting
+class PPFClusteringDetector : public PPF3DDetector
+{
+public:
+  PPFClusteringDetector() : PPF3DDetector(0.05, 0.05) {}
+
+  void cluster(const std::vector<Pose3DPtr>& poses, std::vector<Pose3DPtr>& results)
+  {
+    clusterPoses(poses, (int)poses.size(), results);
+  }
+};
+
+typedef TestBaseWithParam<int> ClusterPosesSize;
+
+PERF_TEST_P(ClusterPosesSize, clusterPoses, testing::Values(10000, 100000))
+{
+  const int numPoses = GetParam();
+
+  // a few hundred dense groups of hypotheses in a unit cube, as produced by the voting
+  RNG rng(0x12345678);
+  const int numGroups = 300;
+  std::vector<Pose3DPtr> poses(numPoses);
+  for (int i=0; i<numPoses; i++)
+  {
+    RNG groupRng(i % numGroups);
+    double t[3], q[4];
+    for (int k=0; k<3; k++)
+      t[k] = groupRng.uniform(0.0, 1.0) + rng.gaussian(0.01);
+    for (int k=0; k<4; k++)
+      q[k] = groupRng.uniform(-1.0, 1.0) + rng.gaussian(0.02);
+    const double qNorm = sqrt(q[0]*q[0]+q[1]*q[1]+q[2]*q[2]+q[3]*q[3]);
+    for (int k=0; k<4; k++)
+      q[k] /= qNorm;
+
+    poses[i] = Pose3DPtr(new Pose3D(0, 0, (unsigned int)rng.uniform(1, 100)));
+    poses[i]->updatePoseQuat(q, t);
+  }
+
+  PPFClusteringDetector detector;
+  std::vector<Pose3DPtr> input(numPoses), results;
+
+  declare.time(60);
+
+  // the clustering writes the averaged poses back into its input, so every
+  // run gets a fresh copy
+  while (next())
+  {
+    for (int i=0; i<numPoses; i++)
+      input[i] = poses[i]->clone();
+
+    startTimer();
+    detector.cluster(input, results);
+    stopTimer();
+  }
+
+  SANITY_CHECK_NOTHING();
+}
@@ -0,0 +1,93 @@
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                          License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2014, OpenCV Foundation, all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote products
+//     derived from this software without specific prior written permission.
+//
+// This software is provided by the copyright holders and contributors "as is" and
+// any express or implied warranties, including, but not limited to, the implied
+// warranties of merchantability and fitness for a particular purpose are disclaimed.
+// In no event shall the Intel Corporation or contributors be liable for any direct,
+// indirect, incidental, special, exemplary, or consequential damages
+// (including, but not limited to, procurement of substitute goods or services;
+// loss of use, data, or profits; or business interruption) however caused
+// and on any theory of liability, whether in contract, strict liability,
+// or tort (including negligence or otherwise) arising in any way out of
+// the use of this software, even if advised of the possibility of such damage.
+
+#ifdef __GNUC__
+#  pragma GCC diagnostic ignored "-Wmissing-declarations"
+#  if defined __clang__ || defined __APPLE__
+#    pragma GCC diagnostic ignored "-Wmissing-prototypes"
+#    pragma GCC diagnostic ignored "-Wextra"
+#  endif
+#endif
+
+#ifndef __OPENCV_SURFACE_MATCHING_PERF_PRECOMP_HPP__
+#define __OPENCV_SURFACE_MATCHING_PERF_PRECOMP_HPP__
+
+#include "opencv2/ts.hpp"
+#include "opencv2/surface_matching.hpp"
+#include "opencv2/surface_matching/ppf_helpers.hpp"
+
+#ifdef GTEST_CREATE_SHARED_LIBRARY
+#error no modules except ts should have GTEST_CREATE_SHARED_LIBRARY defined
+#endif
+
+namespace cv
+{
+namespace ppf_match_3d
+{
+
+// Creates an ellipsoid with analytic normals. The three different axes avoid
+// the symmetries of a sphere, which would make every pose hypothesis equal.
+static inline Mat generateEllipsoidPC(int numPoints, float a=1.0f, float b=0.6f, float c=0.3f)
+{
+  RNG rng(0);
+  Mat pc(numPoints, 6, CV_32F);
+
+  for (int i=0; i<numPoints; i++)
+  {
+    const double u = rng.uniform(0.0, 2*CV_PI);
+    const double v = acos(rng.uniform(-1.0, 1.0));
+    float* row = pc.ptr<float>(i);
+
+    row[0] = (float)(a*cos(u)*sin(v));
+    row[1] = (float)(b*sin(u)*sin(v));
+    row[2] = (float)(c*cos(v));
+
+    double n[3] = {row[0]/(a*a), row[1]/(b*b), row[2]/(c*c)};
+    const double norm = sqrt(n[0]*n[0]+n[1]*n[1]+n[2]*n[2]);
+    row[3] = (float)(n[0]/norm);
+    row[4] = (float)(n[1]/norm);
+    row[5] = (float)(n[2]/norm);
+  }
+
+  return pc;
+}
+
+} // namespace ppf_match_3d
+} // namespace cv
+
+#endif
@@ -42,7 +42,9 @@
 #define __OPENCV_SURFACE_MATCHING_UTILS_HPP_
 
 #include <cmath>
+#include <cfloat>
 #include <cstdio>
+#include <algorithm>
 
 namespace cv
 {
@@ -753,6 +755,106 @@ static inline void eigenLowest33(const double C[3][3], double A[3])
   A[2] = 1.0;
 }
 
+/**
+ *  @brief Closed form solution for the eigenvector corresponding to the smallest
+ *  eigenvalue of a symmetric 3x3 matrix, in single precision. The eigenvalue is
+ *  obtained through the trigonometric solution of the characteristic polynomial and
+ *  the eigenvector as the longest cross product of two rows of C - lambda*I.
+ *  @param [in] C Upper triangle of the matrix : c00, c01, c02, c11, c12, c22
+ *  @param [out] A Unit eigenvector corresponding to the lowest eigenvalue
+ */
+static inline void eigenLowestSym33_32f(const float C[6], float A[3])
+{
+  // normalize to avoid over/underflows of the cubic terms
+  float maxAbs = 0;
+  for (int i=0; i<6; i++)
+    maxAbs = std::max(maxAbs, (float)fabs(C[i]));
+
+  if (maxAbs < FLT_MIN)
+  {
+    A[0] = 0; A[1] = 0; A[2] = 1;
+    return ;
+  }
+
+  const float s = 1.0f/maxAbs;
+  const float a00 = C[0]*s, a01 = C[1]*s, a02 = C[2]*s;
+  const float a11 = C[3]*s, a12 = C[4]*s, a22 = C[5]*s;
+
+  const float p1 = a01*a01 + a02*a02 + a12*a12;
+  const float q = (a00 + a11 + a22)*(1.0f/3.0f);
+  float lambda;
+
+  if (p1 <= 0)
+  {
+    lambda = std::min(a00, std::min(a11, a22));
+  }
+  else
+  {
+    const float b00 = a00-q, b11 = a11-q, b22 = a22-q;
+    const float p = sqrt((b00*b00 + b11*b11 + b22*b22 + 2*p1)*(1.0f/6.0f));
+    const float detB = b00*(b11*b22 - a12*a12) - a01*(a01*b22 - a12*a02) + a02*(a01*a12 - b11*a02);
+    float r = detB / (2*p*p*p);
+    r = std::min(1.0f, std::max(-1.0f, r));
+    const float phi = acos(r)*(1.0f/3.0f);
+    // the eigenvalues are q + 2p*cos(phi + 2k*pi/3), k=1 gives the smallest
+    lambda = q + 2*p*cos(phi + (float)(2.0*M_PI/3.0));
+  }
+
+  const float r0[3] = {a00-lambda, a01, a02};
+  const float r1[3] = {a01, a11-lambda, a12};
+  const float r2[3] = {a02, a12, a22-lambda};
+
+  const float c0[3] = {r0[1]*r1[2]-r0[2]*r1[1], r0[2]*r1[0]-r0[0]*r1[2], r0[0]*r1[1]-r0[1]*r1[0]};
+  const float c1[3] = {r0[1]*r2[2]-r0[2]*r2[1], r0[2]*r2[0]-r0[0]*r2[2], r0[0]*r2[1]-r0[1]*r2[0]};
+  const float c2[3] = {r1[1]*r2[2]-r1[2]*r2[1], r1[2]*r2[0]-r1[0]*r2[2], r1[0]*r2[1]-r1[1]*r2[0]};
+
+  const float d0 = c0[0]*c0[0]+c0[1]*c0[1]+c0[2]*c0[2];
+  const float d1 = c1[0]*c1[0]+c1[1]*c1[1]+c1[2]*c1[2];
+  const float d2 = c2[0]*c2[0]+c2[1]*c2[1]+c2[2]*c2[2];
+
+  const float* c = c0;
+  float d = d0;
+  if (d1 > d) { c = c1; d = d1; }
+  if (d2 > d) { c = c2; d = d2; }
+
+  if (d > EPS*EPS)
+  {
+    const float invNorm = 1.0f/sqrt(d);
+    A[0] = c[0]*invNorm;
+    A[1] = c[1]*invNorm;
+    A[2] = c[2]*invNorm;
+    return ;
+  }
+
+  // The smallest eigenvalue is repeated (points on a line): any vector orthogonal
+  // to the dominant row is an eigenvector.
+  const float n0 = r0[0]*r0[0]+r0[1]*r0[1]+r0[2]*r0[2];
+  const float n1 = r1[0]*r1[0]+r1[1]*r1[1]+r1[2]*r1[2];
+  const float n2 = r2[0]*r2[0]+r2[1]*r2[1]+r2[2]*r2[2];
+  const float* r = r0;
+  float n = n0;
+  if (n1 > n) { r = r1; n = n1; }
+  if (n2 > n) { r = r2; n = n2; }
+
+  if (n <= EPS*EPS)
+  {
+    // isotropic
+    A[0] = 0; A[1] = 0; A[2] = 1;
+    return ;
+  }
+
+  if (fabs(r[0]) > fabs(r[2]))
+  {
+    const float invNorm = 1.0f/sqrt(r[0]*r[0]+r[1]*r[1]);
+    A[0] = -r[1]*invNorm; A[1] = r[0]*invNorm; A[2] = 0;
+  }
+  else
+  {
+    const float invNorm = 1.0f/sqrt(r[1]*r[1]+r[2]*r[2]);
+    A[0] = 0; A[1] = -r[2]*invNorm; A[2] = r[1]*invNorm;
+  }
+}
+
 } // namespace ppf_match_3d
 
 } // namespace cv
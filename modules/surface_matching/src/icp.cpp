@@ -276,25 +276,21 @@ static void getTransformMat(Mat X, double Pose[16])
   Pose[15]=1;
 }
 
-/* Fast way to look up the duplicates
-duplicates is pre-allocated
-make sure that the max element in array will not exceed maxElement
-*/
-static hashtable_int* getHashtable(int* data, size_t length, int numMaxElement)
-{
-  hashtable_int* hashtable = hashtableCreate(static_cast<size_t>(numMaxElement*2), 0);
-  for (size_t i = 0; i < length; i++)
-  {
-    const KeyType key = (KeyType)data[i];
-    hashtableInsertHashed(hashtable, key+1, reinterpret_cast<void*>(i+1));
-  }
+// Two consecutive solutions closer than this are considered equal. The
+// correspondences, and hence all further iterations, are then identical.
+static const double ICP_CONVERGENCE_EPS = 1e-9;
 
-  return hashtable;
+// source point clouds are assumed to contain their normals
+int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residual, double pose[16])
+{
+  PointCloudIndex scene(dstPC);
+  return registerModelToScene(srcPC, scene, residual, pose);
 }
 
 // source point clouds are assumed to contain their normals
-int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residual, double pose[16])
+int ICP::registerModelToScene(const Mat& srcPC, const PointCloudIndex& scene, double& residual, double pose[16])
 {
+  const Mat& dstPC = scene.getPointCloud();
   int n = srcPC.rows;
 
   const bool useRobustReject = m_rejectionScale>0;
@@ -322,8 +318,15 @@ int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residu
   // initialize pose
   matrixIdentity(4, pose);
 
-  void* flann = indexPCFlann(dstPC0);
-  Mat M = Mat::eye(4,4,CV_64F);
+  // The scene index lives in the original scene frame. The queries are mapped
+  // back into it and the squared distances rescaled to the normalized frame.
+  const float invScale = (float)(1.0/scale);
+  const float sqScale = (float)(scale*scale);
+  const float offset[3] = {(float)meanAvg[0], (float)meanAvg[1], (float)meanAvg[2]};
+
+  // Picky ICP bookkeeping: the selected correspondence of every scene point.
+  // Reset after each iteration, so it is allocated once per registration.
+  std::vector<int> sceneCorr(dstPC0.rows, -1);
 
   double tempResidual = 0;
 
@@ -351,7 +354,7 @@ int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residu
     decrease the accuracy. That's why I won't be implementing it at this
     moment.
 
-    Also note that you have to compute a KD-tree for each level.
+    The KD-tree of the scene is shared by all the levels.
     */
     srcPCT = samplePCUniformInd(srcPCT, sampleStep, srcSampleInd);
 
@@ -363,12 +366,8 @@ int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residu
     int i=0;
 
     size_t numElSrc = (size_t)Src_Moved.rows;
-    int sizesResult[2] = {(int)numElSrc, 1};
-    float* distances = new float[numElSrc];
-    int* indices = new int[numElSrc];
-
-    Mat Indices(2, sizesResult, CV_32S, indices, 0);
-    Mat Distances(2, sizesResult, CV_32F, distances, 0);
+    Mat Indices, Distances;
+    Mat Queries((int)numElSrc, 3, CV_32F);
 
     // use robust weighting for outlier treatment
     int* indicesModel = new int[numElSrc];
@@ -380,12 +379,28 @@ int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residu
     double PoseX[16]={0};
     matrixIdentity(4, PoseX);
 
+    Mat XPrev;
+
     while ( (!(fval_perc<(1+TolP) && fval_perc>(1-TolP))) && i<MaxIterationsPyr)
     {
       size_t di=0, selInd = 0;
 
-      queryPCFlann(flann, Src_Moved, Indices, Distances);
+      for (int qi=0; qi<Queries.rows; qi++)
+      {
+        const float* srcPt = Src_Moved.ptr<float>(qi);
+        float* q = Queries.ptr<float>(qi);
+        q[0] = srcPt[0]*invScale + offset[0];
+        q[1] = srcPt[1]*invScale + offset[1];
+        q[2] = srcPt[2]*invScale + offset[2];
+      }
+
+      scene.knnSearch(Queries, Indices, Distances);
+      Distances *= sqScale;
+
+      const int* indices = Indices.ptr<int>();
+      float* distances = Distances.ptr<float>();
 
+      numElSrc = (size_t)Src_Moved.rows;
       for (di=0; di<numElSrc; di++)
       {
         newI[di] = (int)di;
@@ -416,41 +431,29 @@ int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residu
       // is assigned to the same model point m_j, then select p_i that corresponds
       // to the minimum distance
 
-      hashtable_int* duplicateTable = getHashtable(newJ, numElSrc, dstPC0.rows);
-
-      for (di=0; di<duplicateTable->size; di++)
+      for (di=0; di<numElSrc; di++)
       {
-        hashnode_i *node = duplicateTable->nodes[di];
+        const int dup = newJ[di];
+        const int best = sceneCorr[dup];
 
-        if (node)
+        if (best < 0)
         {
-          // select the first node
-          long idx = reinterpret_cast<long>(node->data)-1, dn=0;
-          int dup = (int)node->key-1;
-          long minIdxD = idx;
-          float minDist = distances[idx];
-
-          while ( node )
-          {
-            idx = reinterpret_cast<long>(node->data)-1;
-
-            if (distances[idx] < minDist)
-            {
-              minDist = distances[idx];
-              minIdxD = idx;
-            }
-
-            node = node->next;
-            dn++;
-          }
-
-          indicesModel[ selInd ] = newI[ minIdxD ];
-          indicesScene[ selInd ] = dup ;
+          sceneCorr[dup] = (int)di;
+          indicesScene[ selInd ] = dup;
           selInd++;
         }
+        else if (distances[newI[di]] < distances[newI[best]])
+        {
+          sceneCorr[dup] = (int)di;
+        }
       }
 
-      hashtableDestroy(duplicateTable);
+      for (di=0; di<selInd; di++)
+      {
+        const int dup = indicesScene[di];
+        indicesModel[di] = newI[ sceneCorr[dup] ];
+        sceneCorr[dup] = -1;
+      }
 
       if (selInd)
       {
@@ -491,6 +494,11 @@ int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residu
 
         if (fval < fval_min)
           fval_min = fval;
+
+        // Early out: the same solution yields the same correspondences again
+        if (!XPrev.empty() && cv::norm(X, XPrev, NORM_INF) < ICP_CONVERGENCE_EPS)
+          break;
+        XPrev = X;
       }
       else
         break;
@@ -512,8 +520,6 @@ int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residu
     delete[] newJ;
     delete[] indicesModel;
     delete[] indicesScene;
-    delete[] distances;
-    delete[] indices;
 
     tempResidual = fval_min;
   }
@@ -533,20 +539,48 @@ int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residu
 
   residual = tempResidual;
 
-  destroyFlann(flann);
   return 0;
 }
 
-// source point clouds are assumed to contain their normals
-int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, std::vector<Pose3DPtr>& poses)
+// Refines every pose hypothesis independently. Each hypothesis writes only to
+// its own Pose3D, so the results do not depend on the scheduling.
+class ICPRegistrationInvoker : public ParallelLoopBody
 {
-  for (size_t i=0; i<poses.size(); i++)
+public:
+  ICPRegistrationInvoker(ICP* icp, const Mat& srcPC, const PointCloudIndex& scene, std::vector<Pose3DPtr>& poses)
+    : m_icp(icp), m_srcPC(srcPC), m_scene(scene), m_poses(poses)
   {
-    double poseICP[16]={0};
-    Mat srcTemp = transformPCPose(srcPC, poses[i]->pose);
-    registerModelToScene(srcTemp, dstPC, poses[i]->residual, poseICP);
-    poses[i]->appendPose(poseICP);
   }
+
+  virtual void operator()(const Range& range) const
+  {
+    for (int i = range.start; i < range.end; i++)
+    {
+      double poseICP[16]={0};
+      Mat srcTemp = transformPCPose(m_srcPC, m_poses[i]->pose);
+      m_icp->registerModelToScene(srcTemp, m_scene, m_poses[i]->residual, poseICP);
+      m_poses[i]->appendPose(poseICP);
+    }
+  }
+
+private:
+  ICP* m_icp;
+  const Mat& m_srcPC;
+  const PointCloudIndex& m_scene;
+  std::vector<Pose3DPtr>& m_poses;
+};
+
+// source point clouds are assumed to contain their normals
+int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, std::vector<Pose3DPtr>& poses)
+{
+  PointCloudIndex scene(dstPC);
+  return registerModelToScene(srcPC, scene, poses);
+}
+
+// source point clouds are assumed to contain their normals
+int ICP::registerModelToScene(const Mat& srcPC, const PointCloudIndex& scene, std::vector<Pose3DPtr>& poses)
+{
+  parallel_for_(Range(0, (int)poses.size()), ICPRegistrationInvoker(this, srcPC, scene, poses));
   return 0;
 }
 
@@ -55,41 +55,397 @@ void getRandomRotation(double R[9]);
 void meanCovLocalPC(const float* pc, const int ws, const int point_count, double CovMat[3][3], double Mean[4]);
 void meanCovLocalPCInd(const float* pc, const int* Indices, const int ws, const int point_count, double CovMat[3][3], double Mean[4]);
 
-Mat loadPLYSimple(const char* fileName, int withNormals)
+enum
+{
+  PLY_INT8 = 0, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64
+};
+
+typedef struct PLYProperty
+{
+  int type;
+  size_t offset;
+  // destination column: 0..2 for x,y,z and 3..5 for nx,ny,nz, -1 if skipped
+  int column;
+} PLYProperty;
+
+static bool isHostLittleEndian()
 {
-  Mat cloud;
-  int numVertices=0;
+  const int one = 1;
+  return *(const char*)&one == 1;
+}
 
-  std::ifstream ifs(fileName);
+static bool parsePLYType(const std::string& name, int& type, size_t& size)
+{
+  static const char* names[][2] = {
+    {"char", "int8"}, {"uchar", "uint8"}, {"short", "int16"}, {"ushort", "uint16"},
+    {"int", "int32"}, {"uint", "uint32"}, {"float", "float32"}, {"double", "float64"}
+  };
+  static const size_t sizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
 
-  if (!ifs.is_open())
+  for (int t=0; t<8; t++)
   {
-    printf("Cannot open file...\n");
-    return Mat();
+    if (name == names[t][0] || name == names[t][1])
+    {
+      type = t;
+      size = sizes[t];
+      return true;
+    }
+  }
+  return false;
+}
+
+static int plyPropertyColumn(const std::string& name)
+{
+  static const char* names[] = {"x", "y", "z", "nx", "ny", "nz"};
+  for (int c=0; c<6; c++)
+  {
+    if (name == names[c])
+      return c;
   }
+  return -1;
+}
+
+static inline float readPLYScalar(const uchar* src, int type, bool swapBytes)
+{
+  uchar bytes[8];
+  static const int sizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+  const int size = sizes[type];
+
+  if (swapBytes)
+  {
+    for (int b=0; b<size; b++)
+      bytes[b] = src[size-1-b];
+  }
+  else
+  {
+    memcpy(bytes, src, size);
+  }
+
+  switch (type)
+  {
+  case PLY_INT8: return (float)*(const schar*)bytes;
+  case PLY_UINT8: return (float)*(const uchar*)bytes;
+  case PLY_INT16: return (float)*(const short*)bytes;
+  case PLY_UINT16: return (float)*(const ushort*)bytes;
+  case PLY_INT32: return (float)*(const int*)bytes;
+  case PLY_UINT32: return (float)*(const unsigned int*)bytes;
+  case PLY_FLOAT32: return *(const float*)bytes;
+  default: return (float)*(const double*)bytes;
+  }
+}
 
-  std::string str;
-  while (str.substr(0, 10) !="end_header")
+class PLYReader::Impl
+{
+public:
+  Impl() : f(0), numVertices(0), numRead(0), binary(false), swapBytes(false), stride(0), normals(false),
+           bufBegin(0), bufEnd(0)
   {
-    std::string entry = str.substr(0, 14);
-    if (entry == "element vertex")
+  }
+
+  ~Impl()
+  {
+    if (f)
+      fclose(f);
+  }
+
+  bool open(const char* fileName);
+  int readBinary(Mat& pc, int count);
+  int readAscii(Mat& pc, int count);
+
+  FILE* f;
+  int numVertices, numRead;
+  bool binary, swapBytes;
+  size_t stride;
+  bool normals;
+  std::vector<PLYProperty> properties;
+
+  // raw data of the current chunk. For ASCII files it may keep a partial line
+  // between [bufBegin, bufEnd) for the next refill.
+  std::vector<uchar> buffer;
+  size_t bufBegin, bufEnd;
+};
+
+bool PLYReader::Impl::open(const char* fileName)
+{
+  f = fopen(fileName, "rb");
+  if (!f)
+    return false;
+
+  char line[1024];
+  int lineNo = 0;
+  int numElements = 0;
+  bool inVertex = false, format = false;
+
+  while (fgets(line, sizeof(line), f))
+  {
+    std::istringstream iss(line);
+    std::string keyword;
+    iss >> keyword;
+
+    if (lineNo++ == 0)
     {
-      numVertices = atoi(str.substr(15, str.size()-15).c_str());
+      if (keyword != "ply")
+        return false;
+      continue;
+    }
+
+    if (keyword == "format")
+    {
+      std::string type;
+      iss >> type;
+      if (type == "ascii")
+        binary = false;
+      else if (type == "binary_little_endian")
+      {
+        binary = true;
+        swapBytes = !isHostLittleEndian();
+      }
+      else if (type == "binary_big_endian")
+      {
+        binary = true;
+        swapBytes = isHostLittleEndian();
+      }
+      else
+        return false;
+      format = true;
+    }
+    else if (keyword == "element")
+    {
+      std::string name;
+      iss >> name;
+      inVertex = (name == "vertex");
+      if (inVertex)
+      {
+        // the data of preceding elements would have to be skipped
+        if (numElements != 0)
+          return false;
+        iss >> numVertices;
+      }
+      numElements++;
+    }
+    else if (keyword == "property" && inVertex)
+    {
+      std::string type, name;
+      iss >> type;
+      if (type == "list")
+        return false;
+      iss >> name;
+
+      PLYProperty prop;
+      size_t size = 0;
+      if (!parsePLYType(type, prop.type, size))
+        return false;
+      prop.offset = stride;
+      prop.column = plyPropertyColumn(name);
+      stride += size;
+      normals = normals || prop.column >= 3;
+      properties.push_back(prop);
+    }
+    else if (keyword == "end_header")
+    {
+      return format && numVertices >= 0 && !properties.empty();
     }
-    std::getline(ifs, str);
   }
 
-  if (withNormals)
-    cloud=Mat(numVertices, 6, CV_32FC1);
-  else
-    cloud=Mat(numVertices, 3, CV_32FC1);
+  return false;
+}
 
-  for (int i = 0; i < numVertices; i++)
+int PLYReader::Impl::readBinary(Mat& pc, int count)
+{
+  const int cols = pc.cols;
+
+  // fast path: the file stores exactly the requested float columns in order
+  bool direct = !swapBytes && pc.isContinuous() && stride == cols*sizeof(float);
+  for (size_t p=0; p<properties.size() && direct; p++)
+    direct = properties[p].type == PLY_FLOAT32 && properties[p].column == (int)p;
+
+  if (direct)
+    return (int)fread(pc.data, stride, count, f);
+
+  const int chunkSize = 16384;
+  buffer.resize(chunkSize*stride);
+
+  int numDone = 0;
+  while (numDone < count)
   {
-    float* data = (float*)(&cloud.data[i*cloud.step[0]]);
-    if (withNormals)
+    const int numWanted = std::min(chunkSize, count - numDone);
+    const int numGot = (int)fread(&buffer[0], stride, numWanted, f);
+
+    for (int r=0; r<numGot; r++)
     {
-      ifs >> data[0] >> data[1] >> data[2] >> data[3] >> data[4] >> data[5];
+      const uchar* record = &buffer[r*stride];
+      float* row = pc.ptr<float>(numDone + r);
+
+      for (size_t p=0; p<properties.size(); p++)
+      {
+        const PLYProperty& prop = properties[p];
+        if (prop.column >= 0 && prop.column < cols)
+          row[prop.column] = readPLYScalar(record + prop.offset, prop.type, swapBytes);
+      }
+    }
+
+    numDone += numGot;
+    if (numGot < numWanted)
+      break;
+  }
+
+  return numDone;
+}
+
+int PLYReader::Impl::readAscii(Mat& pc, int count)
+{
+  const size_t chunkSize = 1 << 20;
+  const int cols = pc.cols;
+
+  if (buffer.size() < chunkSize + 1)
+    buffer.resize(chunkSize + 1);
+
+  int numDone = 0;
+  while (numDone < count)
+  {
+    // find the end of the next line, refilling the buffer if it is incomplete
+    uchar* lineBegin = &buffer[bufBegin];
+    uchar* lineEnd = (uchar*)memchr(lineBegin, '\n', bufEnd - bufBegin);
+
+    if (!lineEnd)
+    {
+      const size_t remaining = bufEnd - bufBegin;
+      if (remaining == buffer.size() - 1)
+        buffer.resize(2*buffer.size());  // very long line
+      memmove(&buffer[0], &buffer[bufBegin], remaining);
+      bufBegin = 0;
+      bufEnd = remaining;
+
+      const size_t numGot = fread(&buffer[bufEnd], 1, buffer.size() - 1 - bufEnd, f);
+      bufEnd += numGot;
+
+      lineBegin = &buffer[0];
+      lineEnd = (uchar*)memchr(lineBegin, '\n', bufEnd);
+      if (!lineEnd)
+      {
+        if (numGot)
+          continue;
+        if (!bufEnd)
+          break;
+        // last line without a newline
+        lineEnd = &buffer[bufEnd];
+      }
+    }
+
+    *lineEnd = 0;
+    bufBegin = std::min((size_t)(lineEnd - &buffer[0]) + 1, bufEnd);
+
+    char* p = (char*)lineBegin;
+    float* row = pc.ptr<float>(numDone);
+    bool valid = true;
+
+    for (size_t k=0; k<properties.size(); k++)
+    {
+      char* end = 0;
+      const double value = strtod(p, &end);
+      if (end == p)
+      {
+        valid = false;
+        break;
+      }
+      p = end;
+
+      const int column = properties[k].column;
+      if (column >= 0 && column < cols)
+        row[column] = (float)value;
+    }
+
+    // skip blank lines
+    if (valid)
+      numDone++;
+  }
+
+  return numDone;
+}
+
+PLYReader::PLYReader()
+{
+}
+
+PLYReader::~PLYReader()
+{
+}
+
+bool PLYReader::open(const char* fileName)
+{
+  impl = makePtr<Impl>();
+  if (!impl->open(fileName))
+  {
+    impl.release();
+    return false;
+  }
+  return true;
+}
+
+void PLYReader::close()
+{
+  impl.release();
+}
+
+int PLYReader::getNumVertices() const
+{
+  return impl.empty() ? 0 : impl->numVertices;
+}
+
+bool PLYReader::hasNormals() const
+{
+  return !impl.empty() && impl->normals;
+}
+
+bool PLYReader::isBinary() const
+{
+  return !impl.empty() && impl->binary;
+}
+
+int PLYReader::read(Mat& pc)
+{
+  CV_Assert(pc.type() == CV_32F && (pc.cols == 3 || pc.cols == 6));
+
+  if (impl.empty())
+    return 0;
+
+  const int count = std::min(pc.rows, impl->numVertices - impl->numRead);
+  if (count <= 0)
+    return 0;
+
+  if (pc.cols == 6 && !impl->normals)
+    pc.colRange(3, 6).setTo(Scalar::all(0));
+
+  const int numGot = impl->binary ? impl->readBinary(pc, count) : impl->readAscii(pc, count);
+  impl->numRead += numGot;
+
+  // a truncated file does not have more vertices to give
+  if (numGot < count)
+    impl->numRead = impl->numVertices;
+
+  return numGot;
+}
+
+Mat loadPLYSimple(const char* fileName, int withNormals)
+{
+  PLYReader reader;
+
+  if (!reader.open(fileName))
+  {
+    printf("Cannot open file...\n");
+    return Mat();
+  }
+
+  Mat cloud(reader.getNumVertices(), withNormals ? 6 : 3, CV_32FC1);
+  const int numRead = reader.read(cloud);
+  if (numRead < cloud.rows)
+    cloud = cloud.rowRange(0, numRead).clone();
+
+  if (withNormals)
+  {
+    for (int i = 0; i < cloud.rows; i++)
+    {
+      float* data = cloud.ptr<float>(i);
 
       // normalize to unit norm
       double norm = sqrt(data[3]*data[3] + data[4]*data[4] + data[5]*data[5]);
@@ -100,19 +456,15 @@ Mat loadPLYSimple(const char* fileName, int withNormals)
         data[5]/=(float)norm;
       }
     }
-    else
-    {
-      ifs >> data[0] >> data[1] >> data[2];
-    }
   }
 
   //cloud *= 5.0f;
   return cloud;
 }
 
-void writePLY(Mat PC, const char* FileName)
+void writePLY(Mat PC, const char* FileName, bool binary)
 {
-  std::ofstream outFile( FileName );
+  std::ofstream outFile( FileName, binary ? std::ios::out | std::ios::binary : std::ios::out );
 
   if ( !outFile )
   {
@@ -129,7 +481,10 @@ void writePLY(Mat PC, const char* FileName)
   const int vertNum  = ( int ) PC.cols;
 
   outFile << "ply" << std::endl;
-  outFile << "format ascii 1.0" << std::endl;
+  if (binary)
+    outFile << (isHostLittleEndian() ? "format binary_little_endian 1.0" : "format binary_big_endian 1.0") << std::endl;
+  else
+    outFile << "format ascii 1.0" << std::endl;
   outFile << "element vertex " << pointNum << std::endl;
   outFile << "property float x" << std::endl;
   outFile << "property float y" << std::endl;
@@ -146,6 +501,22 @@ void writePLY(Mat PC, const char* FileName)
   // Points
   ////
 
+  if (binary)
+  {
+    const int numFloats = (vertNum==6) ? 6 : 3;
+
+    if (PC.isContinuous() && vertNum == numFloats)
+    {
+      outFile.write((const char*)PC.data, (std::streamsize)pointNum*numFloats*sizeof(float));
+    }
+    else
+    {
+      for ( int pi = 0; pi < pointNum; ++pi )
+        outFile.write((const char*)PC.ptr<float>(pi), numFloats*sizeof(float));
+    }
+    return;
+  }
+
   for ( int pi = 0; pi < pointNum; ++pi )
   {
     const float* point = (float*)(&PC.data[ pi*PC.step ]);
@@ -207,81 +578,160 @@ void destroyFlann(void* flannIndex)
 
 // For speed purposes this function assumes that PC, Indices and Distances are created with continuous structures
 void queryPCFlann(void* flannIndex, Mat& pc, Mat& indices, Mat& distances)
+{
+  queryPCFlann(flannIndex, pc, indices, distances, 1);
+}
+
+void queryPCFlann(void* flannIndex, Mat& pc, Mat& indices, Mat& distances, const int numNeighbors)
 {
   Mat obj_32f;
   pc.colRange(0,3).copyTo(obj_32f);
-  ((FlannIndex*)flannIndex)->knnSearch(obj_32f, indices, distances, 1, cvflann::SearchParams(32) );
+  ((FlannIndex*)flannIndex)->knnSearch(obj_32f, indices, distances, numNeighbors, cvflann::SearchParams(32) );
 }
 
-// uses a volume instead of an octree
-// TODO: Right now normals are required.
-// This is much faster than sample_pc_octree
-Mat samplePCByQuantization(Mat pc, float xrange[2], float yrange[2], float zrange[2], float sampleStep, int weightByCenter)
+class PCQueryInvoker : public ParallelLoopBody
 {
-  std::vector< std::vector<int> > map;
+public:
+  PCQueryInvoker(void* flannIndex, const Mat& queries, Mat& indices, Mat& distances, int numNeighbors)
+    : m_flannIndex(flannIndex), m_queries(queries), m_indices(indices), m_distances(distances),
+      m_numNeighbors(numNeighbors)
+  {
+  }
 
-  int numSamplesDim = (int)(1.0/sampleStep);
+  virtual void operator()(const Range& range) const
+  {
+    Mat queries = m_queries.rowRange(range);
+    Mat indices = m_indices.rowRange(range);
+    Mat distances = m_distances.rowRange(range);
+    queryPCFlann(m_flannIndex, queries, indices, distances, m_numNeighbors);
+  }
 
-  float xr = xrange[1] - xrange[0];
-  float yr = yrange[1] - yrange[0];
-  float zr = zrange[1] - zrange[0];
+private:
+  void* m_flannIndex;
+  const Mat& m_queries;
+  Mat& m_indices;
+  Mat& m_distances;
+  int m_numNeighbors;
+};
 
-  int numPoints = 0;
+PointCloudIndex::PointCloudIndex(const Mat& pc)
+{
+  CV_Assert(pc.type() == CV_32F || pc.type() == CV_32FC1);
 
-  map.resize((numSamplesDim+1)*(numSamplesDim+1)*(numSamplesDim+1));
+  m_pc = pc;
+  m_flannIndex = indexPCFlann(pc);
+}
 
-  // OpenMP might seem like a good idea, but it didn't speed this up for me
-  //#pragma omp parallel for
-  for (int i=0; i<pc.rows; i++)
-  {
-    const float* point = (float*)(&pc.data[i * pc.step]);
+PointCloudIndex::~PointCloudIndex()
+{
+  destroyFlann(m_flannIndex);
+}
 
-    // quantize a point
-    const int xCell =(int) ((float)numSamplesDim*(point[0]-xrange[0])/xr);
-    const int yCell =(int) ((float)numSamplesDim*(point[1]-yrange[0])/yr);
-    const int zCell =(int) ((float)numSamplesDim*(point[2]-zrange[0])/zr);
-    const int index = xCell*numSamplesDim*numSamplesDim+yCell*numSamplesDim+zCell;
+void PointCloudIndex::knnSearch(const Mat& queries, Mat& indices, Mat& distances, int numNeighbors) const
+{
+  CV_Assert(numNeighbors > 0);
 
-    /*#pragma omp critical
-        {*/
-    map[index].push_back(i);
-    //  }
+  const int numQueries = queries.rows;
+  indices.create(numQueries, numNeighbors, CV_32S);
+  distances.create(numQueries, numNeighbors, CV_32F);
+
+  if (!numQueries)
+    return;
+
+  // small stripes only pay off for large query sets
+  const double numStripes = std::max(1.0, numQueries/1024.0);
+  parallel_for_(Range(0, numQueries), PCQueryInvoker(m_flannIndex, queries, indices, distances, numNeighbors), numStripes);
+}
+
+// Quantizes the points of a range of rows into their voxel keys. The key is
+// the linear index of the former dense volume, so sorting by it reproduces
+// the output order of the dense implementation.
+class QuantizePCInvoker : public ParallelLoopBody
+{
+public:
+  QuantizePCInvoker(const Mat& pc, const float xrange[2], const float yrange[2], const float zrange[2],
+                    int numSamplesDim, std::vector<int64>& keys)
+    : pc_(pc), numSamplesDim_(numSamplesDim), keys_(&keys)
+  {
+    xmin_ = xrange[0]; ymin_ = yrange[0]; zmin_ = zrange[0];
+    xr_ = xrange[1] - xrange[0];
+    yr_ = yrange[1] - yrange[0];
+    zr_ = zrange[1] - zrange[0];
   }
 
-  for (unsigned int i=0; i<map.size(); i++)
+  virtual void operator()(const Range& range) const
   {
-    numPoints += (map[i].size()>0);
+    const int64 dim = numSamplesDim_;
+
+    for (int i=range.start; i<range.end; i++)
+    {
+      const float* point = (float*)(&pc_.data[i * pc_.step]);
+
+      // quantize a point
+      const int xCell =(int) ((float)numSamplesDim_*(point[0]-xmin_)/xr_);
+      const int yCell =(int) ((float)numSamplesDim_*(point[1]-ymin_)/yr_);
+      const int zCell =(int) ((float)numSamplesDim_*(point[2]-zmin_)/zr_);
+
+      (*keys_)[i] = xCell*dim*dim + yCell*dim + zCell;
+    }
   }
 
-  Mat pcSampled = Mat(numPoints, pc.cols, CV_32F);
-  int c = 0;
+private:
+  const Mat& pc_;
+  int numSamplesDim_;
+  float xmin_, ymin_, zmin_, xr_, yr_, zr_;
+  std::vector<int64>* keys_;
+};
+
+// Averages the points of every occupied voxel. The points of voxel c are
+// cellPoints[cellStart[c]..cellStart[c+1]) in their original order, so the
+// sums are accumulated exactly as in the serial loop.
+class AveragePCCellsInvoker : public ParallelLoopBody
+{
+public:
+  AveragePCCellsInvoker(const Mat& pc, const float xrange[2], const float yrange[2], const float zrange[2],
+                        int numSamplesDim, int weightByCenter, const std::vector<int64>& cellKeys,
+                        const std::vector<int>& cellStart, const std::vector<int>& cellPoints,
+                        const std::vector<int>& cellRank, Mat& pcSampled)
+    : pc_(pc), numSamplesDim_(numSamplesDim), weightByCenter_(weightByCenter), cellKeys_(cellKeys),
+      cellStart_(cellStart), cellPoints_(cellPoints), cellRank_(cellRank), pcSampled_(pcSampled)
+  {
+    xmin_ = xrange[0]; ymin_ = yrange[0]; zmin_ = zrange[0];
+    xr_ = xrange[1] - xrange[0];
+    yr_ = yrange[1] - yrange[0];
+    zr_ = zrange[1] - zrange[0];
+  }
 
-  for (unsigned int i=0; i<map.size(); i++)
+  virtual void operator()(const Range& range) const
   {
-    double px=0, py=0, pz=0;
-    double nx=0, ny=0, nz=0;
+    const int64 numSamplesDim = numSamplesDim_;
 
-    std::vector<int> curCell = map[i];
-    int cn = (int)curCell.size();
-    if (cn>0)
+    for (int cell=range.start; cell<range.end; cell++)
     {
-      if (weightByCenter)
+      double px=0, py=0, pz=0;
+      double nx=0, ny=0, nz=0;
+
+      const int* curCell = &cellPoints_[cellStart_[cell]];
+      const int cn = cellStart_[cell+1] - cellStart_[cell];
+
+      if (weightByCenter_)
       {
-        int xCell, yCell, zCell;
+        const int64 key = cellKeys_[cell];
+        int64 xCell, yCell, zCell;
         double xc, yc, zc;
         double weightSum = 0 ;
-        zCell = i % numSamplesDim;
-        yCell = ((i-zCell)/numSamplesDim) % numSamplesDim;
-        xCell = ((i-zCell-yCell*numSamplesDim)/(numSamplesDim*numSamplesDim));
+        zCell = key % numSamplesDim;
+        yCell = ((key-zCell)/numSamplesDim) % numSamplesDim;
+        xCell = ((key-zCell-yCell*numSamplesDim)/(numSamplesDim*numSamplesDim));
 
-        xc = ((double)xCell+0.5) * (double)xr/numSamplesDim + (double)xrange[0];
-        yc = ((double)yCell+0.5) * (double)yr/numSamplesDim + (double)yrange[0];
-        zc = ((double)zCell+0.5) * (double)zr/numSamplesDim + (double)zrange[0];
+        xc = ((double)xCell+0.5) * (double)xr_/numSamplesDim + (double)xmin_;
+        yc = ((double)yCell+0.5) * (double)yr_/numSamplesDim + (double)ymin_;
+        zc = ((double)zCell+0.5) * (double)zr_/numSamplesDim + (double)zmin_;
 
         for (int j=0; j<cn; j++)
         {
           const int ptInd = curCell[j];
-          float* point = (float*)(&pc.data[ptInd * pc.step]);
+          float* point = (float*)(&pc_.data[ptInd * pc_.step]);
           const double dx = point[0]-xc;
           const double dy = point[1]-yc;
           const double dz = point[2]-zc;
@@ -319,7 +769,7 @@ Mat samplePCByQuantization(Mat pc, float xrange[2], float yrange[2], float zrang
         for (int j=0; j<cn; j++)
         {
           const int ptInd = curCell[j];
-          float* point = (float*)(&pc.data[ptInd * pc.step]);
+          float* point = (float*)(&pc_.data[ptInd * pc_.step]);
 
           px += (double)point[0];
           py += (double)point[1];
@@ -335,10 +785,9 @@ Mat samplePCByQuantization(Mat pc, float xrange[2], float yrange[2], float zrang
         nx/=(double)cn;
         ny/=(double)cn;
         nz/=(double)cn;
-
       }
 
-      float *pcData = (float*)(&pcSampled.data[c*pcSampled.step[0]]);
+      float *pcData = (float*)(&pcSampled_.data[cellRank_[cell]*pcSampled_.step[0]]);
       pcData[0]=(float)px;
       pcData[1]=(float)py;
       pcData[2]=(float)pz;
@@ -352,14 +801,104 @@ Mat samplePCByQuantization(Mat pc, float xrange[2], float yrange[2], float zrang
         pcData[4]=(float)(ny/norm);
         pcData[5]=(float)(nz/norm);
       }
-      //#pragma omp atomic
-      c++;
+    }
+  }
+
+private:
+  const Mat& pc_;
+  int numSamplesDim_, weightByCenter_;
+  float xmin_, ymin_, zmin_, xr_, yr_, zr_;
+  const std::vector<int64>& cellKeys_;
+  const std::vector<int>& cellStart_;
+  const std::vector<int>& cellPoints_;
+  const std::vector<int>& cellRank_;
+  Mat& pcSampled_;
+};
+
+static inline size_t hashVoxelKey(int64 key)
+{
+  uint64 h = (uint64)key * CV_BIG_UINT(0x9E3779B97F4A7C15);
+  return (size_t)(h ^ (h >> 29));
+}
+
+static bool voxelKeyCompare(const std::pair<int64, int>& a, const std::pair<int64, int>& b)
+{
+  return a.first < b.first;
+}
+
+// Sparse voxel grid: only the occupied voxels are stored, in a hash table
+// keyed by the voxel index, so the memory is O(points) whatever the step.
+// TODO: Right now normals are required.
+Mat samplePCByQuantization(Mat pc, float xrange[2], float yrange[2], float zrange[2], float sampleStep, int weightByCenter)
+{
+  const int numSamplesDim = (int)(1.0/sampleStep);
+  const int numPoints = pc.rows;
+
+  // 1. voxel key of every point
+  std::vector<int64> keys(numPoints);
+  parallel_for_(Range(0, numPoints), QuantizePCInvoker(pc, xrange, yrange, zrange, numSamplesDim, keys),
+                std::max(1.0, numPoints/65536.0));
+
+  // 2. assign a cell id to every key in order of appearance (open addressing)
+  const size_t numSlots = (size_t)next_power_of_two((unsigned int)std::max(2*numPoints, 16));
+  const size_t mask = numSlots - 1;
+  std::vector<int> slots(numSlots, -1);
+  std::vector<int64> cellKeys;
+  std::vector<int> cellOfPoint(numPoints);
+  std::vector<int> cellStart(1, 0);
+
+  for (int i=0; i<numPoints; i++)
+  {
+    const int64 key = keys[i];
+    size_t slot = hashVoxelKey(key) & mask;
+
+    while (slots[slot] >= 0 && cellKeys[slots[slot]] != key)
+      slot = (slot + 1) & mask;
 
-      curCell.clear();
+    if (slots[slot] < 0)
+    {
+      slots[slot] = (int)cellKeys.size();
+      cellKeys.push_back(key);
+      cellStart.push_back(0);
     }
+
+    cellOfPoint[i] = slots[slot];
+    cellStart[slots[slot]+1]++;
+  }
+
+  std::vector<int>().swap(slots);
+  std::vector<int64>().swap(keys);
+
+  const int numCells = (int)cellKeys.size();
+
+  // 3. group the point indices by cell, keeping their order (counting sort)
+  for (int c=0; c<numCells; c++)
+    cellStart[c+1] += cellStart[c];
+
+  std::vector<int> cellPoints(numPoints);
+  {
+    std::vector<int> fill(cellStart.begin(), cellStart.end()-1);
+    for (int i=0; i<numPoints; i++)
+      cellPoints[fill[cellOfPoint[i]]++] = i;
   }
 
-  map.clear();
+  // 4. output the cells in the order of their key, as the dense volume did
+  std::vector< std::pair<int64, int> > order(numCells);
+  for (int c=0; c<numCells; c++)
+    order[c] = std::make_pair(cellKeys[c], c);
+  std::sort(order.begin(), order.end(), voxelKeyCompare);
+
+  std::vector<int> cellRank(numCells);
+  for (int r=0; r<numCells; r++)
+    cellRank[order[r].second] = r;
+
+  Mat pcSampled = Mat(numCells, pc.cols, CV_32F);
+
+  parallel_for_(Range(0, numCells),
+                AveragePCCellsInvoker(pc, xrange, yrange, zrange, numSamplesDim, weightByCenter,
+                                      cellKeys, cellStart, cellPoints, cellRank, pcSampled),
+                std::max(1.0, numCells/4096.0));
+
   return pcSampled;
 }
 
@@ -655,77 +1194,117 @@ void meanCovLocalPCInd(const float* pc, const int* Indices, const int ws, const
 
 }
 
-CV_EXPORTS int computeNormalsPC3d(const Mat& PC, Mat& PCNormals, const int NumNeighbors, const bool FlipViewpoint, const double viewpoint[3])
+// Fits a plane to the neighbourhood of every point. The covariance is
+// accumulated around the local mean in single precision, which keeps the
+// loops vectorizable without losing accuracy for clouds far from the origin.
+class NormalsPCInvoker : public ParallelLoopBody
 {
-  int i;
-
-  if (PC.cols!=3 && PC.cols!=6) // 3d data is expected
+public:
+  NormalsPCInvoker(const float* points, const Mat& indices, const bool flipViewpoint, const double viewpoint[3], Mat& pcNormals)
+    : m_points(points), m_indices(indices), m_flipViewpoint(flipViewpoint), m_pcNormals(pcNormals)
   {
-    //return -1;
-    CV_Error(cv::Error::BadImageSize, "PC should have 3 or 6 elements in its columns");
+    m_viewpoint[0] = (float)viewpoint[0];
+    m_viewpoint[1] = (float)viewpoint[1];
+    m_viewpoint[2] = (float)viewpoint[2];
   }
 
-  int sizes[2] = {PC.rows, 3};
-  int sizesResult[2] = {PC.rows, NumNeighbors};
-  float* dataset = new float[PC.rows*3];
-  float* distances = new float[PC.rows*NumNeighbors];
-  int* indices = new int[PC.rows*NumNeighbors];
-
-  for (i=0; i<PC.rows; i++)
+  virtual void operator()(const Range& range) const
   {
-    const float* src = (float*)(&PC.data[i*PC.step]);
-    float* dst = (float*)(&dataset[i*3]);
+    const int numNeighbors = m_indices.cols;
+    const float invNum = 1.0f/(float)numNeighbors;
 
-    dst[0] = src[0];
-    dst[1] = src[1];
-    dst[2] = src[2];
-  }
+    for (int i=range.start; i<range.end; i++)
+    {
+      const int* indLocal = m_indices.ptr<int>(i);
+      const float* pci = &m_points[i*3];
+      float* pcr = m_pcNormals.ptr<float>(i);
+
+      float mx=0, my=0, mz=0;
+      for (int k=0; k<numNeighbors; k++)
+      {
+        const float* p = &m_points[indLocal[k]*3];
+        mx += p[0];
+        my += p[1];
+        mz += p[2];
+      }
+      mx*=invNum;
+      my*=invNum;
+      mz*=invNum;
 
-  Mat PCInput(2, sizes, CV_32F, dataset, 0);
+      float C[6]={0};
+      for (int k=0; k<numNeighbors; k++)
+      {
+        const float* p = &m_points[indLocal[k]*3];
+        const float dx = p[0]-mx, dy = p[1]-my, dz = p[2]-mz;
+        C[0] += dx*dx;
+        C[1] += dx*dy;
+        C[2] += dx*dz;
+        C[3] += dy*dy;
+        C[4] += dy*dz;
+        C[5] += dz*dz;
+      }
 
-  void* flannIndex = indexPCFlann(PCInput);
+      // eigenvector of the covariance matrix, corresponding to the smallest eigenvalue
+      float nr[3];
+      eigenLowestSym33_32f(C, nr);
 
-  Mat Indices(2, sizesResult, CV_32S, indices, 0);
-  Mat Distances(2, sizesResult, CV_32F, distances, 0);
+      if (m_flipViewpoint)
+      {
+        flipNormalViewpoint_32f(pci, m_viewpoint[0], m_viewpoint[1], m_viewpoint[2], &nr[0], &nr[1], &nr[2]);
+      }
 
-  queryPCFlann(flannIndex, PCInput, Indices, Distances);
-  destroyFlann(flannIndex);
-  flannIndex = 0;
+      pcr[0] = pci[0];
+      pcr[1] = pci[1];
+      pcr[2] = pci[2];
+      pcr[3] = nr[0];
+      pcr[4] = nr[1];
+      pcr[5] = nr[2];
+    }
+  }
 
-  PCNormals = Mat(PC.rows, 6, CV_32F);
+private:
+  const float* m_points;
+  const Mat& m_indices;
+  bool m_flipViewpoint;
+  float m_viewpoint[3];
+  Mat& m_pcNormals;
+};
 
-  for (i=0; i<PC.rows; i++)
+CV_EXPORTS int computeNormalsPC3d(const Mat& PC, Mat& PCNormals, const int NumNeighbors, const bool FlipViewpoint, const double viewpoint[3])
+{
+  if (PC.cols!=3 && PC.cols!=6) // 3d data is expected
   {
-    double C[3][3], mu[4];
-    const float* pci = &dataset[i*3];
-    float* pcr = (float*)(&PCNormals.data[i*PCNormals.step]);
-    double nr[3];
+    //return -1;
+    CV_Error(cv::Error::BadImageSize, "PC should have 3 or 6 elements in its columns");
+  }
 
-    int* indLocal = &indices[i*NumNeighbors];
+  PointCloudIndex index(PC);
+  return computeNormalsPC3d(PC, PCNormals, NumNeighbors, FlipViewpoint, viewpoint, index);
+}
 
-    // compute covariance matrix
-    meanCovLocalPCInd(dataset, indLocal, 3, NumNeighbors, C, mu);
+CV_EXPORTS int computeNormalsPC3d(const Mat& PC, Mat& PCNormals, const int NumNeighbors, const bool FlipViewpoint, const double viewpoint[3], const PointCloudIndex& index)
+{
+  if (PC.cols!=3 && PC.cols!=6) // 3d data is expected
+  {
+    //return -1;
+    CV_Error(cv::Error::BadImageSize, "PC should have 3 or 6 elements in its columns");
+  }
 
-    // eigenvectors of covariance matrix
-    eigenLowest33(C, nr);
+  CV_Assert(index.getPointCloud().rows == PC.rows);
+  CV_Assert(NumNeighbors > 0 && NumNeighbors <= PC.rows);
 
-    pcr[0] = pci[0];
-    pcr[1] = pci[1];
-    pcr[2] = pci[2];
+  // contiguous copy of the points: it is what the neighbour loops read, and
+  // it keeps PCNormals independent of PC in case they share their data
+  Mat points;
+  PC.colRange(0, 3).copyTo(points);
 
-    if (FlipViewpoint)
-    {
-      flipNormalViewpoint(pci, viewpoint[0], viewpoint[1], viewpoint[2], &nr[0], &nr[1], &nr[2]);
-    }
+  Mat Indices, Distances;
+  index.knnSearch(points, Indices, Distances, NumNeighbors);
 
-    pcr[3] = (float)nr[0];
-    pcr[4] = (float)nr[1];
-    pcr[5] = (float)nr[2];
-  }
+  PCNormals.create(PC.rows, 6, CV_32F);
 
-  delete[] indices;
-  delete[] distances;
-  delete[] dataset;
+  parallel_for_(Range(0, PC.rows), NormalsPCInvoker(points.ptr<float>(), Indices, FlipViewpoint, viewpoint, PCNormals),
+                std::max(1.0, PC.rows/4096.0));
 
   return 1;
 }
@@ -88,6 +88,85 @@ static KeyType hashPPF(const double f[4], const double AngleStep, const double D
   return hashKey;
 }
 
+// open addressing slot of the flat model hashtable
+typedef struct THashSlot
+{
+  int key;
+  int begin, end;
+} THashSlot;
+
+static bool hashNodeCompare(const THash& a, const THash& b)
+{
+  return ( (KeyType)a.id < (KeyType)b.id );
+}
+
+// Groups the nodes by key and indexes every group in an open addressing table.
+// The keys are already murmur hashes, so the low bits directly give the slot.
+static void buildFlatHashtable(std::vector<THash>& nodes, Mat& hashNodes, Mat& hashTable)
+{
+  // stable, so that the order inside a bucket follows the training loop
+  std::stable_sort(nodes.begin(), nodes.end(), hashNodeCompare);
+
+  const int numNodes = (int)nodes.size();
+  int numKeys = 0;
+  for (int k=0; k<numNodes; k++)
+  {
+    if (k==0 || nodes[k].id != nodes[k-1].id)
+      numKeys++;
+  }
+
+  const unsigned int numSlots = next_power_of_two((unsigned int)std::max(2*numKeys, 16));
+  const unsigned int mask = numSlots - 1;
+
+  hashNodes.create(std::max(numNodes, 1), 1, CV_32SC3);
+  hashTable.create((int)numSlots, 1, CV_32SC3);
+  hashTable.setTo(Scalar::all(0));
+
+  if (numNodes)
+    memcpy(hashNodes.data, &nodes[0], numNodes*sizeof(THash));
+
+  THashSlot* slots = hashTable.ptr<THashSlot>();
+  int begin = 0;
+  while (begin < numNodes)
+  {
+    const KeyType key = (KeyType)nodes[begin].id;
+    int end = begin+1;
+    while (end < numNodes && (KeyType)nodes[end].id == key)
+      end++;
+
+    unsigned int slot = key & mask;
+    while (slots[slot].end != slots[slot].begin)
+      slot = (slot + 1) & mask;
+
+    slots[slot].key = (int)key;
+    slots[slot].begin = begin;
+    slots[slot].end = end;
+
+    begin = end;
+  }
+}
+
+// Returns the contiguous nodes sharing the given key. Empty slots have begin == end.
+static inline const THash* getBucketFlat(const Mat& hashTable, const Mat& hashNodes, KeyType key, int& numNodes)
+{
+  const THashSlot* slots = hashTable.ptr<THashSlot>();
+  const unsigned int mask = (unsigned int)hashTable.rows - 1;
+  unsigned int slot = key & mask;
+
+  while (slots[slot].end != slots[slot].begin)
+  {
+    if ((KeyType)slots[slot].key == key)
+    {
+      numNodes = slots[slot].end - slots[slot].begin;
+      return hashNodes.ptr<THash>() + slots[slot].begin;
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  numNodes = 0;
+  return 0;
+}
+
 /*static size_t hashMurmur(unsigned int key)
 {
   size_t hashKey=0;
@@ -209,17 +288,12 @@ void PPF3DDetector::computePPFFeatures(const double p1[4], const double n1[4],
 
 void PPF3DDetector::clearTrainingModels()
 {
-  if (this->hash_nodes)
-  {
-    free(this->hash_nodes);
-    this->hash_nodes=0;
-  }
-
-  if (this->hash_table)
-  {
-    hashtableDestroy(this->hash_table);
-    this->hash_table=0;
-  }
+  hash_nodes.release();
+  hash_table.release();
+  ppf.release();
+  sampled_pc.release();
+  model_file.release();
+  trained = false;
 }
 
 PPF3DDetector::~PPF3DDetector()
@@ -232,6 +306,9 @@ void PPF3DDetector::trainModel(const Mat &PC)
 {
   CV_Assert(PC.type() == CV_32F || PC.type() == CV_32FC1);
 
+  // drop a previous (possibly memory mapped) model before allocating the new one
+  clearTrainingModels();
+
   // compute bbox
   float xRange[2], yRange[2], zRange[2];
   computeBboxStd(PC, xRange, yRange, zRange);
@@ -246,10 +323,6 @@ void PPF3DDetector::trainModel(const Mat &PC)
 
   Mat sampled = samplePCByQuantization(PC, xRange, yRange, zRange, (float)sampling_step_relative,0);
 
-  int size = sampled.rows*sampled.rows;
-
-  hashtable_int* hashTable = hashtableCreate(size, NULL);
-
   int numPPF = sampled.rows*sampled.rows;
   ppf = Mat(numPPF, PPF_LENGTH, CV_32FC1);
   int ppfStep = (int)ppf.step;
@@ -258,14 +331,10 @@ void PPF3DDetector::trainModel(const Mat &PC)
   // TODO: Maybe I could sample 1/5th of them here. Check the performance later.
   int numRefPoints = sampled.rows;
 
-  // pre-allocate the hash nodes
-  hash_nodes = (THash*)calloc(numRefPoints*numRefPoints, sizeof(THash));
+  // pre-allocate the hash nodes, they are grouped by key once all of them are known
+  std::vector<THash> nodes;
+  nodes.reserve(numRefPoints*numRefPoints);
 
-  // TODO : This can easily be parallelized. But we have to lock hashtable_insert.
-  // I realized that performance drops when this loop is parallelized (unordered
-  // inserts into the hashtable
-  // But it is still there to be investigated. For now, I leave this unparallelized
-  // since this is just a training part.
   for (int i=0; i<numRefPoints; i++)
   {
     float* f1 = (float*)(&sampled.data[i * sampledStep]);
@@ -289,12 +358,11 @@ void PPF3DDetector::trainModel(const Mat &PC)
         unsigned int corrInd = i*numRefPoints+j;
         unsigned int ppfInd = corrInd*ppfStep;
 
-        THash* hashNode = &hash_nodes[i*numRefPoints+j];
-        hashNode->id = hashValue;
-        hashNode->i = i;
-        hashNode->ppfInd = ppfInd;
-
-        hashtableInsertHashed(hashTable, hashValue, (void*)hashNode);
+        THash hashNode;
+        hashNode.id = (int)hashValue;
+        hashNode.i = i;
+        hashNode.ppfInd = ppfInd;
+        nodes.push_back(hashNode);
 
         float* ppfRow = (float*)(&(ppf.data[ ppfInd ]));
         ppfRow[0] = (float)f[0];
@@ -306,9 +374,10 @@ void PPF3DDetector::trainModel(const Mat &PC)
     }
   }
 
+  buildFlatHashtable(nodes, hash_nodes, hash_table);
+
   angle_step = angle_step_radians;
   distance_step = distanceStep;
-  hash_table = hashTable;
   ppf_step = ppfStep;
   num_ref_points = numRefPoints;
   sampled_pc = sampled;
@@ -331,6 +400,92 @@ bool PPF3DDetector::matchPose(const Pose3D& sourcePose, const Pose3D& targetPose
   return (phi<this->rotation_threshold && dNorm < this->position_threshold);
 }
 
+static bool poseCellCompare(const Vec4i& a, const Vec4i& b)
+{
+  for (int k=0; k<4; k++)
+  {
+    if (a[k] != b[k])
+      return a[k] < b[k];
+  }
+  return false;
+}
+
+// NaN poses never match any other pose. They share a cell that is not adjacent
+// to any finite one, so they end up in clusters of their own.
+static const int POSE_CELL_NAN = 2000000000;
+
+static inline int poseCellCoord(double value, double cellSize)
+{
+  // keep far away outliers representable, the neighbour offsets must not overflow
+  const double c = floor(value / cellSize);
+  if (c != c)
+    return POSE_CELL_NAN;
+  return (int)std::min(std::max(c, -1e9), 1e9);
+}
+
+// Quantizes the translation and the rotation angle of the poses. Cells are as
+// large as the thresholds, so matching cluster centers are at most one cell away.
+class PoseCellInvoker : public ParallelLoopBody
+{
+public:
+  PoseCellInvoker(const std::vector<Pose3DPtr>& poses, double positionThreshold, double rotationThreshold, std::vector<Vec4i>& cells)
+    : poses_(poses), positionThreshold_(positionThreshold), rotationThreshold_(rotationThreshold), cells_(&cells)
+  {
+  }
+
+  virtual void operator()(const Range& range) const
+  {
+    for (int i=range.start; i<range.end; i++)
+    {
+      const Pose3D& pose = *poses_[i];
+      (*cells_)[i] = Vec4i(poseCellCoord(pose.t[0], positionThreshold_),
+                           poseCellCoord(pose.t[1], positionThreshold_),
+                           poseCellCoord(pose.t[2], positionThreshold_),
+                           poseCellCoord(pose.angle, rotationThreshold_));
+    }
+  }
+
+private:
+  const std::vector<Pose3DPtr>& poses_;
+  double positionThreshold_, rotationThreshold_;
+  std::vector<Vec4i>* cells_;
+};
+
+// Collects, for every occupied cell, the occupied cells of its 3x3x3x3 neighbourhood
+class PoseCellNeighborsInvoker : public ParallelLoopBody
+{
+public:
+  PoseCellNeighborsInvoker(const std::vector<Vec4i>& uniqueCells, std::vector< std::vector<int> >& neighbors)
+    : uniqueCells_(uniqueCells), neighbors_(&neighbors)
+  {
+  }
+
+  virtual void operator()(const Range& range) const
+  {
+    for (int c=range.start; c<range.end; c++)
+    {
+      const Vec4i& cell = uniqueCells_[c];
+      std::vector<int>& neighbors = (*neighbors_)[c];
+
+      for (int dx=-1; dx<=1; dx++)
+        for (int dy=-1; dy<=1; dy++)
+          for (int dz=-1; dz<=1; dz++)
+            for (int da=-1; da<=1; da++)
+            {
+              const Vec4i query(cell[0]+dx, cell[1]+dy, cell[2]+dz, cell[3]+da);
+              std::vector<Vec4i>::const_iterator it =
+                std::lower_bound(uniqueCells_.begin(), uniqueCells_.end(), query, poseCellCompare);
+              if (it != uniqueCells_.end() && *it == query)
+                neighbors.push_back((int)(it - uniqueCells_.begin()));
+            }
+    }
+  }
+
+private:
+  const std::vector<Vec4i>& uniqueCells_;
+  std::vector< std::vector<int> >* neighbors_;
+};
+
 void PPF3DDetector::clusterPoses(std::vector<Pose3DPtr> poseList, int numPoses, std::vector<Pose3DPtr> &finalPoses)
 {
   std::vector<PoseCluster3DPtr> poseClusters;
@@ -340,25 +495,80 @@ void PPF3DDetector::clusterPoses(std::vector<Pose3DPtr> poseList, int numPoses,
   // sort the poses for stability
   std::sort(poseList.begin(), poseList.end(), pose3DPtrCompare);
 
-  for (int i=0; i<numPoses; i++)
+  numPoses = std::min(numPoses, (int)poseList.size());
+
+  if (position_threshold > 0 && rotation_threshold > 0)
   {
-    Pose3DPtr pose = poseList[i];
-    bool assigned = false;
+    // bucket the poses in parallel
+    std::vector<Vec4i> cells(numPoses);
+    parallel_for_(Range(0, numPoses), PoseCellInvoker(poseList, position_threshold, rotation_threshold, cells));
+
+    std::vector<Vec4i> uniqueCells(cells);
+    std::sort(uniqueCells.begin(), uniqueCells.end(), poseCellCompare);
+    uniqueCells.erase(std::unique(uniqueCells.begin(), uniqueCells.end()), uniqueCells.end());
+
+    const int numCells = (int)uniqueCells.size();
+    std::vector< std::vector<int> > neighbors(numCells);
+    parallel_for_(Range(0, numCells), PoseCellNeighborsInvoker(uniqueCells, neighbors));
 
-    // search all clusters
-    for (size_t j=0; j<poseClusters.size() && !assigned; j++)
+    // cluster ids whose center lies in a cell
+    std::vector< std::vector<int> > centers(numCells);
+
+    for (int i=0; i<numPoses; i++)
     {
-      const Pose3DPtr poseCenter = poseClusters[j]->poseList[0];
-      if (matchPose(*pose, *poseCenter))
+      Pose3DPtr pose = poseList[i];
+      const int cell = (int)(std::lower_bound(uniqueCells.begin(), uniqueCells.end(), cells[i], poseCellCompare) - uniqueCells.begin());
+
+      // the first created cluster among the matching ones, as in a linear scan
+      int assigned = -1;
+      const std::vector<int>& cellNeighbors = neighbors[cell];
+      for (size_t n=0; n<cellNeighbors.size(); n++)
       {
-        poseClusters[j]->addPose(pose);
-        assigned = true;
+        const std::vector<int>& cellCenters = centers[cellNeighbors[n]];
+        for (size_t j=0; j<cellCenters.size(); j++)
+        {
+          const int clusterId = cellCenters[j];
+          if ((assigned < 0 || clusterId < assigned) &&
+              matchPose(*pose, *poseClusters[clusterId]->poseList[0]))
+          {
+            assigned = clusterId;
+          }
+        }
       }
-    }
 
-    if (!assigned)
+      if (assigned >= 0)
+      {
+        poseClusters[assigned]->addPose(pose);
+      }
+      else
+      {
+        centers[cell].push_back((int)poseClusters.size());
+        poseClusters.push_back(PoseCluster3DPtr(new PoseCluster3D(pose)));
+      }
+    }
+  }
+  else
+  {
+    for (int i=0; i<numPoses; i++)
     {
-      poseClusters.push_back(PoseCluster3DPtr(new PoseCluster3D(pose)));
+      Pose3DPtr pose = poseList[i];
+      bool assigned = false;
+
+      // search all clusters
+      for (size_t j=0; j<poseClusters.size() && !assigned; j++)
+      {
+        const Pose3DPtr poseCenter = poseClusters[j]->poseList[0];
+        if (matchPose(*pose, *poseCenter))
+        {
+          poseClusters[j]->addPose(pose);
+          assigned = true;
+        }
+      }
+
+      if (!assigned)
+      {
+        poseClusters.push_back(PoseCluster3DPtr(new PoseCluster3D(pose)));
+      }
     }
   }
 
@@ -467,195 +677,213 @@ void PPF3DDetector::clusterPoses(std::vector<Pose3DPtr> poseList, int numPoses,
   poseClusters.clear();
 }
 
-void PPF3DDetector::match(const Mat& pc, std::vector<Pose3DPtr>& results, const double relativeSceneSampleStep, const double relativeSceneDistance)
+// Votes for a single scene reference point and returns the best pose hypothesis.
+// The accumulator is expected to be zero on entry and is cleared again while
+// searching for the maximum, so that the caller can reuse it.
+Pose3DPtr PPF3DDetector::voteReferencePoint(const Mat& sampled, int refInd, unsigned int* accumulator)
 {
-  if (!trained)
-  {
-    throw cv::Exception(cv::Error::StsError, "The model is not trained. Cannot match without training", __FUNCTION__, __FILE__, __LINE__);
-  }
+  const int numAngles = (int) (floor (2 * M_PI / angle_step));
+  const float distanceStep = (float)distance_step;
+  const unsigned int n = num_ref_points;
+  const int i = refInd;
 
-  CV_Assert(pc.type() == CV_32F || pc.type() == CV_32FC1);
-  CV_Assert(relativeSceneSampleStep<=1 && relativeSceneSampleStep>0);
+  unsigned int refIndMax = 0, alphaIndMax = 0;
+  unsigned int maxVotes = 0;
 
-  scene_sample_step = (int)(1.0/relativeSceneSampleStep);
+  float* f1 = (float*)(&sampled.data[i * sampled.step]);
+  const double p1[4] = {f1[0], f1[1], f1[2], 0};
+  const double n1[4] = {f1[3], f1[4], f1[5], 0};
+  double *row2, *row3, tsg[3]={0}, Rsg[9]={0}, RInv[9]={0};
 
-  //int numNeighbors = 10;
-  int numAngles = (int) (floor (2 * M_PI / angle_step));
-  float distanceStep = (float)distance_step;
-  unsigned int n = num_ref_points;
-  std::vector<Pose3DPtr> poseList;
-  int sceneSamplingStep = scene_sample_step;
+  computeTransformRT(p1, n1, Rsg, tsg);
+  row2=&Rsg[3];
+  row3=&Rsg[6];
 
-  // compute bbox
-  float xRange[2], yRange[2], zRange[2];
-  computeBboxStd(pc, xRange, yRange, zRange);
+  // Tolga Birdal's notice:
+  // As a later update, we might want to look into a local neighborhood only
+  // To do this, simply search the local neighborhood by radius look up
+  // and collect the neighbors to compute the relative pose
 
-  // sample the point cloud
-  /*float dx = xRange[1] - xRange[0];
-  float dy = yRange[1] - yRange[0];
-  float dz = zRange[1] - zRange[0];
-  float diameter = sqrt ( dx * dx + dy * dy + dz * dz );
-  float distanceSampleStep = diameter * RelativeSceneDistance;*/
-  Mat sampled = samplePCByQuantization(pc, xRange, yRange, zRange, (float)relativeSceneDistance, 0);
+  for (int j = 0; j < sampled.rows; j ++)
+  {
+    if (i!=j)
+    {
+      float* f2 = (float*)(&sampled.data[j * sampled.step]);
+      const double p2[4] = {f2[0], f2[1], f2[2], 0};
+      const double n2[4] = {f2[3], f2[4], f2[5], 0};
+      double p2t[4], alpha_scene;
 
-  // allocate the accumulator : Moved this to the inside of the loop
-  /*#if !defined (_OPENMP)
-     unsigned int* accumulator = (unsigned int*)calloc(numAngles*n, sizeof(unsigned int));
-  #endif*/
+      double f[4]={0};
+      computePPFFeatures(p1, n1, p2, n2, f);
+      KeyType hashValue = hashPPF(f, angle_step, distanceStep);
 
-  poseList.reserve((sampled.rows/sceneSamplingStep)+4);
+      // we don't need to call this here, as we already estimate the tsg from scene reference point
+      // double alpha = computeAlpha(p1, n1, p2);
+      p2t[1] = tsg[1] + row2[0] * p2[0] + row2[1] * p2[1] + row2[2] * p2[2];
+      p2t[2] = tsg[2] + row3[0] * p2[0] + row3[1] * p2[1] + row3[2] * p2[2];
 
-#if defined _OPENMP
-#pragma omp parallel for
-#endif
-  for (int i = 0; i < sampled.rows; i += sceneSamplingStep)
-  {
-    unsigned int refIndMax = 0, alphaIndMax = 0;
-    unsigned int maxVotes = 0;
+      alpha_scene=atan2(-p2t[2], p2t[1]);
 
-    float* f1 = (float*)(&sampled.data[i * sampled.step]);
-    const double p1[4] = {f1[0], f1[1], f1[2], 0};
-    const double n1[4] = {f1[3], f1[4], f1[5], 0};
-    double *row2, *row3, tsg[3]={0}, Rsg[9]={0}, RInv[9]={0};
+      if ( alpha_scene != alpha_scene)
+      {
+        continue;
+      }
+
+      if (sin(alpha_scene)*p2t[2]<0.0)
+        alpha_scene=-alpha_scene;
+
+      alpha_scene=-alpha_scene;
 
-    unsigned int* accumulator = (unsigned int*)calloc(numAngles*n, sizeof(unsigned int));
-    computeTransformRT(p1, n1, Rsg, tsg);
-    row2=&Rsg[3];
-    row3=&Rsg[6];
+      int numNodes = 0;
+      const THash* bucket = getBucketFlat(hash_table, hash_nodes, hashValue, numNodes);
 
-    // Tolga Birdal's notice:
-    // As a later update, we might want to look into a local neighborhood only
-    // To do this, simply search the local neighborhood by radius look up
-    // and collect the neighbors to compute the relative pose
+      for (int b = 0; b < numNodes; b++)
+      {
+        const THash* tData = &bucket[b];
+        int corrI = (int)tData->i;
+        int ppfInd = (int)tData->ppfInd;
+        float* ppfCorrScene = (float*)(&ppf.data[ppfInd]);
+        double alpha_model = (double)ppfCorrScene[PPF_LENGTH-1];
+        double alpha = alpha_model - alpha_scene;
+
+        /*  Tolga Birdal's note: Map alpha to the indices:
+                atan2 generates results in (-pi pi]
+                That's why alpha should be in range [-2pi 2pi]
+                So the quantization would be :
+                numAngles * (alpha+2pi)/(4pi)
+                */
+
+        //printf("%f\n", alpha);
+        int alpha_index = (int)(numAngles*(alpha + 2*M_PI) / (4*M_PI));
+
+        unsigned int accIndex = corrI * numAngles + alpha_index;
+
+        accumulator[accIndex]++;
+      }
+    }
+  }
 
-    for (int j = 0; j < sampled.rows; j ++)
+  // Maximize the accumulator
+  for (unsigned int k = 0; k < n; k++)
+  {
+    for (int j = 0; j < numAngles; j++)
     {
-      if (i!=j)
+      const unsigned int accInd = k*numAngles + j;
+      const unsigned int accVal = accumulator[ accInd ];
+      if (accVal > maxVotes)
       {
-        float* f2 = (float*)(&sampled.data[j * sampled.step]);
-        const double p2[4] = {f2[0], f2[1], f2[2], 0};
-        const double n2[4] = {f2[3], f2[4], f2[5], 0};
-        double p2t[4], alpha_scene;
+        maxVotes = accVal;
+        refIndMax = k;
+        alphaIndMax = j;
+      }
 
-        double f[4]={0};
-        computePPFFeatures(p1, n1, p2, n2, f);
-        KeyType hashValue = hashPPF(f, angle_step, distanceStep);
+      accumulator[accInd ] = 0;
+    }
+  }
 
-        // we don't need to call this here, as we already estimate the tsg from scene reference point
-        // double alpha = computeAlpha(p1, n1, p2);
-        p2t[1] = tsg[1] + row2[0] * p2[0] + row2[1] * p2[1] + row2[2] * p2[2];
-        p2t[2] = tsg[2] + row3[0] * p2[0] + row3[1] * p2[1] + row3[2] * p2[2];
+  // invert Tsg : Luckily rotation is orthogonal: Inverse = Transpose.
+  // We are not required to invert.
+  double tInv[3], tmg[3], Rmg[9];
+  matrixTranspose33(Rsg, RInv);
+  matrixProduct331(RInv, tsg, tInv);
 
-        alpha_scene=atan2(-p2t[2], p2t[1]);
+  double TsgInv[16] = { RInv[0], RInv[1], RInv[2], -tInv[0],
+                        RInv[3], RInv[4], RInv[5], -tInv[1],
+                        RInv[6], RInv[7], RInv[8], -tInv[2],
+                        0, 0, 0, 1
+                      };
 
-        if ( alpha_scene != alpha_scene)
-        {
-          continue;
-        }
+  // TODO : Compute pose
+  const float* fMax = (float*)(&sampled_pc.data[refIndMax * sampled_pc.step]);
+  const double pMax[4] = {fMax[0], fMax[1], fMax[2], 1};
+  const double nMax[4] = {fMax[3], fMax[4], fMax[5], 1};
 
-        if (sin(alpha_scene)*p2t[2]<0.0)
-          alpha_scene=-alpha_scene;
+  computeTransformRT(pMax, nMax, Rmg, tmg);
 
-        alpha_scene=-alpha_scene;
+  double Tmg[16] = { Rmg[0], Rmg[1], Rmg[2], tmg[0],
+                     Rmg[3], Rmg[4], Rmg[5], tmg[1],
+                     Rmg[6], Rmg[7], Rmg[8], tmg[2],
+                     0, 0, 0, 1
+                   };
 
-        hashnode_i* node = hashtableGetBucketHashed(hash_table, (hashValue));
+  // convert alpha_index to alpha
+  int alpha_index = alphaIndMax;
+  double alpha = (alpha_index*(4*M_PI))/numAngles-2*M_PI;
 
-        while (node)
-        {
-          THash* tData = (THash*) node->data;
-          int corrI = (int)tData->i;
-          int ppfInd = (int)tData->ppfInd;
-          float* ppfCorrScene = (float*)(&ppf.data[ppfInd]);
-          double alpha_model = (double)ppfCorrScene[PPF_LENGTH-1];
-          double alpha = alpha_model - alpha_scene;
-
-          /*  Tolga Birdal's note: Map alpha to the indices:
-                  atan2 generates results in (-pi pi]
-                  That's why alpha should be in range [-2pi 2pi]
-                  So the quantization would be :
-                  numAngles * (alpha+2pi)/(4pi)
-                  */
-
-          //printf("%f\n", alpha);
-          int alpha_index = (int)(numAngles*(alpha + 2*M_PI) / (4*M_PI));
-
-          unsigned int accIndex = corrI * numAngles + alpha_index;
-
-          accumulator[accIndex]++;
-          node = node->next;
-        }
-      }
-    }
+  // Equation 2:
+  double Talpha[16]={0};
+  getUnitXRotation_44(alpha, Talpha);
 
-    // Maximize the accumulator
-    for (unsigned int k = 0; k < n; k++)
-    {
-      for (int j = 0; j < numAngles; j++)
-      {
-        const unsigned int accInd = k*numAngles + j;
-        const unsigned int accVal = accumulator[ accInd ];
-        if (accVal > maxVotes)
-        {
-          maxVotes = accVal;
-          refIndMax = k;
-          alphaIndMax = j;
-        }
+  double Temp[16]={0};
+  double rawPose[16]={0};
+  matrixProduct44(Talpha, Tmg, Temp);
+  matrixProduct44(TsgInv, Temp, rawPose);
 
-#if !defined (_OPENMP)
-        accumulator[accInd ] = 0;
-#endif
-      }
+  Pose3DPtr pose(new Pose3D(alpha, refIndMax, maxVotes));
+  pose->updatePose(rawPose);
+
+  return pose;
+}
+
+// Distributes the scene reference points over the workers. Every chunk owns
+// a private accumulator and pose k is always written to poseList[k], which
+// keeps the result independent of the scheduling.
+class PPFVotingInvoker : public ParallelLoopBody
+{
+public:
+  PPFVotingInvoker(PPF3DDetector* detector, const Mat& sampled, int sceneSamplingStep, std::vector<Pose3DPtr>& poseList)
+    : detector_(detector), sampled_(sampled), sceneSamplingStep_(sceneSamplingStep), poseList_(&poseList)
+  {
+    const int numAngles = (int) (floor (2 * M_PI / detector->angle_step));
+    accumulatorSize_ = (size_t)numAngles * (size_t)detector->num_ref_points;
+  }
+
+  virtual void operator()(const Range& range) const
+  {
+    std::vector<unsigned int> accumulator(accumulatorSize_, 0);
+
+    for (int k = range.start; k < range.end; k++)
+    {
+      (*poseList_)[k] = detector_->voteReferencePoint(sampled_, k*sceneSamplingStep_, &accumulator[0]);
     }
+  }
 
-    // invert Tsg : Luckily rotation is orthogonal: Inverse = Transpose.
-    // We are not required to invert.
-    double tInv[3], tmg[3], Rmg[9];
-    matrixTranspose33(Rsg, RInv);
-    matrixProduct331(RInv, tsg, tInv);
-
-    double TsgInv[16] = { RInv[0], RInv[1], RInv[2], -tInv[0],
-                          RInv[3], RInv[4], RInv[5], -tInv[1],
-                          RInv[6], RInv[7], RInv[8], -tInv[2],
-                          0, 0, 0, 1
-                        };
-
-    // TODO : Compute pose
-    const float* fMax = (float*)(&sampled_pc.data[refIndMax * sampled_pc.step]);
-    const double pMax[4] = {fMax[0], fMax[1], fMax[2], 1};
-    const double nMax[4] = {fMax[3], fMax[4], fMax[5], 1};
-
-    computeTransformRT(pMax, nMax, Rmg, tmg);
-    row2=&Rsg[3];
-    row3=&Rsg[6];
-
-    double Tmg[16] = { Rmg[0], Rmg[1], Rmg[2], tmg[0],
-                       Rmg[3], Rmg[4], Rmg[5], tmg[1],
-                       Rmg[6], Rmg[7], Rmg[8], tmg[2],
-                       0, 0, 0, 1
-                     };
-
-    // convert alpha_index to alpha
-    int alpha_index = alphaIndMax;
-    double alpha = (alpha_index*(4*M_PI))/numAngles-2*M_PI;
-
-    // Equation 2:
-    double Talpha[16]={0};
-    getUnitXRotation_44(alpha, Talpha);
-
-    double Temp[16]={0};
-    double rawPose[16]={0};
-    matrixProduct44(Talpha, Tmg, Temp);
-    matrixProduct44(TsgInv, Temp, rawPose);
-
-    Pose3DPtr pose(new Pose3D(alpha, refIndMax, maxVotes));
-    pose->updatePose(rawPose);
-    poseList.push_back(pose);
-
-#if defined (_OPENMP)
-    free(accumulator);
-#endif
+private:
+  PPF3DDetector* detector_;
+  const Mat& sampled_;
+  int sceneSamplingStep_;
+  std::vector<Pose3DPtr>* poseList_;
+  size_t accumulatorSize_;
+};
+
+void PPF3DDetector::match(const Mat& pc, std::vector<Pose3DPtr>& results, const double relativeSceneSampleStep, const double relativeSceneDistance)
+{
+  if (!trained)
+  {
+    throw cv::Exception(cv::Error::StsError, "The model is not trained. Cannot match without training", __FUNCTION__, __FILE__, __LINE__);
   }
 
+  CV_Assert(pc.type() == CV_32F || pc.type() == CV_32FC1);
+  CV_Assert(relativeSceneSampleStep<=1 && relativeSceneSampleStep>0);
+
+  scene_sample_step = (int)(1.0/relativeSceneSampleStep);
+
+  std::vector<Pose3DPtr> poseList;
+  int sceneSamplingStep = scene_sample_step;
+
+  // compute bbox
+  float xRange[2], yRange[2], zRange[2];
+  computeBboxStd(pc, xRange, yRange, zRange);
+
+  // sample the point cloud
+  Mat sampled = samplePCByQuantization(pc, xRange, yRange, zRange, (float)relativeSceneDistance, 0);
+
+  // one pose per scene reference point, in the order of the serial loop
+  const int numRefScene = (sampled.rows + sceneSamplingStep - 1) / sceneSamplingStep;
+  poseList.resize(numRefScene);
+
+  parallel_for_(Range(0, numRefScene), PPFVotingInvoker(this, sampled, sceneSamplingStep, poseList));
+
   // TODO : Make the parameters relative if not arguments.
   //double MinMatchScore = 0.5;
 
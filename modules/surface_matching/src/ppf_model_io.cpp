@@ -0,0 +1,477 @@
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                          License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2014, OpenCV Foundation, all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote products
+//     derived from this software without specific prior written permission.
+//
+// This software is provided by the copyright holders and contributors "as is" and
+// any express or implied warranties, including, but not limited to, the implied
+// warranties of merchantability and fitness for a particular purpose are disclaimed.
+// In no event shall the Intel Corporation or contributors be liable for any direct,
+// indirect, incidental, special, exemplary, or consequential damages
+// (including, but not limited to, procurement of substitute goods or services;
+// loss of use, data, or profits; or business interruption) however caused
+// and on any theory of liability, whether in contract, strict liability,
+// or tort (including negligence or otherwise) arising in any way out of
+//
+// Author: Tolga Birdal <tbirdal AT gmail.com>
+
+#include "precomp.hpp"
+
+#if defined _WIN32
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+namespace cv
+{
+namespace ppf_match_3d
+{
+
+/*
+Binary model layout (version 1). All offsets are in bytes from the beginning
+of the file and every matrix starts on a MODEL_ALIGNMENT boundary, so that the
+mapped data can be used in place:
+
+  ModelFileHeader
+  sampled_pc   (num_ref_points x 6, CV_32F)
+  ppf          (num_ref_points^2 x 5, CV_32F)
+  hash_nodes   (CV_32SC3, THash entries grouped by key)
+  hash_table   (CV_32SC3, open addressing slots)
+*/
+static const char MODEL_MAGIC[8] = {'P','P','F','3','D','M','D','L'};
+static const unsigned int MODEL_VERSION = 1;
+static const unsigned int MODEL_BYTE_ORDER = 0x01020304;
+static const size_t MODEL_ALIGNMENT = 64;
+
+enum
+{
+  MODEL_SECTION_SAMPLED_PC = 0,
+  MODEL_SECTION_PPF,
+  MODEL_SECTION_HASH_NODES,
+  MODEL_SECTION_HASH_TABLE,
+  MODEL_SECTION_COUNT
+};
+
+typedef struct ModelFileSection
+{
+  uint64 offset;
+  int rows, cols, type, reserved;
+} ModelFileSection;
+
+typedef struct ModelFileHeader
+{
+  char magic[8];
+  unsigned int version;
+  unsigned int byteOrder;
+  uint64 fileSize;
+
+  double angleStep, distanceStep;
+  double samplingStepRelative, angleStepRelative, distanceStepRelative;
+  double positionThreshold, rotationThreshold;
+  int numRefPoints, ppfStep, useWeightedAvg, reserved;
+
+  ModelFileSection sections[MODEL_SECTION_COUNT];
+} ModelFileHeader;
+
+static inline uint64 alignOffset(uint64 offset)
+{
+  return (offset + MODEL_ALIGNMENT - 1) & ~(uint64)(MODEL_ALIGNMENT - 1);
+}
+
+// Read-only view of a model file. Uses a shared mapping where available so
+// that the pages are shared by all processes that load the same model.
+class MappedModelFile
+{
+public:
+  MappedModelFile() : data(0), size(0)
+  {
+#if defined _WIN32
+    file = INVALID_HANDLE_VALUE;
+    mapping = NULL;
+#endif
+  }
+
+  ~MappedModelFile()
+  {
+    close();
+  }
+
+  bool open(const std::string& fileName)
+  {
+    close();
+
+#if defined _WIN32
+    file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+      return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+      close();
+      return false;
+    }
+
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping)
+    {
+      close();
+      return false;
+    }
+
+    data = (const uchar*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    size = (size_t)fileSize.QuadPart;
+#else
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+      ::close(fd);
+      return false;
+    }
+
+    void* ptr = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+
+    if (ptr == MAP_FAILED)
+      return false;
+
+    data = (const uchar*)ptr;
+    size = (size_t)st.st_size;
+#endif
+
+    if (!data)
+    {
+      close();
+      return false;
+    }
+
+    return true;
+  }
+
+  void close()
+  {
+#if defined _WIN32
+    if (data)
+      UnmapViewOfFile(data);
+    if (mapping)
+      CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE)
+      CloseHandle(file);
+    mapping = NULL;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (data)
+      munmap((void*)data, size);
+#endif
+    data = 0;
+    size = 0;
+  }
+
+  const uchar* data;
+  size_t size;
+
+private:
+#if defined _WIN32
+  HANDLE file, mapping;
+#endif
+
+  MappedModelFile(const MappedModelFile&);
+  MappedModelFile& operator=(const MappedModelFile&);
+};
+
+static void fillSection(ModelFileSection& section, const Mat& m, uint64& offset)
+{
+  CV_Assert(m.empty() || m.isContinuous());
+
+  section.offset = alignOffset(offset);
+  section.rows = m.rows;
+  section.cols = m.cols;
+  section.type = m.type();
+  section.reserved = 0;
+
+  offset = section.offset + (uint64)m.total()*m.elemSize();
+}
+
+static void writeSection(FILE* f, const ModelFileSection& section, const Mat& m, uint64& offset)
+{
+  static const char padding[MODEL_ALIGNMENT] = {0};
+
+  const size_t numPadding = (size_t)(section.offset - offset);
+  const size_t numBytes = m.total()*m.elemSize();
+  if ((numPadding && fwrite(padding, 1, numPadding, f) != numPadding) ||
+      (numBytes && fwrite(m.data, 1, numBytes, f) != numBytes))
+  {
+    fclose(f);
+    CV_Error(cv::Error::StsError, "Cannot write the PPF model");
+  }
+
+  offset = section.offset + numBytes;
+}
+
+// wraps a section of the mapped file without copying
+static Mat mapSection(const MappedModelFile& file, const ModelFileSection& section)
+{
+  const uint64 numBytes = (uint64)section.rows * section.cols * CV_ELEM_SIZE(section.type);
+
+  if (section.rows < 0 || section.cols < 0 || section.offset % MODEL_ALIGNMENT != 0 ||
+      section.offset + numBytes > (uint64)file.size)
+  {
+    CV_Error(cv::Error::StsParseError, "Corrupted PPF model file");
+  }
+
+  if (!numBytes)
+    return Mat();
+
+  return Mat(section.rows, section.cols, section.type, (void*)(file.data + section.offset));
+}
+
+static bool isPositiveFinite(double value)
+{
+  return value > 0 && !cvIsInf(value) && !cvIsNaN(value);
+}
+
+// The matching reads the mapped model without any bound checks. These checks
+// are O(hashtable slots) and cover what a lookup touches: the quantization
+// steps that size the vote accumulator, the section shapes and the slot
+// ranges. A table without an empty slot would make a lookup probe forever.
+static void validateModel(const ModelFileHeader& header, const Mat& sampled, const Mat& ppf,
+                          const Mat& hashNodes, const Mat& hashTable)
+{
+  const int numRefPoints = header.numRefPoints;
+
+  // at least one and at most INT_MAX angle bins
+  if (!isPositiveFinite(header.angleStep) || header.angleStep > 2*M_PI ||
+      2*M_PI / header.angleStep >= INT_MAX || !isPositiveFinite(header.distanceStep))
+  {
+    CV_Error(cv::Error::StsParseError, "Corrupted PPF model file");
+  }
+
+  if (numRefPoints <= 0 || sampled.type() != CV_32F || sampled.rows != numRefPoints || sampled.cols < 6 ||
+      ppf.type() != CV_32F || ppf.cols != 5 || (int)ppf.step != header.ppfStep ||
+      (int64)ppf.rows != (int64)numRefPoints*numRefPoints ||
+      hashNodes.type() != CV_32SC3 || hashTable.type() != CV_32SC3 || hashNodes.cols != 1 || hashTable.cols != 1)
+  {
+    CV_Error(cv::Error::StsParseError, "Corrupted PPF model file");
+  }
+
+  // the open addressing table masks with its size
+  if (hashTable.rows <= 0 || (hashTable.rows & (hashTable.rows - 1)) != 0)
+  {
+    CV_Error(cv::Error::StsParseError, "Corrupted PPF model file");
+  }
+
+  // slots are {key, begin, end}, empty slots have begin == end
+  const int numNodes = hashNodes.rows;
+  bool hasEmptySlot = false;
+
+  for (int s=0; s<hashTable.rows; s++)
+  {
+    const Vec3i& slot = hashTable.at<Vec3i>(s);
+    const int begin = slot[1], end = slot[2];
+
+    if (begin == end)
+      hasEmptySlot = true;
+    else if (begin < 0 || begin > end || end > numNodes)
+    {
+      CV_Error(cv::Error::StsParseError, "Corrupted PPF model file");
+    }
+  }
+
+  if (!hasEmptySlot)
+  {
+    CV_Error(cv::Error::StsParseError, "Corrupted PPF model file");
+  }
+}
+
+// Checks the nodes of every slot against the model. It reads the node and
+// feature sections, so it is only done on request.
+static void validateModelContents(const ModelFileHeader& header, const Mat& ppf,
+                                  const Mat& hashNodes, const Mat& hashTable)
+{
+  const THash* nodes = hashNodes.ptr<THash>();
+  const int64 ppfStep = header.ppfStep;
+  // alpha comes from atan2, rounded to float
+  const float maxAlpha = (float)M_PI;
+
+  for (int s=0; s<hashTable.rows; s++)
+  {
+    const Vec3i& slot = hashTable.at<Vec3i>(s);
+
+    for (int n=slot[1]; n<slot[2]; n++)
+    {
+      const int64 ppfInd = nodes[n].ppfInd;
+      if (nodes[n].i < 0 || nodes[n].i >= header.numRefPoints ||
+          ppfInd < 0 || ppfInd % ppfStep != 0 || ppfInd / ppfStep >= ppf.rows)
+      {
+        CV_Error(cv::Error::StsParseError, "Corrupted PPF model file");
+      }
+
+      // the vote index is derived from alpha, NaN fails the comparison as well
+      const float alpha = ppf.ptr<float>((int)(ppfInd / ppfStep))[ppf.cols-1];
+      if (!(alpha >= -maxAlpha && alpha <= maxAlpha))
+      {
+        CV_Error(cv::Error::StsParseError, "Corrupted PPF model file");
+      }
+    }
+  }
+}
+
+void PPF3DDetector::save(const std::string& fileName) const
+{
+  if (!trained)
+  {
+    CV_Error(cv::Error::StsError, "The model is not trained. Cannot save without training");
+  }
+
+  ModelFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+  header.version = MODEL_VERSION;
+  header.byteOrder = MODEL_BYTE_ORDER;
+
+  header.angleStep = angle_step;
+  header.distanceStep = distance_step;
+  header.samplingStepRelative = sampling_step_relative;
+  header.angleStepRelative = angle_step_relative;
+  header.distanceStepRelative = distance_step_relative;
+  header.positionThreshold = position_threshold;
+  header.rotationThreshold = rotation_threshold;
+  header.numRefPoints = num_ref_points;
+  header.ppfStep = ppf_step;
+  header.useWeightedAvg = use_weighted_avg ? 1 : 0;
+
+  const Mat* sections[MODEL_SECTION_COUNT] = { &sampled_pc, &ppf, &hash_nodes, &hash_table };
+
+  uint64 offset = sizeof(ModelFileHeader);
+  for (int s=0; s<MODEL_SECTION_COUNT; s++)
+    fillSection(header.sections[s], *sections[s], offset);
+  header.fileSize = offset;
+
+  FILE* f = fopen(fileName.c_str(), "wb");
+  if (!f)
+  {
+    CV_Error(cv::Error::StsError, "Cannot open the PPF model file for writing: " + fileName);
+  }
+
+  if (fwrite(&header, sizeof(header), 1, f) != 1)
+  {
+    fclose(f);
+    CV_Error(cv::Error::StsError, "Cannot write the PPF model");
+  }
+
+  offset = sizeof(ModelFileHeader);
+  for (int s=0; s<MODEL_SECTION_COUNT; s++)
+    writeSection(f, header.sections[s], *sections[s], offset);
+
+  // buffered data is only written, and write errors only reported, on close
+  if (fclose(f) != 0)
+  {
+    CV_Error(cv::Error::StsError, "Cannot write the PPF model");
+  }
+}
+
+void PPF3DDetector::load(const std::string& fileName, bool checkContents)
+{
+  Ptr<MappedModelFile> file(new MappedModelFile());
+
+  if (!file->open(fileName))
+  {
+    CV_Error(cv::Error::StsError, "Cannot open the PPF model file: " + fileName);
+  }
+
+  if (file->size < sizeof(ModelFileHeader))
+  {
+    CV_Error(cv::Error::StsParseError, "Corrupted PPF model file");
+  }
+
+  ModelFileHeader header;
+  memcpy(&header, file->data, sizeof(header));
+
+  if (memcmp(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) != 0)
+  {
+    CV_Error(cv::Error::StsParseError, "Not a PPF model file: " + fileName);
+  }
+
+  if (header.version != MODEL_VERSION)
+  {
+    CV_Error(cv::Error::StsParseError, "Unsupported PPF model file version");
+  }
+
+  if (header.byteOrder != MODEL_BYTE_ORDER)
+  {
+    CV_Error(cv::Error::StsParseError, "The PPF model file was written on a machine with a different byte order");
+  }
+
+  if (header.fileSize > (uint64)file->size)
+  {
+    CV_Error(cv::Error::StsParseError, "Truncated PPF model file");
+  }
+
+  Mat sampled = mapSection(*file, header.sections[MODEL_SECTION_SAMPLED_PC]);
+  Mat ppfMapped = mapSection(*file, header.sections[MODEL_SECTION_PPF]);
+  Mat hashNodes = mapSection(*file, header.sections[MODEL_SECTION_HASH_NODES]);
+  Mat hashTable = mapSection(*file, header.sections[MODEL_SECTION_HASH_TABLE]);
+
+  validateModel(header, sampled, ppfMapped, hashNodes, hashTable);
+  if (checkContents)
+    validateModelContents(header, ppfMapped, hashNodes, hashTable);
+
+  clearTrainingModels();
+
+  angle_step = header.angleStep;
+  angle_step_radians = header.angleStep;
+  distance_step = header.distanceStep;
+  sampling_step_relative = header.samplingStepRelative;
+  angle_step_relative = header.angleStepRelative;
+  distance_step_relative = header.distanceStepRelative;
+  position_threshold = header.positionThreshold;
+  rotation_threshold = header.rotationThreshold;
+  use_weighted_avg = header.useWeightedAvg != 0;
+  num_ref_points = header.numRefPoints;
+  ppf_step = header.ppfStep;
+
+  sampled_pc = sampled;
+  ppf = ppfMapped;
+  hash_nodes = hashNodes;
+  hash_table = hashTable;
+  model_file = file;
+  trained = true;
+}
+
+} // namespace ppf_match_3d
+
+} // namespace cv
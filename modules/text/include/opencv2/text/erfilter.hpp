@@ -133,6 +133,14 @@ public:
         @param  stat :   The region to be classified
          */
         virtual double eval(const ERStat& stat) = 0; //const = 0; //TODO why cannot use const = 0 here?
+
+        /** @brief Returns an independent copy of the classifier.
+
+        Used by the multi-channel ERFilter::run to evaluate regions of several channels
+        concurrently. The default implementation returns an empty pointer, and then the channels
+        are processed one after the other.
+         */
+        virtual Ptr<Callback> clone() const { return Ptr<Callback>(); }
     };
 
     /** @brief The key method of ERFilter algorithm.
@@ -150,6 +158,19 @@ public:
      */
     virtual void run( InputArray image, std::vector<ERStat>& regions ) = 0;
 
+    /** @brief Runs the filter on several channels of an image.
+
+    @param channels Single channel images CV_8UC1, e.g. the output of computeNMChannels
+
+    @param regions Output for the 1st stage and Input/Output for the 2nd, one vector of ERStat for
+    each channel.
+
+    The result is the same as calling run for every channel in turn. Channels are processed in
+    parallel, each one with its own copy of the filter state, when the classifier can be cloned
+    (see ERFilter::Callback::clone).
+     */
+    virtual void run( InputArrayOfArrays channels, std::vector<std::vector<ERStat> >& regions );
+
 
     //! set/get methods to set the algorithm properties,
     virtual void setCallback(const Ptr<ERFilter::Callback>& cb) = 0;
@@ -129,7 +129,8 @@ public:
 
 enum decoder_mode
 {
-    OCR_DECODER_VITERBI = 0 // Other algorithms may be added
+    OCR_DECODER_VITERBI = 0,     // Other algorithms may be added
+    OCR_DECODER_VITERBI_BEAM = 1 // Viterbi in log space, keeping only the best states at each step
 };
 
 /** @brief OCRHMMDecoder class provides an interface for OCR using Hidden Markov Models.
@@ -165,6 +166,17 @@ public:
         corresponding to each classes in out_class.
          */
         virtual void eval( InputArray image, std::vector<int>& out_class, std::vector<double>& out_confidence);
+
+        /** @brief Classifies a batch of letters (e.g. all the components of a word) in one call.
+
+        @param images Input images CV_8UC1 or CV_8UC3, each one with a single letter.
+        @param out_classes The ranked list of class labels for each input image.
+        @param out_confidences The probabilities of the classes in out_classes for each input image.
+
+        The default implementation calls the single image eval for each image.
+         */
+        virtual void eval( InputArrayOfArrays images, std::vector< std::vector<int> >& out_classes,
+                           std::vector< std::vector<double> >& out_confidences);
     };
 
 public:
@@ -206,8 +218,11 @@ public:
     @param emission_probabilities_table Table with observation emission probabilities. cols ==
     rows == vocabulary.size().
 
-    @param mode HMM Decoding algorithm. Only OCR_DECODER_VITERBI is available for the moment
-    (<http://en.wikipedia.org/wiki/Viterbi_algorithm>).
+    @param mode HMM Decoding algorithm. OCR_DECODER_VITERBI
+    (<http://en.wikipedia.org/wiki/Viterbi_algorithm>) explores all the vocabulary states at each
+    step, OCR_DECODER_VITERBI_BEAM only extends the beam_width best ones (scored in log space).
+
+    @param beam_width Number of states kept at each step by OCR_DECODER_VITERBI_BEAM.
      */
     static Ptr<OCRHMMDecoder> create(const Ptr<OCRHMMDecoder::ClassifierCallback> classifier,// The character classifier with built in feature extractor
                                      const std::string& vocabulary,                    // The language vocabulary (chars when ascii english text)
@@ -216,7 +231,8 @@ public:
                                                                                        //     cols == rows == vocabulari.size()
                                      InputArray emission_probabilities_table,          // Table with observation emission probabilities
                                                                                        //     cols == rows == vocabulari.size()
-                                     decoder_mode mode = OCR_DECODER_VITERBI);         // HMM Decoding algorithm (only Viterbi for the moment)
+                                     decoder_mode mode = OCR_DECODER_VITERBI,          // HMM Decoding algorithm
+                                     int beam_width = 16);                             // States kept at each step in OCR_DECODER_VITERBI_BEAM mode
 
 protected:
 
@@ -225,11 +241,14 @@ protected:
     Mat transition_p;
     Mat emission_p;
     decoder_mode mode;
+    int beam_width;
 };
 
 /** @brief Allow to implicitly load the default character classifier when creating an OCRHMMDecoder object.
 
 @param filename The XML or YAML file with the classifier model (e.g. OCRHMM_knn_model_data.xml)
+@param cacheSize Number of character masks whose classification is kept and reused when the same
+mask shows up again (e.g. recurring glyphs in video). The default 0 disables the cache.
 
 The default classifier is based in the scene text recognition method proposed by Lukás Neumann &
 Jiri Matas in [Neumann11b]. Basically, the region (contour) in the input image is normalized to a
@@ -238,7 +257,8 @@ based on gradient orientations along the chain-code of its perimeter. Then, the
 using a KNN model trained with synthetic data of rendered characters with different standard font
 types.
  */
-CV_EXPORTS Ptr<OCRHMMDecoder::ClassifierCallback> loadOCRHMMClassifierNM(const std::string& filename);
+CV_EXPORTS Ptr<OCRHMMDecoder::ClassifierCallback> loadOCRHMMClassifierNM(const std::string& filename,
+                                                                          int cacheSize = 0);
 
 //! @}
 
@@ -0,0 +1,132 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote products
+//     derived from this software without specific prior written permission.
+//
+// This software is provided by the copyright holders and contributors "as is" and
+// any express or implied warranties, including, but not limited to, the implied
+// warranties of merchantability and fitness for a particular purpose are disclaimed.
+// In no event shall the Intel Corporation or contributors be liable for any direct,
+// indirect, incidental, special, exemplary, or consequential damages
+// (including, but not limited to, procurement of substitute goods or services;
+// loss of use, data, or profits; or business interruption) however caused
+// and on any theory of liability, whether in contract, strict liability,
+// or tort (including negligence or otherwise) arising in any way out of
+// the use of this software, even if advised of the possibility of such damage.
+//
+//M*/
+
+#include "perf_precomp.hpp"
+
+using namespace cv;
+using namespace cv::text;
+using namespace perf;
+
+/* classifier favouring character-like regions, cheap enough not to hide the extraction time */
+class ShapeClassifier : public ERFilter::Callback
+{
+public:
+    double eval(const ERStat& stat)
+    {
+        if (stat.area == 0)
+            return 0.;
+        double aspect = (double)stat.rect.width / stat.rect.height;
+        double fill = (double)stat.area / stat.rect.area();
+        return (aspect > 0.1 && aspect < 2.) ? fill : 0.1 * fill;
+    }
+
+    Ptr<ERFilter::Callback> clone() const { return makePtr<ShapeClassifier>(); }
+};
+
+/* a noisy colour scene with some lines of text */
+static Mat makeScene()
+{
+    Mat scene(480, 640, CV_8UC3);
+    RNG rng(0);
+    rng.fill(scene, RNG::UNIFORM, Scalar::all(60), Scalar::all(200));
+    GaussianBlur(scene, scene, Size(7, 7), 3);
+    for (int i = 0; i < 12; i++)
+    {
+        Point org(rng.uniform(0, 400), rng.uniform(40, 460));
+        Scalar color(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+        putText(scene, "Scene Text 0123", org, FONT_HERSHEY_SIMPLEX, rng.uniform(0.5, 1.5), color, 2);
+    }
+    return scene;
+}
+
+static bool sameRegions(const std::vector<ERStat>& r1, const std::vector<ERStat>& r2)
+{
+    if (r1.size() != r2.size())
+        return false;
+    for (size_t i = 0; i < r1.size(); i++)
+    {
+        if (r1[i].pixel != r2[i].pixel || r1[i].level != r2[i].level || r1[i].area != r2[i].area ||
+            r1[i].rect != r2[i].rect || r1[i].probability != r2[i].probability)
+            return false;
+    }
+    return true;
+}
+
+typedef perf::TestBaseWithParam<int> ERFilterThreads;
+
+PERF_TEST_P(ERFilterThreads, run_channels, testing::Values(1, 2, 4, 8))
+{
+    Mat scene = makeScene();
+
+    /* both polarities, as in the samples */
+    std::vector<Mat> channels;
+    computeNMChannels(scene, channels);
+    size_t cn = channels.size();
+    for (size_t c = 0; c < cn - 1; c++)
+        channels.push_back(255 - channels[c]);
+
+    Ptr<ERFilter> filter = createERFilterNM1(makePtr<ShapeClassifier>(), 16, 0.00015f, 0.13f, 0.2f, true, 0.1f);
+
+    /* the multi-channel run must give the regions of the single-channel one */
+    std::vector< std::vector<ERStat> > sequential(channels.size());
+    for (size_t c = 0; c < channels.size(); c++)
+        filter->run(channels[c], sequential[c]);
+
+    int oldThreads = getNumThreads();
+    setNumThreads(GetParam());
+
+    std::vector< std::vector<ERStat> > regions;
+    filter->run(channels, regions);
+    EXPECT_EQ(sequential.size(), regions.size());
+    for (size_t c = 0; c < regions.size() && c < sequential.size(); c++)
+        EXPECT_TRUE(sameRegions(sequential[c], regions[c])) << "channel " << c;
+
+    TEST_CYCLE()
+    {
+        regions.clear();
+        filter->run(channels, regions);
+    }
+
+    setNumThreads(oldThreads);
+
+    SANITY_CHECK_NOTHING();
+}
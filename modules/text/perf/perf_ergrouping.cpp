@@ -0,0 +1,108 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote products
+//     derived from this software without specific prior written permission.
+//
+// This software is provided by the copyright holders and contributors "as is" and
+// any express or implied warranties, including, but not limited to, the implied
+// warranties of merchantability and fitness for a particular purpose are disclaimed.
+// In no event shall the Intel Corporation or contributors be liable for any direct,
+// indirect, incidental, special, exemplary, or consequential damages
+// (including, but not limited to, procurement of substitute goods or services;
+// loss of use, data, or profits; or business interruption) however caused
+// and on any theory of liability, whether in contract, strict liability,
+// or tort (including negligence or otherwise) arising in any way out of
+// the use of this software, even if advised of the possibility of such damage.
+//
+//M*/
+
+#include "perf_precomp.hpp"
+
+using namespace cv;
+using namespace cv::text;
+using namespace perf;
+using std::tr1::make_tuple;
+using std::tr1::get;
+
+/* scene text images and classifiers, looked up under text_data/ in the test data path */
+#define SCENES \
+  "text_data/scenetext01.jpg", "text_data/scenetext02.jpg", "text_data/scenetext03.jpg", \
+  "text_data/scenetext04.jpg", "text_data/scenetext05.jpg", "text_data/scenetext06.jpg"
+
+typedef std::tr1::tuple<std::string, int> Scene_Threads_t;
+typedef perf::TestBaseWithParam<Scene_Threads_t> Scene_Threads;
+
+PERF_TEST_P(Scene_Threads, grouping_any, testing::Combine(testing::Values(SCENES), testing::Values(1, 4)))
+{
+    Mat src = imread(getDataPath(get<0>(GetParam())));
+    if (src.empty())
+        FAIL() << "Unable to load source image " << get<0>(GetParam());
+
+    std::vector<Mat> channels;
+    computeNMChannels(src, channels);
+    size_t cn = channels.size();
+    for (size_t c = 0; c < cn - 1; c++)
+        channels.push_back(255 - channels[c]);
+
+    Ptr<ERFilter> filter1 = createERFilterNM1(loadClassifierNM1(getDataPath("text_data/trained_classifierNM1.xml")),
+                                              16, 0.00015f, 0.13f, 0.2f, true, 0.1f);
+    Ptr<ERFilter> filter2 = createERFilterNM2(loadClassifierNM2(getDataPath("text_data/trained_classifierNM2.xml")), 0.5);
+
+    std::vector< std::vector<ERStat> > regions(channels.size());
+    filter1->run(channels, regions);
+    filter2->run(channels, regions);
+
+    std::string grouping = getDataPath("text_data/trained_classifier_erGrouping.xml");
+
+    /* the clustering is deterministic, whatever the number of threads */
+    std::vector< std::vector<Vec2i> > reference;
+    std::vector<Rect> reference_rects;
+    int oldThreads = getNumThreads();
+    setNumThreads(1);
+    erGrouping(src, channels, regions, reference, reference_rects, ERGROUPING_ORIENTATION_ANY, grouping, 0.5);
+
+    setNumThreads(get<1>(GetParam()));
+
+    std::vector< std::vector<Vec2i> > groups;
+    std::vector<Rect> rects;
+    declare.time(120);
+    TEST_CYCLE()
+    {
+        /* erGrouping appends to the output vectors */
+        groups.clear();
+        rects.clear();
+        erGrouping(src, channels, regions, groups, rects, ERGROUPING_ORIENTATION_ANY, grouping, 0.5);
+    }
+
+    setNumThreads(oldThreads);
+
+    ASSERT_EQ(reference.size(), groups.size());
+    for (size_t i = 0; i < groups.size(); i++)
+        EXPECT_TRUE(reference[i] == groups[i]) << "group " << i;
+
+    SANITY_CHECK_NOTHING();
+}
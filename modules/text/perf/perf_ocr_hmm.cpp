@@ -0,0 +1,141 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote products
+//     derived from this software without specific prior written permission.
+//
+// This software is provided by the copyright holders and contributors "as is" and
+// any express or implied warranties, including, but not limited to, the implied
+// warranties of merchantability and fitness for a particular purpose are disclaimed.
+// In no event shall the Intel Corporation or contributors be liable for any direct,
+// indirect, incidental, special, exemplary, or consequential damages
+// (including, but not limited to, procurement of substitute goods or services;
+// loss of use, data, or profits; or business interruption) however caused
+// and on any theory of liability, whether in contract, strict liability,
+// or tort (including negligence or otherwise) arising in any way out of
+// the use of this software, even if advised of the possibility of such damage.
+//
+//M*/
+
+#include "perf_precomp.hpp"
+
+using namespace cv;
+using namespace cv::text;
+using namespace perf;
+
+/* binary masks of the letters of a word, as the OCRHMMDecoder cuts them */
+static void makeCharMasks(const std::string& word, std::vector<Mat>& masks)
+{
+    masks.clear();
+    for (size_t i = 0; i < word.size(); i++)
+    {
+        Mat canvas = Mat::zeros(60, 60, CV_8UC1);
+        putText(canvas, word.substr(i, 1), Point(10, 45), FONT_HERSHEY_SIMPLEX, 1.5, Scalar(255), 3);
+        std::vector< std::vector<Point> > contours;
+        Mat tmp = canvas.clone();
+        findContours(tmp, contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
+        Rect bbox;
+        for (size_t c = 0; c < contours.size(); c++)
+            bbox = bbox | boundingRect(contours[c]);
+        masks.push_back(canvas(bbox).clone());
+    }
+}
+
+typedef perf::TestBaseWithParam<int> OCRHMMCache;
+
+PERF_TEST_P(OCRHMMCache, classify_word, testing::Values(0, 256))
+{
+    std::string model = getDataPath("text_data/OCRHMM_knn_model_data.xml.gz");
+    Ptr<OCRHMMDecoder::ClassifierCallback> classifier = loadOCRHMMClassifierNM(model, GetParam());
+
+    std::vector<Mat> masks;
+    makeCharMasks("OpenCVText2015", masks);
+
+    /* the batch gives what the letters give one by one */
+    std::vector< std::vector<int> > classes;
+    std::vector< std::vector<double> > confidences;
+    classifier->eval(masks, classes, confidences);
+    ASSERT_EQ(masks.size(), classes.size());
+    for (size_t i = 0; i < masks.size(); i++)
+    {
+        std::vector<int> out_class;
+        std::vector<double> out_confidence;
+        classifier->eval(masks[i], out_class, out_confidence);
+        EXPECT_TRUE(out_class == classes[i]) << "letter " << i;
+        EXPECT_TRUE(out_confidence == confidences[i]) << "letter " << i;
+    }
+
+    TEST_CYCLE()
+    {
+        classifier->eval(masks, classes, confidences);
+    }
+
+    SANITY_CHECK_NOTHING();
+}
+
+typedef perf::TestBaseWithParam<int> OCRHMMMode;
+
+PERF_TEST_P(OCRHMMMode, decode_words, testing::Values((int)OCR_DECODER_VITERBI, (int)OCR_DECODER_VITERBI_BEAM))
+{
+    std::string model = getDataPath("text_data/OCRHMM_knn_model_data.xml.gz");
+    FileStorage fs(getDataPath("text_data/OCRHMM_transitions_table.xml"), FileStorage::READ);
+    Mat transition_p;
+    fs["transition_probabilities"] >> transition_p;
+    fs.release();
+    Mat emission_p = Mat::eye(62, 62, CV_64FC1);
+    std::string voc = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+
+    Ptr<OCRHMMDecoder> decoder = OCRHMMDecoder::create(loadOCRHMMClassifierNM(model), voc, transition_p, emission_p,
+                                                       (decoder_mode)GetParam(), 8);
+
+    /* a text line of white words over black, as the detection masks */
+    const char* words[] = { "scene", "text", "OpenCV", "decoder", "Viterbi", "beam" };
+    const int num_words = (int)(sizeof(words) / sizeof(words[0]));
+    std::vector<Mat> lines;
+    for (int i = 0; i < num_words; i++)
+    {
+        Mat line = Mat::zeros(60, 300, CV_8UC1);
+        putText(line, words[i], Point(10, 45), FONT_HERSHEY_SIMPLEX, 1.5, Scalar(255), 3);
+        lines.push_back(line);
+    }
+
+    std::string output;
+    int iterations = 0;
+    int64 start = getTickCount();
+    TEST_CYCLE()
+    {
+        for (int i = 0; i < num_words; i++)
+            decoder->run(lines[i], output, NULL, NULL, NULL, OCR_LEVEL_WORD);
+        iterations++;
+    }
+    double seconds = (getTickCount() - start) / getTickFrequency();
+    if (seconds > 0)
+        RecordProperty("words_per_sec", cvRound(iterations * num_words / seconds));
+
+    EXPECT_FALSE(output.empty());
+
+    SANITY_CHECK_NOTHING();
+}
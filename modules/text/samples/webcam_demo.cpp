@@ -140,7 +140,8 @@ int main(int argc, char* argv[])
     vector< Ptr<OCRHMMDecoder> > decoders;
     for (int o=0; o<num_ocrs; o++)
     {
-      decoders.push_back(OCRHMMDecoder::create(loadOCRHMMClassifierNM("OCRHMM_knn_model_data.xml.gz"),
+      // glyphs repeat a lot from frame to frame, let the classifier cache them
+      decoders.push_back(OCRHMMDecoder::create(loadOCRHMMClassifierNM("OCRHMM_knn_model_data.xml.gz", 4096),
                                                voc, transition_p, emission_p));
     }
     cout << " Done!" << endl;
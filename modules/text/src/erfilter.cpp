@@ -45,7 +45,6 @@
 #include "opencv2/ml.hpp"
 #include <limits>
 #include <fstream>
-#include <queue>
 
 #if defined _MSC_VER && _MSC_VER == 1500
     typedef int int_fast32_t;
@@ -65,27 +64,6 @@ using namespace cv::ml;
 using namespace std;
 using namespace cv::ml;
 
-// Deletes a tree of ERStat regions starting at root. Used only
-// internally to this implementation.
-static void deleteERStatTree(ERStat* root) {
-    queue<ERStat*> to_delete;
-    to_delete.push(root);
-    while (!to_delete.empty()) {
-        ERStat* n = to_delete.front();
-        to_delete.pop();
-        ERStat* c = n->child;
-        if (c != NULL) {
-            to_delete.push(c);
-            ERStat* sibling = c->next;
-            while (sibling != NULL) {
-                to_delete.push(sibling);
-                sibling = sibling->next;
-            }
-        }
-        delete n;
-    }
-}
-
 ERStat::ERStat(int init_level, int init_pixel, int init_x, int init_y) : pixel(init_pixel),
                level(init_level), area(0), perimeter(0), euler(0), probability(1.0),
                parent(0), child(0), next(0), prev(0), local_maxima(0),
@@ -104,6 +82,114 @@ ERStat::ERStat(int init_level, int init_pixel, int init_x, int init_y) : pixel(i
 
 // derivative classes
 
+// Pool of the ERStat nodes of the component tree built by er_tree_extract. Nodes are placed
+// in fixed-size blocks, addressed by their int position, so their addresses never change; the
+// blocks and the crossings deques are kept between runs, and clear() takes all of them back at
+// once instead of walking the tree to delete it.
+class ERStatPool
+{
+public:
+    ERStatPool() : num_used(0)
+    {
+        // the constructor allocates crossings, the prototype does not keep them
+        delete prototype.crossings;
+        prototype.crossings = NULL;
+        prototype.pixels = NULL;
+        prototype.med_crossings = 0.f;
+        prototype.hole_area_ratio = 0.f;
+        prototype.convex_hull_ratio = 0.f;
+        prototype.num_inflexion_points = 0.f;
+    }
+
+    ~ERStatPool()
+    {
+        for (size_t b=0; b<blocks.size(); b++)
+            fastFree(blocks[b]);
+        for (size_t c=0; c<all_crossings.size(); c++)
+            delete all_crossings[c];
+    }
+
+    // the same as new ERStat(level, pixel, x, y)
+    ERStat* create(int level, int pixel, int x, int y)
+    {
+        ERStat *er;
+        if (!free_nodes.empty())
+        {
+            er = free_nodes.back();
+            free_nodes.pop_back();
+        }
+        else
+        {
+            if (num_used == (int)blocks.size()*BLOCK_SIZE)
+                blocks.push_back((ERStat*)fastMalloc(BLOCK_SIZE*sizeof(ERStat)));
+            er = blocks[num_used/BLOCK_SIZE] + num_used%BLOCK_SIZE;
+            num_used++;
+        }
+
+        new (er) ERStat(prototype);
+        er->level = level;
+        er->pixel = pixel;
+        er->rect = Rect(x,y,1,1);
+        er->crossings = createCrossings();
+        er->crossings->push_back(0);
+        return er;
+    }
+
+    // give back a node (and its crossings) that is no longer in the tree
+    void release(ERStat *er)
+    {
+        releaseCrossings(er->crossings);
+        er->crossings = NULL;
+        free_nodes.push_back(er);
+    }
+
+    deque<int>* createCrossings()
+    {
+        if (free_crossings.empty())
+        {
+            all_crossings.push_back(new deque<int>());
+            return all_crossings.back();
+        }
+        deque<int> *crossings = free_crossings.back();
+        free_crossings.pop_back();
+        return crossings;
+    }
+
+    void releaseCrossings(deque<int> *crossings)
+    {
+        if (crossings == NULL)
+            return;
+        crossings->clear();
+        free_crossings.push_back(crossings);
+    }
+
+    // give back all the nodes, keeping their memory for the next tree
+    void clear()
+    {
+        num_used = 0;
+        free_nodes.clear();
+        free_crossings.clear();
+        for (size_t c=0; c<all_crossings.size(); c++)
+        {
+            all_crossings[c]->clear();
+            free_crossings.push_back(all_crossings[c]);
+        }
+    }
+
+private:
+    enum { BLOCK_SIZE = 4096 };
+
+    ERStat prototype;
+    vector<ERStat*> blocks;
+    int num_used;
+    vector<ERStat*> free_nodes;
+    vector<deque<int>*> all_crossings;
+    vector<deque<int>*> free_crossings;
+
+    ERStatPool(const ERStatPool&);
+    ERStatPool& operator=(const ERStatPool&);
+};
+
 
 // the classe implementing the interface for the 1st and 2nd stages of Neumann and Matas algorithm
 class CV_EXPORTS ERFilterNM : public ERFilter
@@ -122,6 +208,9 @@ public:
     // input/output - for the second one.
     void run( InputArray image, vector<ERStat>& regions );
 
+    // the same for several channels, processed in parallel by copies of this filter
+    void run( InputArrayOfArrays channels, vector< vector<ERStat> >& regions );
+
 protected:
     int thresholdDelta;
     float maxArea;
@@ -150,6 +239,8 @@ private:
     vector<ERStat> *regions;
     // image mask used for feature calculations
     Mat region_mask;
+    // nodes of the component tree being extracted
+    ERStatPool er_pool;
 
     // extract the component tree and store all the ER regions
     void er_tree_extract( InputArray image );
@@ -161,10 +252,12 @@ private:
     void er_merge( ERStat *parent, ERStat *child );
     // copy extracted regions into the output vector
     ERStat* er_save( ERStat *er, ERStat *parent, ERStat *prev );
-    // recursively walk the tree and filter (remove) regions using the callback classifier
-    ERStat* er_tree_filter( InputArray image, ERStat *stat, ERStat *parent, ERStat *prev );
-    // recursively walk the tree selecting only regions with local maxima probability
-    ERStat* er_tree_nonmax_suppression( ERStat *er, ERStat *parent, ERStat *prev );
+    // walk the tree and filter (remove) regions using the callback classifier
+    void er_tree_filter( InputArray image, ERStat *root );
+    // walk the tree selecting only regions with local maxima probability
+    void er_tree_nonmax_suppression( ERStat *root );
+    // copy the selected regions of a flattened tree into the output vector
+    void er_tree_copy( const vector<ERStat*> &order, const vector<int> &parents, const vector<char> &keep );
 };
 
 
@@ -180,6 +273,9 @@ public:
     // The classifier must return probability measure for the region.
     double eval(const ERStat& stat);
 
+    // copies share the model, prediction does not modify it
+    Ptr<ERFilter::Callback> clone() const { return makePtr<ERClassifierNM1>(*this); }
+
 private:
     Ptr<Boost> boost;
 };
@@ -196,6 +292,9 @@ public:
     // The classifier must return probability measure for the region.
     double eval(const ERStat& stat);
 
+    // copies share the model, prediction does not modify it
+    Ptr<ERFilter::Callback> clone() const { return makePtr<ERClassifierNM2>(*this); }
+
 private:
     Ptr<Boost> boost;
 };
@@ -237,7 +336,7 @@ void ERFilterNM::run( InputArray image, vector<ERStat>& _regions )
             vector<ERStat> aux_regions;
             regions->swap(aux_regions);
             regions->reserve(aux_regions.size());
-            er_tree_nonmax_suppression( &aux_regions.front(), NULL, NULL );
+            er_tree_nonmax_suppression( &aux_regions.front() );
             aux_regions.clear();
         }
     }
@@ -249,11 +348,85 @@ void ERFilterNM::run( InputArray image, vector<ERStat>& _regions )
         vector<ERStat> aux_regions;
         regions->swap(aux_regions);
         regions->reserve(aux_regions.size());
-        er_tree_filter( image, &aux_regions.front(), NULL, NULL );
+        er_tree_filter( image, &aux_regions.front() );
         aux_regions.clear();
     }
 }
 
+// run the default implementation sequentially over the channels
+void ERFilter::run( InputArrayOfArrays _channels, vector< vector<ERStat> >& _regions )
+{
+    vector<Mat> channels;
+    _channels.getMatVector(channels);
+    _regions.resize(channels.size());
+
+    for (size_t c=0; c<channels.size(); c++)
+        run(channels[c], _regions[c]);
+}
+
+// every channel is filtered by its own ERFilterNM, so they can run concurrently
+class ERFilterNMChannelsInvoker : public ParallelLoopBody
+{
+public:
+    ERFilterNMChannelsInvoker(vector< Ptr<ERFilterNM> > &_filters, vector<Mat> &_channels,
+                              vector< vector<ERStat> > &_regions) :
+        filters(&_filters), channels(&_channels), regions(&_regions) {}
+
+    void operator()(const Range& range) const
+    {
+        for (int c = range.start; c < range.end; c++)
+            (*filters)[c]->run((*channels)[c], (*regions)[c]);
+    }
+
+private:
+    vector< Ptr<ERFilterNM> > *filters;
+    vector<Mat> *channels;
+    vector< vector<ERStat> > *regions;
+};
+
+void ERFilterNM::run( InputArrayOfArrays _channels, vector< vector<ERStat> >& _regions )
+{
+    vector<Mat> channels;
+    _channels.getMatVector(channels);
+    _regions.resize(channels.size());
+
+    // a copy of the filter for every channel, each one with a clone of the classifier;
+    // a classifier that can not be cloned may not be thread-safe, so it is not shared
+    vector< Ptr<ERFilterNM> > filters(channels.size());
+    for (size_t c=0; c<channels.size(); c++)
+    {
+        CV_Assert( channels[c].type() == CV_8UC1 );
+
+        Ptr<ERFilter::Callback> cb;
+        if (!classifier.empty())
+            cb = classifier->clone();
+        if (cb.empty())
+        {
+            for (size_t i=0; i<channels.size(); i++)
+                run(channels[i], _regions[i]);
+            return;
+        }
+
+        filters[c] = makePtr<ERFilterNM>();
+        filters[c]->classifier = cb;
+        filters[c]->thresholdDelta = thresholdDelta;
+        filters[c]->minArea = minArea;
+        filters[c]->maxArea = maxArea;
+        filters[c]->minProbability = minProbability;
+        filters[c]->minProbabilityDiff = minProbabilityDiff;
+        filters[c]->nonMaxSuppression = nonMaxSuppression;
+    }
+
+    parallel_for_(Range(0, (int)channels.size()), ERFilterNMChannelsInvoker(filters, channels, _regions));
+
+    // counters as if the channels were processed by this filter
+    for (size_t c=0; c<filters.size(); c++)
+    {
+        num_accepted_regions += filters[c]->num_accepted_regions;
+        num_rejected_regions += filters[c]->num_rejected_regions;
+    }
+}
+
 // extract the component tree and store all the ER regions
 // uses the algorithm described in
 // Linear time maximally stable extremal regions, D Nistér, H Stewénius – ECCV 2008
@@ -303,7 +476,7 @@ void ERFilterNM::er_tree_extract( InputArray image )
     vector<int> boundary_edges[256];
 
     // add a dummy-component before start
-    er_stack.push_back(new ERStat);
+    er_stack.push_back(er_pool.create(256, 0, 0, 0));
 
     // we'll look initially for all pixels with grey-level lower than a grey-level higher than any allowed in the image
     int threshold_level = (255/thresholdDelta)+1;
@@ -323,7 +496,7 @@ void ERFilterNM::er_tree_extract( InputArray image )
 
         // push a component with current level in the component stack
         if (push_new_component)
-            er_stack.push_back(new ERStat(current_level, current_pixel, x, y));
+            er_stack.push_back(er_pool.create(current_level, current_pixel, x, y));
         push_new_component = false;
 
         // explore the (remaining) edges to the neighbors to the current pixel
@@ -520,19 +693,9 @@ void ERFilterNM::er_tree_extract( InputArray image )
             regions->reserve(num_accepted_regions+1);
             er_save(er_stack.back(), NULL, NULL);
 
-            // clean memory
-            for (size_t r=0; r<er_stack.size(); r++)
-            {
-                ERStat *stat = er_stack.at(r);
-                if (stat->crossings)
-                {
-                    stat->crossings->clear();
-                    delete(stat->crossings);
-                    stat->crossings = NULL;
-                }
-                deleteERStatTree(stat);
-            }
+            // clean memory (the whole tree at once, the pool keeps it for the next run)
             er_stack.clear();
+            er_pool.clear();
 
             return;
         }
@@ -563,7 +726,7 @@ void ERFilterNM::er_tree_extract( InputArray image )
 
                 if (new_level < er_stack.back()->level)
                 {
-                    er_stack.push_back(new ERStat(new_level, current_pixel, current_pixel%width, current_pixel/width));
+                    er_stack.push_back(er_pool.create(new_level, current_pixel, current_pixel%width, current_pixel/width));
                     er_merge(er_stack.back(), er);
                     break;
                 }
@@ -665,8 +828,7 @@ void ERFilterNM::er_merge(ERStat *parent, ERStat *child)
     child->med_crossings = (float)m_crossings.at(1);
 
     // free unnecessary mem
-    child->crossings->clear();
-    delete(child->crossings);
+    er_pool.releaseCrossings(child->crossings);
     child->crossings = NULL;
 
     // recover the original grey-level
@@ -712,13 +874,7 @@ void ERFilterNM::er_merge(ERStat *parent, ERStat *child)
         }
 
         // free mem
-        if(child->crossings)
-        {
-            child->crossings->clear();
-            delete(child->crossings);
-            child->crossings = NULL;
-        }
-        delete(child);
+        er_pool.release(child);
     }
 
 }
@@ -729,7 +885,10 @@ ERStat* ERFilterNM::er_save( ERStat *er, ERStat *parent, ERStat *prev )
 
     regions->push_back(*er);
 
+    // the crossings of the root stay in the pool
+    regions->back().crossings = NULL;
     regions->back().parent = parent;
+    regions->back().prev = prev;
     if (prev != NULL)
     {
       prev->next = &(regions->back());
@@ -787,180 +946,234 @@ ERStat* ERFilterNM::er_save( ERStat *er, ERStat *parent, ERStat *prev )
     return this_er;
 }
 
-// recursively walk the tree and filter (remove) regions using the callback classifier
-ERStat* ERFilterNM::er_tree_filter ( InputArray image, ERStat * stat, ERStat *parent, ERStat *prev )
+// list the regions of the tree under root in the order the depth-first walk visits them
+// (children in child/next order), together with the position in the list of their parents
+static void er_tree_flatten( ERStat *root, vector<ERStat*> &order, vector<int> &parents )
 {
-    Mat src = image.getMat();
-    // assert correct image type
-    CV_Assert( src.type() == CV_8UC1 );
-
-    //Fill the region and calculate 2nd stage features
-    Mat region = region_mask(Rect(Point(stat->rect.x,stat->rect.y),Point(stat->rect.br().x+2,stat->rect.br().y+2)));
-    region = Scalar(0);
-    int newMaskVal = 255;
-    int flags = 4 + (newMaskVal << 8) + FLOODFILL_FIXED_RANGE + FLOODFILL_MASK_ONLY;
-    Rect rect;
+    order.clear();
+    parents.clear();
 
-    floodFill( src(Rect(Point(stat->rect.x,stat->rect.y),Point(stat->rect.br().x,stat->rect.br().y))),
-               region, Point(stat->pixel%src.cols - stat->rect.x, stat->pixel/src.cols - stat->rect.y),
-               Scalar(255), &rect, Scalar(stat->level), Scalar(0), flags );
-    rect.width += 2;
-    rect.height += 2;
-    region = region(rect);
+    vector< pair<ERStat*,int> > pending;
+    pending.push_back(make_pair(root, -1));
+    while (!pending.empty())
+    {
+        ERStat *stat = pending.back().first;
+        int parent = pending.back().second;
+        pending.pop_back();
+
+        int index = (int)order.size();
+        order.push_back(stat);
+        parents.push_back(parent);
+
+        // siblings wait until the whole subtree has been listed
+        if ((stat->next != NULL) && (parent != -1))
+            pending.push_back(make_pair(stat->next, parent));
+        if (stat->child != NULL)
+            pending.push_back(make_pair(stat->child, index));
+    }
+}
 
-    vector<vector<Point> > contours;
-    vector<Point> contour_poly;
-    vector<Vec4i> hierarchy;
-    findContours( region, contours, hierarchy, RETR_TREE, CHAIN_APPROX_NONE, Point(0, 0) );
-    //TODO check epsilon parameter of approxPolyDP (set empirically) : we want more precission
-    //     if the region is very small because otherwise we'll loose all the convexities
-    approxPolyDP( Mat(contours[0]), contour_poly, (float)min(rect.width,rect.height)/17, true );
+// copy the listed regions selected in keep into the output vector, each one becoming a child of
+// the copy of its closest selected ancestor; links are set once all the copies are in place
+void ERFilterNM::er_tree_copy( const vector<ERStat*> &order, const vector<int> &parents, const vector<char> &keep )
+{
+    int num_regions = (int)order.size();
 
-    bool was_convex = false;
-    int  num_inflexion_points = 0;
+    // position in regions of the copy of a region, or of the copy of its closest selected ancestor
+    vector<int> copy_of(num_regions, -1);
+    // position in regions of the parent of every copy
+    vector<int> copy_parent;
 
-    for (int p = 0 ; p<(int)contour_poly.size(); p++)
+    for (int i=0; i<num_regions; i++)
     {
-        int p_prev = p-1;
-        int p_next = p+1;
-        if (p_prev == -1)
-            p_prev = (int)contour_poly.size()-1;
-        if (p_next == (int)contour_poly.size())
-            p_next = 0;
-
-        double angle_next = atan2((double)(contour_poly[p_next].y-contour_poly[p].y),
-                                  (double)(contour_poly[p_next].x-contour_poly[p].x));
-        double angle_prev = atan2((double)(contour_poly[p_prev].y-contour_poly[p].y),
-                                  (double)(contour_poly[p_prev].x-contour_poly[p].x));
-        if ( angle_next < 0 )
-            angle_next = 2.*CV_PI + angle_next;
-
-        double angle = (angle_next - angle_prev);
-        if (angle > 2.*CV_PI)
-            angle = angle - 2.*CV_PI;
-        else if (angle < 0)
-            angle = 2.*CV_PI + abs(angle);
-
-        if (p>0)
+        int parent = (parents[i] < 0) ? -1 : copy_of[parents[i]];
+        if (keep[i])
         {
-            if ( ((angle > CV_PI)&&(!was_convex)) || ((angle < CV_PI)&&(was_convex)) )
-                num_inflexion_points++;
+            copy_of[i] = (int)regions->size();
+            copy_parent.push_back(parent);
+            regions->push_back(*order[i]);
+        }
+        else
+        {
+            copy_of[i] = parent;
         }
-        was_convex = (angle > CV_PI);
-
     }
 
-    floodFill(region, Point(0,0), Scalar(255), 0);
-    int holes_area = region.cols*region.rows-countNonZero(region);
-
-    int hull_area = 0;
-
+    vector<int> last_child(regions->size(), -1);
+    for (int j=0; j<(int)regions->size(); j++)
     {
+        ERStat *this_er = &(*regions)[j];
+        int parent = copy_parent[j];
 
-        vector<Point> hull;
-        convexHull(contours[0], hull, false);
-        hull_area = (int)contourArea(hull);
-    }
+        this_er->parent = (parent < 0) ? NULL : &(*regions)[parent];
+        this_er->child  = NULL;
+        this_er->next   = NULL;
+        this_er->prev   = NULL;
 
+        if (parent >= 0)
+        {
+            if (last_child[parent] >= 0)
+            {
+                this_er->prev = &(*regions)[last_child[parent]];
+                this_er->prev->next = this_er;
+            }
+            else
+            {
+                (*regions)[parent].child = this_er;
+            }
+            last_child[parent] = j;
+        }
+    }
+}
 
-    stat->hole_area_ratio = (float)holes_area / stat->area;
-    stat->convex_hull_ratio = (float)hull_area / (float)contourArea(contours[0]);
-    stat->num_inflexion_points = (float)num_inflexion_points;
+// walk the tree and filter (remove) regions using the callback classifier
+void ERFilterNM::er_tree_filter ( InputArray image, ERStat * root )
+{
+    Mat src = image.getMat();
+    // assert correct image type
+    CV_Assert( src.type() == CV_8UC1 );
 
+    // the regions are processed in the order of a depth-first walk
+    vector<ERStat*> order;
+    vector<int> parents;
+    er_tree_flatten(root, order, parents);
+    vector<char> keep(order.size(), 0);
 
-    // calculate P(child|character) and filter if possible
-    if ( (classifier != NULL) && (stat->parent != NULL) )
+    // region_mask is all zeros between regions, every region clears what it has written
+    for (size_t i=0; i<order.size(); i++)
     {
-        stat->probability = classifier->eval(*stat);
-    }
+        ERStat *stat = order[i];
 
-    if ( ( ((classifier != NULL)?(stat->probability >= minProbability):true) &&
-          ((stat->area >= minArea*region_mask.rows*region_mask.cols) &&
-           (stat->area <= maxArea*region_mask.rows*region_mask.cols)) ) ||
-        (stat->parent == NULL) )
-    {
+        // the root is always kept and never classified, its features are not needed
+        if (stat->parent == NULL)
+        {
+            num_accepted_regions++;
+            keep[i] = 1;
+            continue;
+        }
 
-        num_accepted_regions++;
-        regions->push_back(*stat);
+        //Fill the region and calculate 2nd stage features
+        Mat er_window = region_mask(Rect(Point(stat->rect.x,stat->rect.y),Point(stat->rect.br().x+2,stat->rect.br().y+2)));
+        Mat region = er_window;
+        int newMaskVal = 255;
+        int flags = 4 + (newMaskVal << 8) + FLOODFILL_FIXED_RANGE + FLOODFILL_MASK_ONLY;
+        Rect rect;
+
+        floodFill( src(Rect(Point(stat->rect.x,stat->rect.y),Point(stat->rect.br().x,stat->rect.br().y))),
+                   region, Point(stat->pixel%src.cols - stat->rect.x, stat->pixel/src.cols - stat->rect.y),
+                   Scalar(255), &rect, Scalar(stat->level), Scalar(0), flags );
+        rect.width += 2;
+        rect.height += 2;
+        region = region(rect);
+
+        vector<vector<Point> > contours;
+        vector<Point> contour_poly;
+        vector<Vec4i> hierarchy;
+        findContours( region, contours, hierarchy, RETR_TREE, CHAIN_APPROX_NONE, Point(0, 0) );
+        //TODO check epsilon parameter of approxPolyDP (set empirically) : we want more precission
+        //     if the region is very small because otherwise we'll loose all the convexities
+        approxPolyDP( Mat(contours[0]), contour_poly, (float)min(rect.width,rect.height)/17, true );
+
+        bool was_convex = false;
+        int  num_inflexion_points = 0;
+
+        for (int p = 0 ; p<(int)contour_poly.size(); p++)
+        {
+            int p_prev = p-1;
+            int p_next = p+1;
+            if (p_prev == -1)
+                p_prev = (int)contour_poly.size()-1;
+            if (p_next == (int)contour_poly.size())
+                p_next = 0;
+
+            double angle_next = atan2((double)(contour_poly[p_next].y-contour_poly[p].y),
+                                      (double)(contour_poly[p_next].x-contour_poly[p].x));
+            double angle_prev = atan2((double)(contour_poly[p_prev].y-contour_poly[p].y),
+                                      (double)(contour_poly[p_prev].x-contour_poly[p].x));
+            if ( angle_next < 0 )
+                angle_next = 2.*CV_PI + angle_next;
+
+            double angle = (angle_next - angle_prev);
+            if (angle > 2.*CV_PI)
+                angle = angle - 2.*CV_PI;
+            else if (angle < 0)
+                angle = 2.*CV_PI + abs(angle);
+
+            if (p>0)
+            {
+                if ( ((angle > CV_PI)&&(!was_convex)) || ((angle < CV_PI)&&(was_convex)) )
+                    num_inflexion_points++;
+            }
+            was_convex = (angle > CV_PI);
 
-        regions->back().parent = parent;
-        regions->back().next   = NULL;
-        regions->back().child  = NULL;
+        }
 
-        if (prev != NULL)
-            prev->next = &(regions->back());
-        else if (parent != NULL)
-            parent->child = &(regions->back());
+        floodFill(region, Point(0,0), Scalar(255), 0);
+        int holes_area = region.cols*region.rows-countNonZero(region);
 
-        ERStat *old_prev = NULL;
-        ERStat *this_er  = &regions->back();
+        int hull_area = 0;
 
-        for (ERStat * child = stat->child; child; child = child->next)
         {
-            old_prev = er_tree_filter(image, child, this_er, old_prev);
+
+            vector<Point> hull;
+            convexHull(contours[0], hull, false);
+            hull_area = (int)contourArea(hull);
         }
 
-        return this_er;
 
-    } else {
+        stat->hole_area_ratio = (float)holes_area / stat->area;
+        stat->convex_hull_ratio = (float)hull_area / (float)contourArea(contours[0]);
+        stat->num_inflexion_points = (float)num_inflexion_points;
 
-        num_rejected_regions++;
+        // clear the filled pixels and the border floodFill has drawn around the region window,
+        // instead of clearing the whole window of the next region
+        region = Scalar(0);
+        er_window.row(0) = Scalar(0);
+        er_window.row(er_window.rows-1) = Scalar(0);
+        er_window.col(0) = Scalar(0);
+        er_window.col(er_window.cols-1) = Scalar(0);
 
-        ERStat *old_prev = prev;
 
-        for (ERStat * child = stat->child; child; child = child->next)
+        // calculate P(child|character) and filter if possible
+        if (classifier != NULL)
         {
-            old_prev = er_tree_filter(image, child, parent, old_prev);
+            stat->probability = classifier->eval(*stat);
         }
 
-        return old_prev;
+        if ( ((classifier != NULL)?(stat->probability >= minProbability):true) &&
+             ((stat->area >= minArea*region_mask.rows*region_mask.cols) &&
+              (stat->area <= maxArea*region_mask.rows*region_mask.cols)) )
+        {
+            num_accepted_regions++;
+            keep[i] = 1;
+        } else {
+            num_rejected_regions++;
+        }
     }
 
+    er_tree_copy(order, parents, keep);
 }
 
-// recursively walk the tree selecting only regions with local maxima probability
-ERStat* ERFilterNM::er_tree_nonmax_suppression ( ERStat * stat, ERStat *parent, ERStat *prev )
+// walk the tree selecting only regions with local maxima probability
+void ERFilterNM::er_tree_nonmax_suppression ( ERStat * root )
 {
+    vector<ERStat*> order;
+    vector<int> parents;
+    er_tree_flatten(root, order, parents);
+    vector<char> keep(order.size(), 0);
 
-    if ( ( stat->local_maxima ) || ( stat->parent == NULL ) )
+    for (size_t i=0; i<order.size(); i++)
     {
-
-        regions->push_back(*stat);
-
-        regions->back().parent = parent;
-        regions->back().next   = NULL;
-        regions->back().child  = NULL;
-
-        if (prev != NULL)
-            prev->next = &(regions->back());
-        else if (parent != NULL)
-            parent->child = &(regions->back());
-
-        ERStat *old_prev = NULL;
-        ERStat *this_er  = &regions->back();
-
-        for (ERStat * child = stat->child; child; child = child->next)
-        {
-            old_prev = er_tree_nonmax_suppression( child, this_er, old_prev );
-        }
-
-        return this_er;
-
-    } else {
-
-        num_rejected_regions++;
-        num_accepted_regions--;
-
-        ERStat *old_prev = prev;
-
-        for (ERStat * child = stat->child; child; child = child->next)
+        if ( ( order[i]->local_maxima ) || ( order[i]->parent == NULL ) )
         {
-            old_prev = er_tree_nonmax_suppression( child, parent, old_prev );
+            keep[i] = 1;
+        } else {
+            num_rejected_regions++;
+            num_accepted_regions--;
         }
-
-        return old_prev;
     }
 
+    er_tree_copy(order, parents, keep);
 }
 
 void ERFilterNM::setCallback(const Ptr<ERFilter::Callback>& cb)
@@ -1038,10 +1251,12 @@ ERClassifierNM1::ERClassifierNM1(const string& filename)
 double ERClassifierNM1::eval(const ERStat& stat)
 {
     //Classify
-    Mat sample = (Mat_<float>(1,4) <<  (float)(stat.rect.width)/(stat.rect.height), // aspect ratio
-                     sqrt((float)(stat.area))/stat.perimeter, // compactness
-                     (float)(1-stat.euler), //number of holes
-                     stat.med_crossings);
+    // called for every region of the tree, so the sample is not allocated
+    float features[4] = { (float)(stat.rect.width)/(stat.rect.height), // aspect ratio
+                          sqrt((float)(stat.area))/stat.perimeter, // compactness
+                          (float)(1-stat.euler), //number of holes
+                          stat.med_crossings };
+    Mat sample(1, 4, CV_32F, features);
 
     float votes = boost->predict( sample, noArray(), DTrees::PREDICT_SUM | StatModel::RAW_OUTPUT);
 
@@ -1069,11 +1284,12 @@ ERClassifierNM2::ERClassifierNM2(const string& filename)
 double ERClassifierNM2::eval(const ERStat& stat)
 {
     //Classify
-    Mat sample = (Mat_<float>(1,7) << (float)(stat.rect.width)/(stat.rect.height), // aspect ratio
-                     sqrt((float)(stat.area))/stat.perimeter, // compactness
-                     (float)(1-stat.euler), //number of holes
-                     stat.med_crossings, stat.hole_area_ratio,
-                     stat.convex_hull_ratio, stat.num_inflexion_points);
+    float features[7] = { (float)(stat.rect.width)/(stat.rect.height), // aspect ratio
+                          sqrt((float)(stat.area))/stat.perimeter, // compactness
+                          (float)(1-stat.euler), //number of holes
+                          stat.med_crossings, stat.hole_area_ratio,
+                          stat.convex_hull_ratio, stat.num_inflexion_points };
+    Mat sample(1, 7, CV_32F, features);
 
     float votes = boost->predict( sample, noArray(), DTrees::PREDICT_SUM | StatModel::RAW_OUTPUT);
 
@@ -1188,6 +1404,8 @@ public:
 
     // The classifier must return probability measure for the region.
     double eval(const ERStat& s) {if (s.area ==0) return (double)0.0; return (double)1.0;}
+
+    Ptr<ERFilter::Callback> clone() const { return makePtr<ERDummyClassifier>(); }
 };
 
 /* Create a dummy classifier that accepts all regions */
@@ -1476,6 +1694,9 @@ public:
     // copies p to the internal point set
     void check_in (vector<float> *p);
 
+    // copies the point set of another box
+    void check_in (const Minibox &b);
+
     // returns the volume of the box
     long double volume();
 };
@@ -1500,6 +1721,23 @@ void Minibox::check_in (vector<float> *p)
     }
 }
 
+void Minibox::check_in (const Minibox &b)
+{
+    if (!b.initialized)
+        return;
+    if (!initialized)
+    {
+        edge_begin = b.edge_begin;
+        edge_end = b.edge_end;
+        initialized = true;
+    }
+    else for (int i=0; i<(int)edge_begin.size(); i++)
+    {
+        edge_begin.at(i) = min(b.edge_begin.at(i),edge_begin.at(i));
+        edge_end.at(i) = max(b.edge_end.at(i),edge_end.at(i));
+    }
+}
+
 long double Minibox::volume ()
 {
     long double volume_ = 1;
@@ -1923,6 +2161,113 @@ static void MST_linkage_core_vector(const int_fast32_t N,
     }
 }
 
+/*
+   Distance updates of one step of MST_linkage_core_sqeuclidean:
+   each stripe of the active nodes is relaxed against the last node taken
+   into the tree and reports its own nearest node.
+*/
+class MSTStepInvoker : public ParallelLoopBody
+{
+public:
+    MSTStepInvoker(const float *_X, int _dim, int _prev_node, const int *_active, int _count, int _nstripes,
+                   float *_d, float *_stripe_min, int *_stripe_idx)
+                   : X(_X), dim(_dim), prev_node(_prev_node), active(_active), count(_count), nstripes(_nstripes),
+                     d(_d), stripe_min(_stripe_min), stripe_idx(_stripe_idx) {}
+
+    void operator()(const Range& r) const
+    {
+        const float *P = X + (size_t)prev_node*dim;
+        for (int s = r.start; s < r.end; s++)
+        {
+            int begin = (int)((int64)count*s/nstripes);
+            int end = (int)((int64)count*(s+1)/nstripes);
+            float min_d = std::numeric_limits<float>::infinity();
+            int min_idx = -1;
+            for (int k = begin; k < end; k++)
+            {
+                int i = active[k];
+                const float *Q = X + (size_t)i*dim;
+                float sum = 0.f;
+                for (int n = 0; n < dim; n++)
+                {
+                    float diff = Q[n] - P[n];
+                    sum += diff*diff;
+                }
+                if (d[i] > sum)
+                    d[i] = sum;
+                if (d[i] < min_d)
+                {
+                    min_d = d[i];
+                    min_idx = k;
+                }
+            }
+            stripe_min[s] = min_d;
+            stripe_idx[s] = min_idx;
+        }
+    }
+
+private:
+    const float *X;
+    int dim;
+    int prev_node;
+    const int *active;
+    int count;
+    int nstripes;
+    float *d;
+    float *stripe_min;
+    int *stripe_idx;
+};
+
+/*
+     Single linkage MST (Prim) for squared euclidean distances on float samples.
+
+     Same spanning tree as MST_linkage_core_vector, but the active nodes are kept in a
+     compact array (in index order, so ties are broken as before) and the distance
+     updates are split in stripes that run in parallel once there are enough nodes.
+     Memory stays O(N*dim).
+
+     N: integer, number of data points
+     X: N*dim samples
+     Z2: output data structure
+*/
+static void MST_linkage_core_sqeuclidean(const int_fast32_t N, const float *X, int dim, cluster_result & Z2)
+{
+    const int min_stripe_size = 1024;
+    int max_stripes = std::max(1, getNumThreads());
+
+    vector<int> active((size_t)N);
+    vector<float> d((size_t)N, std::numeric_limits<float>::infinity());
+    vector<float> stripe_min(max_stripes);
+    vector<int> stripe_idx(max_stripes);
+    for (int i = 0; i < (int)N; i++)
+        active[i] = i;
+
+    int prev_node = 0;
+    for (int_fast32_t j = 0; j < N-1; j++)
+    {
+        // take prev_node out of the active set, keeping the index order
+        active.erase(std::lower_bound(active.begin(), active.end(), prev_node));
+
+        int count = (int)active.size();
+        int nstripes = std::min(max_stripes, std::max(1, count/min_stripe_size));
+        MSTStepInvoker step(X, dim, prev_node, &active[0], count, nstripes, &d[0], &stripe_min[0], &stripe_idx[0]);
+        if (nstripes > 1)
+            parallel_for_(Range(0, nstripes), step);
+        else
+            step(Range(0, 1));
+
+        // first stripe wins on ties, as the sequential scan would do
+        int best = -1;
+        for (int s = 0; s < nstripes; s++)
+            if (stripe_idx[s] >= 0 && (best < 0 || stripe_min[s] < stripe_min[best]))
+                best = s;
+        int idx2 = (best < 0) ? active[0] : active[stripe_idx[best]];
+
+        Z2.append(prev_node, idx2, (double)d[idx2]);
+        prev_node = idx2;
+    }
+}
+
 class linkage_output {
 private:
     double * Z;
@@ -2138,7 +2483,7 @@ private:
 };
 
 /*Clustering for the "stored data approach": the input are points in a vector space.*/
-static int linkage_vector(double *X, int N, int dim, double * Z, unsigned char method, unsigned char metric)
+static int linkage_vector(float *X, int N, int dim, double * Z, unsigned char method, unsigned char metric)
 {
 
     CV_Assert(N >=1);
@@ -2148,10 +2493,19 @@ static int linkage_vector(double *X, int N, int dim, double * Z, unsigned char m
     try
     {
         cluster_result Z2(N-1);
-        auto_array_ptr<int_fast32_t> members;
-        dissimilarity dist(X, N, dim, members, method, metric, false);
-        MST_linkage_core_vector(N, dist, Z2);
-        dist.postprocess(Z2);
+        if ((method == METHOD_METR_SINGLE) &&
+            ((metric == METRIC_SEUCLIDEAN) || (metric == METRIC_SQEUCLIDEAN)))
+        {
+            MST_linkage_core_sqeuclidean(N, X, dim, Z2);
+        }
+        else
+        {
+            vector<double> Xd(X, X + (size_t)N*dim);
+            auto_array_ptr<int_fast32_t> members;
+            dissimilarity dist(&Xd[0], N, dim, members, method, metric, false);
+            MST_linkage_core_vector(N, dist, Z2);
+            dist.postprocess(Z2);
+        }
         generate_dendrogram(Z, Z2, N);
     } // try
     catch (const bad_alloc&)
@@ -2193,13 +2547,12 @@ struct ERFeatures
 
 struct HCluster{
     int num_elem;           // number of elements
-    vector<int> elements;   // elements (contour ID)
     int nfa;                // the number of false alarms for this merge
     float dist;             // distance of the merge
     float dist_ext;         // distamce where this merge will merge with another
     long double volume;     // volume of the bounding sphere (or bounding box)
     long double volume_ext; // volume of the sphere(or box) + envolvent empty space
-    vector<vector<float> > points; // nD points in this cluster
+    Minibox box;            // bounding box of the nD points in this cluster
     bool max_meaningful;    // is this merge max meaningul ?
     vector<int> max_in_branch; // otherwise which merges are the max_meaningful in this branch
     int min_nfa_in_branch;  // min nfa detected within the chilhood
@@ -2218,7 +2571,7 @@ public:
     MaxMeaningfulClustering(unsigned char _method, unsigned char _metric, vector<ERFeatures> &_regions,
                             Size _imsize, const string &filename, double _minProbability);
 
-    void operator()(double *data, unsigned int num, int dim, unsigned char method,
+    void operator()(float *data, unsigned int num, int dim, unsigned char method,
                     unsigned char metric, vector< vector<int> > *meaningful_clusters);
 
     MaxMeaningfulClustering & operator=(const MaxMeaningfulClustering &a);
@@ -2230,7 +2583,7 @@ private:
     Size imsize;
 
     /// Helper functions
-    void build_merge_info(double *dendogram, double *data, int num, int dim, bool use_full_merge_rule,
+    void build_merge_info(double *dendogram, float *data, int num, int dim, bool use_full_merge_rule,
                           vector<HCluster> *merge_info, vector< vector<int> > *meaningful_clusters);
 
     /// Calculate the Number of False Alarms
@@ -2262,7 +2615,7 @@ MaxMeaningfulClustering::MaxMeaningfulClustering(unsigned char _method, unsigned
 }
 
 
-void MaxMeaningfulClustering::operator()(double *data, unsigned int num, int dim, unsigned char method,
+void MaxMeaningfulClustering::operator()(float *data, unsigned int num, int dim, unsigned char method,
                                          unsigned char metric, vector< vector<int> > *meaningful_clusters)
 {
 
@@ -2279,12 +2632,46 @@ void MaxMeaningfulClustering::operator()(double *data, unsigned int num, int dim
     merge_info.clear();
 }
 
-void MaxMeaningfulClustering::build_merge_info(double *Z, double *X, int N, int dim,
+// appends the elements (contour IDs) below a dendrogram node, in the order they were merged
+static void dendrogram_elements(const vector<HCluster> &merge_info, int node, int N, vector<int> &elements)
+{
+    vector<int> pending(1, node);
+    while (!pending.empty())
+    {
+        int n = pending.back();
+        pending.pop_back();
+        if (n < N)
+        {
+            elements.push_back(n);
+        }
+        else
+        {
+            pending.push_back(merge_info[n-N].node2);
+            pending.push_back(merge_info[n-N].node1);
+        }
+    }
+}
+
+// hands the max_in_branch list of a merge over to its parent merge
+static void move_max_in_branch(HCluster &child, HCluster &parent)
+{
+    if (parent.max_in_branch.empty())
+        parent.max_in_branch.swap(child.max_in_branch);
+    else
+        parent.max_in_branch.insert(parent.max_in_branch.end(),
+                                    child.max_in_branch.begin(), child.max_in_branch.end());
+    vector<int>().swap(child.max_in_branch);
+}
+
+void MaxMeaningfulClustering::build_merge_info(double *Z, float *X, int N, int dim,
                                                bool use_full_merge_rule,
                                                vector<HCluster> *merge_info,
                                                vector< vector<int> > *meaningful_clusters)
 {
 
+    // the merges only keep their bounding box, the elements are read back from the dendrogram
+    merge_info->reserve(N-1);
+
     // walk the whole dendogram
     for (int i=0; i<(N-1)*4; i=i+4)
     {
@@ -2297,50 +2684,31 @@ void MaxMeaningfulClustering::build_merge_info(double *Z, double *X, int N, int
 
         if (node1<N)
         {
-            vector<float> point;
-            for (int n=0; n<dim; n++)
-                point.push_back((float)X[node1*dim+n]);
-            cluster.points.push_back(point);
-            cluster.elements.push_back((int)node1);
+            vector<float> point(X+node1*dim, X+(node1+1)*dim);
+            cluster.box.check_in(&point);
         }
         else
         {
-            for (int ii=0; ii<(int)merge_info->at(node1-N).points.size(); ii++)
-            {
-                cluster.points.push_back(merge_info->at(node1-N).points[ii]);
-                cluster.elements.push_back(merge_info->at(node1-N).elements[ii]);
-            }
+            cluster.box.check_in(merge_info->at(node1-N).box);
+            merge_info->at(node1-N).box = Minibox();
             //update the extended volume of node1 using the dist where this cluster merge with another
             merge_info->at(node1-N).dist_ext = dist;
         }
         if (node2<N)
         {
-            vector<float> point;
-            for (int n=0; n<dim; n++)
-                point.push_back((float)X[node2*dim+n]);
-            cluster.points.push_back(point);
-            cluster.elements.push_back((int)node2);
+            vector<float> point(X+node2*dim, X+(node2+1)*dim);
+            cluster.box.check_in(&point);
         }
         else
         {
-            for (int ii=0; ii<(int)merge_info->at(node2-N).points.size(); ii++)
-            {
-                cluster.points.push_back(merge_info->at(node2-N).points[ii]);
-                cluster.elements.push_back(merge_info->at(node2-N).elements[ii]);
-            }
-
+            cluster.box.check_in(merge_info->at(node2-N).box);
+            merge_info->at(node2-N).box = Minibox();
             //update the extended volume of node2 using the dist where this cluster merge with another
             merge_info->at(node2-N).dist_ext = dist;
         }
 
-        Minibox mb;
-        for (int ii=0; ii<(int)cluster.points.size(); ii++)
-        {
-            mb.check_in(&cluster.points.at(ii));
-        }
-
         cluster.dist   = dist;
-        cluster.volume = mb.volume();
+        cluster.volume = cluster.box.volume();
         if (cluster.volume >= 1)
             cluster.volume = 0.999999;
         if (cluster.volume == 0)
@@ -2364,13 +2732,24 @@ void MaxMeaningfulClustering::build_merge_info(double *Z, double *X, int N, int
 
     }
 
+    vector<int> elements;
     for (int i=0; i<(int)merge_info->size(); i++)
     {
 
         merge_info->at(i).nfa = nfa((float)merge_info->at(i).volume,
                                     merge_info->at(i).num_elem, N);
 
-        merge_info->at(i).probability = probability(merge_info->at(i).elements);
+        // probability() discards big groups anyway, do not collect their elements
+        if (merge_info->at(i).num_elem > MAX_GROUP_ELEMENTS)
+        {
+            merge_info->at(i).probability = 0.;
+        }
+        else
+        {
+            elements.clear();
+            dendrogram_elements(*merge_info, N+i, N, elements);
+            merge_info->at(i).probability = probability(elements);
+        }
         int node1 = merge_info->at(i).node1;
         int node2 = merge_info->at(i).node2;
 
@@ -2400,14 +2779,12 @@ void MaxMeaningfulClustering::build_merge_info(double *Z, double *X, int N, int
                         merge_info->at(merge_info->at(node1-N).max_in_branch.at(k)).max_meaningful = false;
                     for (int k =0; k<(int)merge_info->at(node2-N).max_in_branch.size(); k++)
                         merge_info->at(merge_info->at(node2-N).max_in_branch.at(k)).max_meaningful = false;
+                    vector<int>().swap(merge_info->at(node1-N).max_in_branch);
+                    vector<int>().swap(merge_info->at(node2-N).max_in_branch);
                 } else {
                     merge_info->at(i).max_meaningful = false;
-                    merge_info->at(i).max_in_branch.insert(merge_info->at(i).max_in_branch.end(),
-                                                           merge_info->at(node1-N).max_in_branch.begin(),
-                                                           merge_info->at(node1-N).max_in_branch.end());
-                    merge_info->at(i).max_in_branch.insert(merge_info->at(i).max_in_branch.end(),
-                                                           merge_info->at(node2-N).max_in_branch.begin(),
-                                                           merge_info->at(node2-N).max_in_branch.end());
+                    move_max_in_branch(merge_info->at(node1-N), merge_info->at(i));
+                    move_max_in_branch(merge_info->at(node2-N), merge_info->at(i));
 
                     if (merge_info->at(i).nfa < min(merge_info->at(node1-N).min_nfa_in_branch,
                                                     merge_info->at(node2-N).min_nfa_in_branch))
@@ -2431,11 +2808,10 @@ void MaxMeaningfulClustering::build_merge_info(double *Z, double *X, int N, int
                         merge_info->at(i).min_nfa_in_branch = merge_info->at(i).nfa;
                         for (int k =0; k<(int)merge_info->at(node1-N).max_in_branch.size(); k++)
                             merge_info->at(merge_info->at(node1-N).max_in_branch.at(k)).max_meaningful = false;
+                        vector<int>().swap(merge_info->at(node1-N).max_in_branch);
                     } else {
                         merge_info->at(i).max_meaningful = false;
-                        merge_info->at(i).max_in_branch.insert(merge_info->at(i).max_in_branch.end(),
-                                                               merge_info->at(node1-N).max_in_branch.begin(),
-                                                               merge_info->at(node1-N).max_in_branch.end());
+                        move_max_in_branch(merge_info->at(node1-N), merge_info->at(i));
                         merge_info->at(i).min_nfa_in_branch = min(merge_info->at(i).nfa,
                                                                   merge_info->at(node1-N).min_nfa_in_branch);
                     }
@@ -2449,11 +2825,10 @@ void MaxMeaningfulClustering::build_merge_info(double *Z, double *X, int N, int
                         merge_info->at(i).min_nfa_in_branch = merge_info->at(i).nfa;
                         for (int k =0; k<(int)merge_info->at(node2-N).max_in_branch.size(); k++)
                             merge_info->at(merge_info->at(node2-N).max_in_branch.at(k)).max_meaningful = false;
+                        vector<int>().swap(merge_info->at(node2-N).max_in_branch);
                     } else {
                         merge_info->at(i).max_meaningful = false;
-                        merge_info->at(i).max_in_branch.insert(merge_info->at(i).max_in_branch.end(),
-                        merge_info->at(node2-N).max_in_branch.begin(),
-                        merge_info->at(node2-N).max_in_branch.end());
+                        move_max_in_branch(merge_info->at(node2-N), merge_info->at(i));
                         merge_info->at(i).min_nfa_in_branch = min(merge_info->at(i).nfa,
                         merge_info->at(node2-N).min_nfa_in_branch);
                     }
@@ -2467,15 +2842,13 @@ void MaxMeaningfulClustering::build_merge_info(double *Z, double *X, int N, int
         if (merge_info->at(i).max_meaningful)
         {
             vector<int> cluster;
-            for (int k=0; k<(int)merge_info->at(i).elements.size();k++)
-                cluster.push_back(merge_info->at(i).elements.at(k));
+            dendrogram_elements(*merge_info, N+i, N, cluster);
             meaningful_clusters->push_back(cluster);
         }
     }
 
 }
 
-
 int MaxMeaningfulClustering::nfa(float sigma, int k, int N)
 {
     // use an approximation for the nfa calculations (faster)
@@ -3062,7 +3435,7 @@ static void erGroupingGK(InputArray _image, InputArrayOfArrays _src, vector<vect
 
         unsigned int N = (unsigned int)regions.at(c).size();
         int dim = 7; //dimensionality of feature space
-        double *data = (double*)malloc(dim*N * sizeof(double));
+        float *data = (float*)malloc(dim*N * sizeof(float));
         if (data == NULL)
             CV_Error(Error::StsNoMem, "Not enough Memory for erGrouping hierarchical clustering structures!");
 
@@ -3077,14 +3450,14 @@ static void erGroupingGK(InputArray _image, InputArrayOfArrays _src, vector<vect
         int count = 0;
         for (int i=0; i<(int)regions.at(c).size(); i++)
         {
-            data[count] = (double)features.at(i).center.x/channel.cols*weight_param1;
-            data[count+1] = (double)features.at(i).center.y/channel.rows*weight_param1;
-            data[count+2] = (double)features.at(i).intensity_mean/255*weight_param2;
-            data[count+3] = (double)features.at(i).boundary_intensity_mean/255*weight_param3;
-            data[count+4] = (double)max(features.at(i).rect.height,features.at(i).rect.width)/
+            data[count] = (float)features.at(i).center.x/channel.cols*weight_param1;
+            data[count+1] = (float)features.at(i).center.y/channel.rows*weight_param1;
+            data[count+2] = (float)features.at(i).intensity_mean/255*weight_param2;
+            data[count+3] = (float)features.at(i).boundary_intensity_mean/255*weight_param3;
+            data[count+4] = (float)max(features.at(i).rect.height,features.at(i).rect.width)/
                                     max(channel.rows,channel.cols)*weight_param5;
-            data[count+5] = (double)features.at(i).stroke_mean/max_stroke*weight_param6;
-            data[count+6] = (double)features.at(i).gradient_mean/255*weight_param4;
+            data[count+5] = (float)features.at(i).stroke_mean/max_stroke*weight_param6;
+            data[count+6] = (float)features.at(i).gradient_mean/255*weight_param4;
 
             count = count+dim;
         }
@@ -47,6 +47,8 @@
 #include <iostream>
 #include <fstream>
 #include <queue>
+#include <map>
+#include <limits>
 
 namespace cv
 {
@@ -81,6 +83,17 @@ void OCRHMMDecoder::ClassifierCallback::eval( InputArray image, vector<int>& out
     out_confidence.clear();
 }
 
+void OCRHMMDecoder::ClassifierCallback::eval( InputArrayOfArrays images, vector< vector<int> >& out_classes,
+                                              vector< vector<double> >& out_confidences)
+{
+    vector<Mat> imgs;
+    images.getMatVector(imgs);
+    out_classes.resize(imgs.size());
+    out_confidences.resize(imgs.size());
+    for (size_t i=0; i<imgs.size(); i++)
+        eval(imgs[i], out_classes[i], out_confidences[i]);
+}
+
 
 bool sort_rect_horiz (Rect a,Rect b);
 bool sort_rect_horiz (Rect a,Rect b) { return (a.x<b.x); }
@@ -93,13 +106,32 @@ public:
                        const string& _vocabulary,
                        InputArray transition_probabilities_table,
                        InputArray emission_probabilities_table,
-                       decoder_mode _mode)
+                       decoder_mode _mode,
+                       int _beam_width)
     {
         classifier = _classifier;
         transition_p = transition_probabilities_table.getMat();
         emission_p = emission_probabilities_table.getMat();
         vocabulary = _vocabulary;
         mode = _mode;
+        beam_width = _beam_width;
+
+        CV_Assert( (mode == OCR_DECODER_VITERBI) || (mode == OCR_DECODER_VITERBI_BEAM) );
+        CV_Assert( beam_width > 0 );
+        CV_Assert( (transition_p.type() == CV_64FC1) && (emission_p.type() == CV_64FC1) );
+
+        //This must be extracted from dictionary, or just assumed to be equal for all characters
+        start_p.assign(vocabulary.size(), 1.0/vocabulary.size());
+
+        log_transition_p.create(transition_p.size(), CV_64FC1);
+        for (int j=0; j<transition_p.rows; j++)
+        {
+            for (int i=0; i<transition_p.cols; i++)
+            {
+                double p = transition_p.at<double>(j,i);
+                log_transition_p.at<double>(j,i) = (p > 0) ? std::log(p) : -std::numeric_limits<double>::infinity();
+            }
+        }
     }
 
     ~OCRHMMDecoderImpl()
@@ -250,103 +282,219 @@ public:
 
             sort(contours_rect.begin(), contours_rect.end(), sort_rect_horiz);
 
-            // Do character recognition foreach contour
+            // Do character recognition for all the contours of the word at once
+            vector<Mat> char_masks(contours.size());
             for (int i=0; i<(int)contours.size(); i++)
+                words_mask[w](contours_rect.at(i)).copyTo(char_masks[i]);
+
+            classifier->eval(char_masks,observations,confidences);
+            for (int i=0; i<(int)observations.size(); i++)
             {
-                Mat tmp_mask;
-                words_mask[w](contours_rect.at(i)).copyTo(tmp_mask);
-
-                vector<int> out_class;
-                vector<double> out_conf;
-                classifier->eval(tmp_mask,out_class,out_conf);
-                if (!out_class.empty())
-                    obs.push_back(out_class[0]);
-                observations.push_back(out_class);
-                confidences.push_back(out_conf);
+                if (!observations[i].empty())
+                    obs.push_back(observations[i][0]);
             }
 
 
-            //This must be extracted from dictionary, or just assumed to be equal for all characters
-            vector<double> start_p(vocabulary.size());
-            for (int i=0; i<(int)vocabulary.size(); i++)
-                start_p[i] = 1.0/vocabulary.size();
+            if (obs.empty())
+                continue;
 
+            string word;
+            double max_prob;
+            if (mode == OCR_DECODER_VITERBI_BEAM)
+                max_prob = decodeBeam(observations, confidences, obs, word);
+            else
+                max_prob = decodeViterbi(observations, confidences, obs, word);
 
-            Mat V = Mat::zeros((int)observations.size(),(int)vocabulary.size(),CV_64FC1);
-            vector<string> path(vocabulary.size());
+            out_sequence = out_sequence+" "+word;
 
-            // Initialize base cases (t == 0)
-            for (int i=0; i<(int)vocabulary.size(); i++)
-            {
-                for (int j=0; j<(int)observations[0].size(); j++)
-                {
-                    emission_p.at<double>(observations[0][j],obs[0]) = confidences[0][j];
-                }
-                V.at<double>(0,i) = start_p[i] * emission_p.at<double>(i,obs[0]);
-                path[i] = vocabulary.at(i);
-            }
+            if (component_rects != NULL)
+                component_rects->push_back(words_rect[w]);
+            if (component_texts != NULL)
+                component_texts->push_back(word);
+            if (component_confidences != NULL)
+                component_confidences->push_back((float)max_prob);
 
+        }
 
-            // Run Viterbi for t > 0
-            for (int t=1; t<(int)obs.size(); t++)
-            {
+        return;
+    }
 
-                //Dude this has to be done each time!!
-                emission_p = Mat::eye(62,62,CV_64FC1);
-                for (int e=0; e<(int)observations[t].size(); e++)
-                {
-                    emission_p.at<double>(observations[t][e],obs[t]) = confidences[t][e];
-                }
+private:
+    // trellis buffers, reused between calls
+    vector<double> start_p;
+    Mat log_transition_p;
+    vector<double> emission;
+    vector<double> prev_scores;
+    vector<double> scores;
+    vector<int> backpointers; // obs.size() x vocabulary.size()
+    vector<int> beam;
+    vector< pair<double,int> > candidates;
+
+    // emission probabilities of all the states for the observation at time t
+    void setEmission(const vector<int>& observation, const vector<double>& confidence, int ob)
+    {
+        emission.resize(vocabulary.size());
+        for (int i=0; i<(int)vocabulary.size(); i++)
+            emission[i] = emission_p.at<double>(i,ob);
+        for (int e=0; e<(int)observation.size(); e++)
+            emission[observation[e]] = confidence[e];
+    }
 
-                vector<string> newpath(vocabulary.size());
+    // follows the backpointers from the last state
+    void backtrack(int state, int num_steps, string& word)
+    {
+        int num_states = (int)vocabulary.size();
+        word.resize(num_steps);
+        for (int t=num_steps-1; t>=0; t--)
+        {
+            word[t] = vocabulary.at(state);
+            if (t > 0)
+                state = backpointers[t*num_states+state];
+        }
+    }
+
+    double decodeViterbi(const vector< vector<int> >& observations, const vector< vector<double> >& confidences,
+                         const vector<int>& obs, string& word)
+    {
+        int num_states = (int)vocabulary.size();
+        int num_steps = (int)obs.size();
+        prev_scores.resize(num_states);
+        scores.resize(num_states);
+        backpointers.resize((size_t)num_steps*num_states);
+
+        // Initialize base cases (t == 0)
+        setEmission(observations[0], confidences[0], obs[0]);
+        for (int i=0; i<num_states; i++)
+            prev_scores[i] = start_p[i] * emission[i];
+
+        // Run Viterbi for t > 0
+        for (int t=1; t<num_steps; t++)
+        {
+            setEmission(observations[t], confidences[t], obs[t]);
+            int* bp = &backpointers[t*num_states];
 
-                for (int i=0; i<(int)vocabulary.size(); i++)
+            for (int i=0; i<num_states; i++)
+            {
+                double max_prob = 0;
+                int best_idx = 0;
+                // states the observation can not emit stay at zero
+                if (emission[i] != 0)
                 {
-                    double max_prob = 0;
-                    int best_idx = 0;
-                    for (int j=0; j<(int)vocabulary.size(); j++)
+                    for (int j=0; j<num_states; j++)
                     {
-                        double prob = V.at<double>(t-1,j) * transition_p.at<double>(j,i) * emission_p.at<double>(i,obs[t]);
+                        double prob = prev_scores[j] * transition_p.at<double>(j,i) * emission[i];
                         if ( prob > max_prob)
                         {
                             max_prob = prob;
                             best_idx = j;
                         }
                     }
-
-                    V.at<double>(t,i) = max_prob;
-                    newpath[i] = path[best_idx] + vocabulary.at(i);
                 }
+                scores[i] = max_prob;
+                bp[i] = best_idx;
+            }
+            prev_scores.swap(scores);
+        }
 
-                // Don't need to remember the old paths
-                path.swap(newpath);
+        double max_prob = 0;
+        int best_idx = 0;
+        for (int i=0; i<num_states; i++)
+        {
+            if ( prev_scores[i] > max_prob)
+            {
+                max_prob = prev_scores[i];
+                best_idx = i;
             }
+        }
+
+        backtrack(best_idx, num_steps, word);
+        return max_prob;
+    }
 
-            double max_prob = 0;
-            int best_idx = 0;
-            for (int i=0; i<(int)vocabulary.size(); i++)
+    // keeps the beam_width best scored states (in index order)
+    void selectBeam()
+    {
+        candidates.clear();
+        for (int i=0; i<(int)prev_scores.size(); i++)
+        {
+            if (prev_scores[i] > -std::numeric_limits<double>::infinity())
+                candidates.push_back(make_pair(-prev_scores[i], i));
+        }
+        if ((int)candidates.size() > beam_width)
+        {
+            nth_element(candidates.begin(), candidates.begin()+beam_width, candidates.end());
+            candidates.resize(beam_width);
+        }
+        beam.clear();
+        for (int c=0; c<(int)candidates.size(); c++)
+            beam.push_back(candidates[c].second);
+        sort(beam.begin(), beam.end());
+    }
+
+    double decodeBeam(const vector< vector<int> >& observations, const vector< vector<double> >& confidences,
+                      const vector<int>& obs, string& word)
+    {
+        const double minus_inf = -std::numeric_limits<double>::infinity();
+        int num_states = (int)vocabulary.size();
+        int num_steps = (int)obs.size();
+        prev_scores.resize(num_states);
+        scores.resize(num_states);
+        backpointers.resize((size_t)num_steps*num_states);
+
+        // Initialize base cases (t == 0)
+        setEmission(observations[0], confidences[0], obs[0]);
+        for (int i=0; i<num_states; i++)
+            prev_scores[i] = (emission[i] > 0) ? std::log(start_p[i]) + std::log(emission[i]) : minus_inf;
+        selectBeam();
+
+        // Extend the beam for t > 0
+        for (int t=1; t<num_steps; t++)
+        {
+            setEmission(observations[t], confidences[t], obs[t]);
+            int* bp = &backpointers[t*num_states];
+
+            for (int i=0; i<num_states; i++)
             {
-                double prob = V.at<double>((int)obs.size()-1,i);
-                if ( prob > max_prob)
+                scores[i] = minus_inf;
+                bp[i] = 0;
+                if (emission[i] <= 0)
+                    continue;
+
+                double max_score = minus_inf;
+                int best_idx = 0;
+                for (int b=0; b<(int)beam.size(); b++)
                 {
-                    max_prob = prob;
-                    best_idx = i;
+                    int j = beam[b];
+                    double score = prev_scores[j] + log_transition_p.at<double>(j,i);
+                    if (score > max_score)
+                    {
+                        max_score = score;
+                        best_idx = j;
+                    }
+                }
+                if (max_score > minus_inf)
+                {
+                    scores[i] = max_score + std::log(emission[i]);
+                    bp[i] = best_idx;
                 }
             }
+            prev_scores.swap(scores);
+            selectBeam();
+        }
 
-            //cout << path[best_idx] << endl;
-            out_sequence = out_sequence+" "+path[best_idx];
-
-            if (component_rects != NULL)
-                component_rects->push_back(words_rect[w]);
-            if (component_texts != NULL)
-                component_texts->push_back(path[best_idx]);
-            if (component_confidences != NULL)
-                component_confidences->push_back((float)max_prob);
-
+        double max_score = minus_inf;
+        int best_idx = 0;
+        for (int i=0; i<num_states; i++)
+        {
+            if (prev_scores[i] > max_score)
+            {
+                max_score = prev_scores[i];
+                best_idx = i;
+            }
         }
 
-        return;
+        backtrack(best_idx, num_steps, word);
+        return std::exp(max_score);
     }
 };
 
@@ -354,28 +502,113 @@ Ptr<OCRHMMDecoder> OCRHMMDecoder::create( Ptr<OCRHMMDecoder::ClassifierCallback>
                                           const string& _vocabulary,
                                           InputArray transition_p,
                                           InputArray emission_p,
-                                          decoder_mode _mode)
+                                          decoder_mode _mode,
+                                          int _beam_width)
 {
-    return makePtr<OCRHMMDecoderImpl>(_classifier, _vocabulary, transition_p, emission_p, _mode);
+    return makePtr<OCRHMMDecoderImpl>(_classifier, _vocabulary, transition_p, emission_p, _mode, _beam_width);
 }
 
 
+// squared euclidean distance between two feature vectors
+static inline float featureDistance(const float* a, const float* b, int n)
+{
+    int i = 0;
+    float s = 0.f;
+#if CV_SSE2
+    if( checkHardwareSupport( CV_CPU_SSE2 ) )
+    {
+        __m128 acc = _mm_setzero_ps();
+        for ( ; i <= n - 4; i += 4 )
+        {
+            __m128 d = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+            acc = _mm_add_ps(acc, _mm_mul_ps(d, d));
+        }
+        float CV_DECL_ALIGNED(16) buf[4];
+        _mm_store_ps(buf, acc);
+        s = (buf[0] + buf[1]) + (buf[2] + buf[3]);
+    }
+#elif CV_NEON
+    float32x4_t acc = vdupq_n_f32(0.f);
+    for ( ; i <= n - 4; i += 4 )
+    {
+        float32x4_t d = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+        acc = vmlaq_f32(acc, d, d);
+    }
+    float32x2_t s2 = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    s = vget_lane_f32(vpadd_f32(s2, s2), 0);
+#endif
+    for ( ; i < n; i++ )
+    {
+        float d = a[i] - b[i];
+        s += d*d;
+    }
+    return s;
+}
+
+// FNV-1a hash of a character mask, used as the cache key
+static uint64 maskHash(const Mat& mask)
+{
+    uint64 h = CV_BIG_UINT(14695981039346656037);
+    h = (h ^ (uint64)mask.rows) * CV_BIG_UINT(1099511628211);
+    h = (h ^ (uint64)mask.cols) * CV_BIG_UINT(1099511628211);
+    for (int y=0; y<mask.rows; y++)
+    {
+        const uchar* row = mask.ptr<uchar>(y);
+        for (int x=0; x<mask.cols; x++)
+            h = (h ^ row[x]) * CV_BIG_UINT(1099511628211);
+    }
+    return h;
+}
+
+static bool sameMask(const Mat& a, const Mat& b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (int y=0; y<a.rows; y++)
+    {
+        if (!equal(a.ptr<uchar>(y), a.ptr<uchar>(y)+a.cols, b.ptr<uchar>(y)))
+            return false;
+    }
+    return true;
+}
+
 class CV_EXPORTS OCRHMMClassifierKNN : public OCRHMMDecoder::ClassifierCallback
 {
 public:
     //constructor
-    OCRHMMClassifierKNN(const std::string& filename);
+    OCRHMMClassifierKNN(const std::string& filename, int cacheSize = 0);
     // Destructor
     ~OCRHMMClassifierKNN() {}
 
     void eval( InputArray mask, vector<int>& out_class, vector<double>& out_confidence );
+    void eval( InputArrayOfArrays masks, vector< vector<int> >& out_classes, vector< vector<double> >& out_confidences );
 private:
-    Ptr<KNearest> knn;
+    // the classification of an already seen mask
+    struct CachedChar
+    {
+        Mat mask;
+        vector<int> out_class;
+        vector<double> out_confidence;
+    };
+
+    static const int num_features = 200;
+    static const int num_neighbours = 11;
+
+    bool extractFeatures( const Mat& mask, float* sample );
+    void vote( const float* responses, const float* dists, int k,
+               vector<int>& out_class, vector<double>& out_confidence );
+
+    Mat train_samples;   // one contiguous CV_32F row per training sample
+    Mat train_responses; // CV_32F labels
+    vector<vector<int> > equivalency_mat;
+    int cache_size;
+    map<uint64, CachedChar> cache;
 };
 
-OCRHMMClassifierKNN::OCRHMMClassifierKNN (const string& filename)
+OCRHMMClassifierKNN::OCRHMMClassifierKNN (const string& filename, int cacheSize)
 {
-    knn = KNearest::create();
+    CV_Assert( cacheSize >= 0 );
+    cache_size = cacheSize;
     if (ifstream(filename.c_str()))
     {
         Mat hus, labels;
@@ -383,24 +616,141 @@ OCRHMMClassifierKNN::OCRHMMClassifierKNN (const string& filename)
         storage["hus"] >> hus;
         storage["labels"] >> labels;
         storage.release();
-        knn->train(hus, ROW_SAMPLE, labels);
+        CV_Assert( !hus.empty() && hus.cols == num_features && (int)labels.total() == hus.rows );
+        hus.convertTo(train_samples, CV_32F);
+        labels.reshape(1, 1).convertTo(train_responses, CV_32F);
     }
     else
         CV_Error(Error::StsBadArg, "Default classifier data file not found!");
+
+    equivalency_mat.resize(62);
+    equivalency_mat[2].push_back(28);  // c -> C
+    equivalency_mat[28].push_back(2);  // C -> c
+    equivalency_mat[8].push_back(34);  // i -> I
+    equivalency_mat[8].push_back(11);  // i -> l
+    equivalency_mat[11].push_back(8);  // l -> i
+    equivalency_mat[11].push_back(34); // l -> I
+    equivalency_mat[34].push_back(8);  // I -> i
+    equivalency_mat[34].push_back(11); // I -> l
+    equivalency_mat[9].push_back(35);  // j -> J
+    equivalency_mat[35].push_back(9);  // J -> j
+    equivalency_mat[14].push_back(40); // o -> O
+    equivalency_mat[14].push_back(52); // o -> 0
+    equivalency_mat[40].push_back(14); // O -> o
+    equivalency_mat[40].push_back(52); // O -> 0
+    equivalency_mat[52].push_back(14); // 0 -> o
+    equivalency_mat[52].push_back(40); // 0 -> O
+    equivalency_mat[15].push_back(41); // p -> P
+    equivalency_mat[41].push_back(15); // P -> p
+    equivalency_mat[18].push_back(44); // s -> S
+    equivalency_mat[44].push_back(18); // S -> s
+    equivalency_mat[20].push_back(46); // u -> U
+    equivalency_mat[46].push_back(20); // U -> u
+    equivalency_mat[21].push_back(47); // v -> V
+    equivalency_mat[47].push_back(21); // V -> v
+    equivalency_mat[22].push_back(48); // w -> W
+    equivalency_mat[48].push_back(22); // W -> w
+    equivalency_mat[23].push_back(49); // x -> X
+    equivalency_mat[49].push_back(23); // X -> x
+    equivalency_mat[25].push_back(51); // z -> Z
+    equivalency_mat[51].push_back(25); // Z -> z
 }
 
 void OCRHMMClassifierKNN::eval( InputArray _mask, vector<int>& out_class, vector<double>& out_confidence )
 {
-    CV_Assert( _mask.getMat().type() == CV_8UC1 );
+    vector<Mat> masks(1, _mask.getMat());
+    vector< vector<int> > out_classes;
+    vector< vector<double> > out_confidences;
+    eval(masks, out_classes, out_confidences);
+    out_class.swap(out_classes[0]);
+    out_confidence.swap(out_confidences[0]);
+}
 
-    out_class.clear();
-    out_confidence.clear();
+void OCRHMMClassifierKNN::eval( InputArrayOfArrays _masks, vector< vector<int> >& out_classes,
+                                vector< vector<double> >& out_confidences )
+{
+    vector<Mat> masks;
+    _masks.getMatVector(masks);
+
+    out_classes.assign(masks.size(), vector<int>());
+    out_confidences.assign(masks.size(), vector<double>());
+
+    // features of the masks not found in the cache, one row each
+    Mat samples((int)masks.size(), num_features, CV_32FC1);
+    vector<int> sample_idx;
+    vector<uint64> keys(masks.size());
+    for (int i=0; i<(int)masks.size(); i++)
+    {
+        CV_Assert( masks[i].type() == CV_8UC1 );
+
+        if (cache_size > 0)
+        {
+            keys[i] = maskHash(masks[i]);
+            map<uint64, CachedChar>::const_iterator it = cache.find(keys[i]);
+            if ((it != cache.end()) && sameMask(it->second.mask, masks[i]))
+            {
+                out_classes[i] = it->second.out_class;
+                out_confidences[i] = it->second.out_confidence;
+                continue;
+            }
+        }
+
+        if (extractFeatures(masks[i], samples.ptr<float>((int)sample_idx.size())))
+            sample_idx.push_back(i);
+    }
+
+    if (sample_idx.empty())
+        return;
+
+    int num_samples = (int)sample_idx.size();
+    int num_train = train_samples.rows;
+    int k = (num_neighbours < num_train) ? num_neighbours : num_train;
+
+    // brute force distances, each training sample is read once for the whole batch
+    Mat dists(num_samples, num_train, CV_32FC1);
+    for (int t=0; t<num_train; t++)
+    {
+        const float* train_row = train_samples.ptr<float>(t);
+        for (int q=0; q<num_samples; q++)
+            dists.at<float>(q,t) = featureDistance(samples.ptr<float>(q), train_row, num_features);
+    }
+
+    vector< pair<float,int> > neighbours(num_train);
+    vector<float> nn_responses(k), nn_dists(k);
+    for (int q=0; q<num_samples; q++)
+    {
+        // k nearest neighbours, ties resolved by training order as in KNearest
+        const float* dist_row = dists.ptr<float>(q);
+        for (int t=0; t<num_train; t++)
+            neighbours[t] = make_pair(dist_row[t], t);
+        partial_sort(neighbours.begin(), neighbours.begin()+k, neighbours.end());
+        for (int j=0; j<k; j++)
+        {
+            nn_dists[j] = neighbours[j].first;
+            nn_responses[j] = train_responses.at<float>(0,neighbours[j].second);
+        }
 
+        int i = sample_idx[q];
+        vote(&nn_responses[0], &nn_dists[0], k, out_classes[i], out_confidences[i]);
+
+        if (cache_size > 0)
+        {
+            if ((int)cache.size() >= cache_size)
+                cache.clear();
+            CachedChar& cached = cache[keys[i]];
+            masks[i].copyTo(cached.mask);
+            cached.out_class = out_classes[i];
+            cached.out_confidence = out_confidences[i];
+        }
+    }
+}
+
+bool OCRHMMClassifierKNN::extractFeatures( const Mat& _mask, float* _sample )
+{
     int image_height = 35;
     int image_width = 35;
-    int num_features = 200;
 
-    Mat img = _mask.getMat();
+    Mat img = _mask;
     Mat tmp;
     img.copyTo(tmp);
 
@@ -410,7 +760,7 @@ void OCRHMMClassifierKNN::eval( InputArray _mask, vector<int>& out_class, vector
     findContours( tmp, contours, hierarchy, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE, Point(0, 0) );
 
     if (contours.empty())
-        return;
+        return false;
 
     int idx = 0;
     if (contours.size() > 1)
@@ -432,7 +782,10 @@ void OCRHMMClassifierKNN::eval( InputArray _mask, vector<int>& out_class, vector
         // clean-up the outside of the contour
         Mat tmp_c = Mat::zeros(tmp.rows, tmp.cols, CV_8UC1);
         drawContours(tmp_c, contours, idx, Scalar(255), FILLED);
-        img = img & tmp_c;
+        // into a new matrix, the caller's mask is kept as it was (it may be cached)
+        Mat cleaned;
+        bitwise_and(img, tmp_c, cleaned);
+        img = cleaned;
     }
     Rect bbox = boundingRect(contours[idx]);
 
@@ -505,7 +858,7 @@ void OCRHMMClassifierKNN::eval( InputArray _mask, vector<int>& out_class, vector
     }
 
     //Generate features for each bitmap
-    Mat sample = Mat(1,num_features,CV_32FC1);
+    Mat sample = Mat(1,num_features,CV_32FC1,_sample);
     Mat patch;
     for (int i=0; i<(int)maps.size(); i++)
     {
@@ -522,61 +875,51 @@ void OCRHMMClassifierKNN::eval( InputArray _mask, vector<int>& out_class, vector
         }
     }
 
-    Mat responses,dists,predictions;
-    knn->findNearest( sample, 11, predictions, responses, dists);
-
-    Scalar dist_sum = sum(dists);
-    Mat class_predictions = Mat::zeros(1,62,CV_64FC1);
+    return true;
+}
 
-    vector<vector<int> > equivalency_mat(62);
-    equivalency_mat[2].push_back(28);  // c -> C
-    equivalency_mat[28].push_back(2);  // C -> c
-    equivalency_mat[8].push_back(34);  // i -> I
-    equivalency_mat[8].push_back(11);  // i -> l
-    equivalency_mat[11].push_back(8);  // l -> i
-    equivalency_mat[11].push_back(34); // l -> I
-    equivalency_mat[34].push_back(8);  // I -> i
-    equivalency_mat[34].push_back(11); // I -> l
-    equivalency_mat[9].push_back(35);  // j -> J
-    equivalency_mat[35].push_back(9);  // J -> j
-    equivalency_mat[14].push_back(40); // o -> O
-    equivalency_mat[14].push_back(52); // o -> 0
-    equivalency_mat[40].push_back(14); // O -> o
-    equivalency_mat[40].push_back(52); // O -> 0
-    equivalency_mat[52].push_back(14); // 0 -> o
-    equivalency_mat[52].push_back(40); // 0 -> O
-    equivalency_mat[15].push_back(41); // p -> P
-    equivalency_mat[41].push_back(15); // P -> p
-    equivalency_mat[18].push_back(44); // s -> S
-    equivalency_mat[44].push_back(18); // S -> s
-    equivalency_mat[20].push_back(46); // u -> U
-    equivalency_mat[46].push_back(20); // U -> u
-    equivalency_mat[21].push_back(47); // v -> V
-    equivalency_mat[47].push_back(21); // V -> v
-    equivalency_mat[22].push_back(48); // w -> W
-    equivalency_mat[48].push_back(22); // W -> w
-    equivalency_mat[23].push_back(49); // x -> X
-    equivalency_mat[49].push_back(23); // X -> x
-    equivalency_mat[25].push_back(51); // z -> Z
-    equivalency_mat[51].push_back(25); // Z -> z
+void OCRHMMClassifierKNN::vote( const float* responses, const float* dists, int k,
+                                vector<int>& out_class, vector<double>& out_confidence )
+{
+    // majority vote among the neighbours, the smallest label wins on ties (as KNearest)
+    vector<float> sorted_responses(responses, responses+k);
+    sort(sorted_responses.begin(), sorted_responses.end());
+    float prediction = sorted_responses[0];
+    int best_count = 0, prev_start = 0;
+    for (int j=1; j<=k; j++)
+    {
+        if ((j == k) || (sorted_responses[j] != sorted_responses[j-1]))
+        {
+            if (best_count < j-prev_start)
+            {
+                best_count = j-prev_start;
+                prediction = sorted_responses[j-1];
+            }
+            prev_start = j;
+        }
+    }
 
+    double dist_sum = 0;
+    for (int j=0; j<k; j++)
+        dist_sum += dists[j];
+    Mat class_predictions = Mat::zeros(1,62,CV_64FC1);
 
-    for (int j=0; j<responses.cols; j++)
+    for (int j=0; j<k; j++)
     {
-        if (responses.at<float>(0,j)<0)
+        if (responses[j]<0)
             continue;
-        class_predictions.at<double>(0,(int)responses.at<float>(0,j)) += dists.at<float>(0,j);
-        for (int e=0; e<(int)equivalency_mat[(int)responses.at<float>(0,j)].size(); e++)
+        class_predictions.at<double>(0,(int)responses[j]) += dists[j];
+        for (int e=0; e<(int)equivalency_mat[(int)responses[j]].size(); e++)
         {
-            class_predictions.at<double>(0,equivalency_mat[(int)responses.at<float>(0,j)][e]) += dists.at<float>(0,j);
-            dist_sum[0] +=  dists.at<float>(0,j);
+            class_predictions.at<double>(0,equivalency_mat[(int)responses[j]][e]) += dists[j];
+            dist_sum +=  dists[j];
         }
     }
 
-    class_predictions = class_predictions/dist_sum[0];
+    class_predictions = class_predictions/dist_sum;
 
-    out_class.push_back((int)predictions.at<float>(0,0));
-    out_confidence.push_back(class_predictions.at<double>(0,(int)predictions.at<float>(0,0)));
+    out_class.push_back((int)prediction);
+    out_confidence.push_back(class_predictions.at<double>(0,(int)prediction));
 
     for (int i=0; i<class_predictions.cols; i++)
     {
@@ -590,10 +933,10 @@ void OCRHMMClassifierKNN::eval( InputArray _mask, vector<int>& out_class, vector
 }
 
 
-Ptr<OCRHMMDecoder::ClassifierCallback> loadOCRHMMClassifierNM(const std::string& filename)
+Ptr<OCRHMMDecoder::ClassifierCallback> loadOCRHMMClassifierNM(const std::string& filename, int cacheSize)
 
 {
-    return makePtr<OCRHMMClassifierKNN>(filename);
+    return makePtr<OCRHMMClassifierKNN>(filename, cacheSize);
 }
 
 }